@@ -0,0 +1,387 @@
+
+
+
+#include "ChessBenchmarkCommandlet.h"
+
+#include "ChessExperience.h"
+#include "ChessBitboard.h"
+#include "ChessNotation.h"
+#include "ChessTablebase.h"
+#include "ChessTestCases.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	struct FTablebaseCase
+	{
+		const TCHAR* Name;
+		const TCHAR* FEN;
+		EChessWDL::Type WDL;
+		int32 DTZ;
+	};
+
+	// Positions whose values follow from the rules alone: mates in one, a promotion no king can stop, a hanging rook, the corner draw
+	const FTablebaseCase TablebaseCases[] =
+	{
+		{ TEXT("KQvKMateInOne"), TEXT("k7/8/1K6/8/8/8/8/7Q w - - 0 1"), EChessWDL::Win, 1 },
+		{ TEXT("KRvKMateInOne"), TEXT("k7/8/K7/8/8/8/8/7R w - - 0 1"), EChessWDL::Win, 1 },
+		{ TEXT("KRvKHangingRook"), TEXT("8/8/8/8/8/8/6kR/K7 b - - 0 1"), EChessWDL::Draw, 0 },
+		{ TEXT("KPvKPromotion"), TEXT("8/4P3/8/8/8/8/8/K6k w - - 0 1"), EChessWDL::Win, 1 },
+		{ TEXT("KPvKCornerDraw"), TEXT("k7/8/8/8/8/8/P7/K7 w - - 0 1"), EChessWDL::Draw, 0 },
+	};
+
+	const int32 BenchmarkSizes[] = { 1, 100, 10000 };
+}
+
+UChessBenchmarkCommandlet::UChessBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UChessBenchmarkCommandlet::Main(const FString& Params)
+{
+	FString outputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / TEXT("ChessBenchmark.json");
+	FString format;
+	FParse::Value(*Params, TEXT("output="), outputPath);
+	FParse::Value(*Params, TEXT("format="), format);
+	FParse::Value(*Params, TEXT("mintime="), m_MinSeconds);
+	const bool quick = FParse::Param(*Params, TEXT("quick"));
+	FString tablebaseDirectory;
+	FParse::Value(*Params, TEXT("tablebase="), tablebaseDirectory);
+
+	if (format.IsEmpty())
+		format = FPaths::GetExtension(outputPath).Equals(TEXT("csv"), ESearchCase::IgnoreCase) ? TEXT("csv") : TEXT("json");
+
+	m_Rows.Reset();
+	RunPerft(quick);
+	RunInstructions();
+	RunAnims();
+	RunBoardUpdates();
+	RunPieceUpdates();
+	if (!tablebaseDirectory.IsEmpty())
+		RunTablebase(tablebaseDirectory);
+
+	const bool csv = format.Equals(TEXT("csv"), ESearchCase::IgnoreCase);
+	if (!FFileHelper::SaveStringToFile(csv ? ToCSV() : ToJSON(), *outputPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not write benchmark results to %s"), *outputPath);
+		return 1;
+	}
+
+	int32 failures = 0;
+	for (const FChessBenchmarkRow& row : m_Rows)
+	{
+		if (!row.Passed)
+		{
+			UE_LOG(LogTemp, Error, TEXT("%s.%s failed: %llu, expected %llu"), *row.Suite, *row.Name, row.Result, row.Expected);
+			++failures;
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Chess benchmark wrote %d results to %s, %d failed"), m_Rows.Num(), *outputPath, failures);
+	return failures > 0 ? 1 : 0;
+}
+
+template<typename FunctionType>
+FChessBenchmarkRow& UChessBenchmarkCommandlet::Measure(const TCHAR* suite, const TCHAR* name, int32 size, FunctionType&& body)
+{
+	FChessBenchmarkRow& row = m_Rows.AddDefaulted_GetRef();
+	row.Suite = suite;
+	row.Name = name;
+	row.Size = size;
+
+	// Doubling batches keep the clock reads out of cheap bodies
+	uint64 batch = 1;
+	const double start = FPlatformTime::Seconds();
+	do
+	{
+		for (uint64 i = 0; i < batch; ++i)
+		{
+			body();
+		}
+
+		row.Iterations += batch;
+		batch *= 2;
+		row.Seconds = FPlatformTime::Seconds() - start;
+	}
+	while (row.Seconds < m_MinSeconds);
+
+	UE_LOG(LogTemp, Display, TEXT("%s.%s [%d]: %.0f/s"), suite, name, size, row.GetPerSecond());
+	return row;
+}
+
+void UChessBenchmarkCommandlet::RunPerft(bool quick)
+{
+	for (const FChessPerftCase& perftCase : CHESS_PERFT_CASES)
+	{
+		FChessBenchmarkRow& row = m_Rows.AddDefaulted_GetRef();
+		row.Suite = TEXT("Perft");
+		row.Name = perftCase.Name;
+		row.Size = quick ? perftCase.Depth - 1 : perftCase.Depth;
+		row.Expected = quick ? perftCase.ShallowNodes : perftCase.Nodes;
+
+		FChessBitboardPosition position;
+		if (!ParseFEN(perftCase.FEN, position))
+		{
+			row.Passed = false;
+			continue;
+		}
+
+		const double start = FPlatformTime::Seconds();
+		row.Result = Perft(position, row.Size);
+		row.Seconds = FPlatformTime::Seconds() - start;
+		row.Iterations = row.Result;
+		row.Passed = row.Result == row.Expected;
+
+		UE_LOG(LogTemp, Display, TEXT("Perft.%s depth %d: %llu nodes, %.2f Mnps"), perftCase.Name, row.Size, row.Result, row.GetPerSecond() / 1000000.0);
+	}
+}
+
+void UChessBenchmarkCommandlet::RunInstructions()
+{
+	// Raw rules engine, no actor around it. The round trips are checked by the NajiExperience.Chess automation tests.
+	{
+		ChessGame game;
+		AChessGame::SetupGame(nullptr, nullptr, game);
+
+		int32 moveIdx = 0;
+		Measure(TEXT("Instructions"), TEXT("ChessGameRoundTrip"), 1, [&game, &moveIdx]()
+		{
+			const FChessTileMove& move = CHESS_ROUND_TRIP_MOVES[moveIdx];
+			moveIdx = (moveIdx + 1) % UE_ARRAY_COUNT(CHESS_ROUND_TRIP_MOVES);
+
+			game.EvaluateInstruction(MakeMoveInstruction(move.FromX, move.FromY, move.ToX, move.ToY));
+			game.UndoInstruction();
+		});
+	}
+
+	// Full actor pipeline, including the incremental piece and bitboard sync
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("ChessBenchmark"));
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+
+	if (AChessGame* chessGame = world->SpawnActor<AChessGame>())
+	{
+		chessGame->Setup(nullptr, nullptr);
+
+		int32 moveIdx = 0;
+		Measure(TEXT("Instructions"), TEXT("AChessGameRoundTrip"), 1, [chessGame, &moveIdx]()
+		{
+			const FChessTileMove& move = CHESS_ROUND_TRIP_MOVES[moveIdx];
+			moveIdx = (moveIdx + 1) % UE_ARRAY_COUNT(CHESS_ROUND_TRIP_MOVES);
+
+			chessGame->EvaluateInstruction(MakeMoveInstruction(move.FromX, move.FromY, move.ToX, move.ToY));
+			chessGame->UndoLastInstruction();
+		});
+
+		chessGame->Destroy();
+	}
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+}
+
+void UChessBenchmarkCommandlet::RunPieceUpdates()
+{
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("ChessBenchmark"));
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+
+	for (int32 size : BenchmarkSizes)
+	{
+		// size pieces spread over as many boards as needed, every board in its start position
+		const int32 numBoards = FMath::DivideAndRoundUp(size, MAX_BOARD_PIECES);
+		TArray<AChessGame*> chessGames;
+		for (int32 board = 0; board < numBoards; ++board)
+		{
+			if (AChessGame* chessGame = world->SpawnActor<AChessGame>())
+			{
+				chessGame->Setup(nullptr, nullptr);
+				chessGames.Add(chessGame);
+			}
+		}
+
+		// Cost of a full rescan of every board
+		Measure(TEXT("Board"), TEXT("UpdatePiecesPositions"), size, [&chessGames]()
+		{
+			for (AChessGame* chessGame : chessGames)
+			{
+				chessGame->UpdatePiecesPositions(nullptr);
+			}
+		});
+
+		for (AChessGame* chessGame : chessGames)
+		{
+			chessGame->Destroy();
+		}
+	}
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+}
+
+void UChessBenchmarkCommandlet::RunAnims()
+{
+	const FChessAnimUpdate updateInfo = { 1.0f / 60.0f };
+
+	for (int32 size : BenchmarkSizes)
+	{
+		TArray<FVector2D> initial;
+		TArray<FVector2D> target;
+		TArray<float> elapsed;
+		TArray<FVector2D> positions;
+		initial.SetNumUninitialized(size);
+		target.SetNumUninitialized(size);
+		elapsed.SetNumZeroed(size);
+		positions.SetNumUninitialized(size);
+
+		for (int32 i = 0; i < size; ++i)
+		{
+			initial[i] = FVector2D(i % Chess::BOARD_SIZE, i / Chess::BOARD_SIZE);
+			target[i] = initial[i] + FVector2D(1.0, 2.0);
+		}
+
+		// Long enough that nothing finishes, the steady state of a busy frame
+		TArray<int32> finished;
+		Measure(TEXT("Anim"), TEXT("UpdateAnimInstances"), size, [&]()
+		{
+			finished.Reset();
+			UpdateAnimInstances(updateInfo, 1.0e9f, EChessAnimEasing::QuadOut, initial, target, elapsed, positions, finished);
+		});
+	}
+}
+
+void UChessBenchmarkCommandlet::RunBoardUpdates()
+{
+	for (int32 size : BenchmarkSizes)
+	{
+		// size pieces spread over as many boards as needed, each with its own lookup
+		const int32 numBoards = FMath::DivideAndRoundUp(size, MAX_BOARD_PIECES);
+		TArray<FChessInstancedMeshLookup> lookups;
+		lookups.SetNum(numBoards);
+		for (int32 board = 0; board < numBoards; ++board)
+		{
+			TArray<FChessInstancedMesh> instancedMeshes;
+			instancedMeshes.SetNum(FMath::Min(size - board * MAX_BOARD_PIECES, MAX_BOARD_PIECES));
+			for (int32 i = 0; i < instancedMeshes.Num(); ++i)
+			{
+				instancedMeshes[i].PieceIdx = static_cast<Chess::PieceIdx>(i);
+				instancedMeshes[i].PieceType = EChessPieceType::Pawn;
+			}
+			lookups[board].Build(instancedMeshes);
+		}
+
+		// A quarter of the pieces of every board animating
+		TArray<Chess::PieceIdx> animatedPieces;
+		for (int32 i = 0; i < MAX_BOARD_PIECES; i += 4)
+		{
+			animatedPieces.Add(static_cast<Chess::PieceIdx>(i));
+		}
+
+		TArray<int32> indices;
+		Measure(TEXT("Board"), TEXT("CollectUpdatingInstancedMeshes"), size, [&]()
+		{
+			int32 numCollected = 0;
+			for (const FChessInstancedMeshLookup& lookup : lookups)
+			{
+				FChessDirtyPieces dirty;
+				dirty.Mark(animatedPieces);
+				CollectUpdatingInstancedMeshes(lookup, dirty, indices);
+				numCollected += indices.Num();
+			}
+			check(numCollected <= size);
+		});
+	}
+}
+
+void UChessBenchmarkCommandlet::RunTablebase(const FString& directory)
+{
+	FChessTablebase tablebase(directory, 64);
+
+	TArray<FChessBitboardPosition> positions;
+	for (const FTablebaseCase& tablebaseCase : TablebaseCases)
+	{
+		// Result counts the checks that held: the WDL probe, the DTZ probe and the root probe agreeing with both
+		FChessBenchmarkRow& row = m_Rows.AddDefaulted_GetRef();
+		row.Suite = TEXT("Tablebase");
+		row.Name = tablebaseCase.Name;
+		row.Expected = 3;
+
+		FChessBitboardPosition position;
+		if (!ParseFEN(tablebaseCase.FEN, position))
+		{
+			row.Passed = false;
+			continue;
+		}
+
+		row.Size = FMath::CountBits(position.GetOccupancy());
+
+		EChessWDL::Type wdl = EChessWDL::Draw;
+		int32 dtz = 0;
+		FChessMove rootMove;
+		EChessWDL::Type rootWDL = EChessWDL::Draw;
+		int32 rootDTZ = 0;
+
+		const double start = FPlatformTime::Seconds();
+		const bool foundWDL = tablebase.ProbeWDL(position, wdl);
+		const bool foundDTZ = tablebase.ProbeDTZ(position, dtz);
+		const bool foundRoot = tablebase.ProbeRoot(position, rootMove, rootWDL, rootDTZ);
+		row.Seconds = FPlatformTime::Seconds() - start;
+		row.Iterations = 1;
+
+		row.Result = (foundWDL && wdl == tablebaseCase.WDL ? 1 : 0)
+			+ (foundDTZ && dtz == tablebaseCase.DTZ ? 1 : 0)
+			+ (foundRoot && rootWDL == tablebaseCase.WDL && rootDTZ == tablebaseCase.DTZ ? 1 : 0);
+		row.Passed = row.Result == row.Expected;
+
+		UE_LOG(LogTemp, Display, TEXT("Tablebase.%s: wdl %d dtz %d, root %s wdl %d dtz %d (%s)"), tablebaseCase.Name, static_cast<int32>(wdl), dtz,
+			foundRoot ? *WriteSAN(position, rootMove) : TEXT("-"), static_cast<int32>(rootWDL), rootDTZ, row.Passed ? TEXT("ok") : TEXT("MISMATCH"));
+
+		positions.Add(position);
+	}
+
+	if (positions.Num() == 0)
+		return;
+
+	// Every table is mapped and its blocks cached by now, the steady state of an endgame search
+	int32 positionIdx = 0;
+	Measure(TEXT("Tablebase"), TEXT("ProbeWDL"), positions.Num(), [&tablebase, &positions, &positionIdx]()
+	{
+		EChessWDL::Type wdl = EChessWDL::Draw;
+		tablebase.ProbeWDL(positions[positionIdx], wdl);
+		positionIdx = (positionIdx + 1) % positions.Num();
+	});
+}
+
+FString UChessBenchmarkCommandlet::ToCSV() const
+{
+	FString csv = TEXT("suite,name,size,iterations,seconds,per_second,result,expected,passed\n");
+	for (const FChessBenchmarkRow& row : m_Rows)
+	{
+		csv += FString::Printf(TEXT("%s,%s,%d,%llu,%.6f,%.2f,%llu,%llu,%d\n"),
+			*row.Suite, *row.Name, row.Size, row.Iterations, row.Seconds, row.GetPerSecond(), row.Result, row.Expected, row.Passed ? 1 : 0);
+	}
+	return csv;
+}
+
+FString UChessBenchmarkCommandlet::ToJSON() const
+{
+	FString json = FString::Printf(TEXT("{\n\t\"timestamp\": \"%s\",\n\t\"results\": [\n"), *FDateTime::UtcNow().ToIso8601());
+	for (int32 i = 0; i < m_Rows.Num(); ++i)
+	{
+		const FChessBenchmarkRow& row = m_Rows[i];
+		json += FString::Printf(TEXT("\t\t{ \"suite\": \"%s\", \"name\": \"%s\", \"size\": %d, \"iterations\": %llu, \"seconds\": %.6f, \"per_second\": %.2f, \"result\": %llu, \"expected\": %llu, \"passed\": %s }%s\n"),
+			*row.Suite, *row.Name, row.Size, row.Iterations, row.Seconds, row.GetPerSecond(), row.Result, row.Expected, row.Passed ? TEXT("true") : TEXT("false"), i + 1 < m_Rows.Num() ? TEXT(",") : TEXT(""));
+	}
+	json += TEXT("\t]\n}\n");
+	return json;
+}
@@ -0,0 +1,53 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ChessBenchmarkCommandlet.generated.h"
+
+struct FChessBenchmarkRow
+{
+	FString Suite;
+	FString Name;
+	int32 Size = 0;
+	uint64 Iterations = 0;
+	double Seconds = 0.0;
+	uint64 Result = 0; // Suite specific, node count for perft
+	uint64 Expected = 0;
+	bool Passed = true;
+
+	double GetPerSecond() const { return Seconds > 0.0 ? Iterations / Seconds : 0.0; }
+};
+
+// Headless benchmark of the move generator and the instruction/anim/render paths.
+// UnrealEditor-Cmd NajiExperience.uproject -run=ChessBenchmark -nullrhi [-output=<path>] [-format=json|csv] [-quick] [-mintime=<seconds>] [-tablebase=<dir>]
+// Returns non zero if a perft count differs from its published value, or if a known KQvK, KRvK or KPvK position probes
+// to another value in the Syzygy tables of -tablebase. Round trips are checked by the NajiExperience.Chess automation tests.
+UCLASS()
+class UChessBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UChessBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	void RunPerft(bool quick);
+	void RunInstructions();
+	void RunAnims();
+	void RunBoardUpdates();
+	void RunPieceUpdates();
+	void RunTablebase(const FString& directory);
+
+	// Repeats the body until it ran for at least m_MinSeconds
+	template<typename FunctionType>
+	FChessBenchmarkRow& Measure(const TCHAR* suite, const TCHAR* name, int32 size, FunctionType&& body);
+
+	FString ToCSV() const;
+	FString ToJSON() const;
+
+	TArray<FChessBenchmarkRow> m_Rows;
+	double m_MinSeconds = 0.25;
+};
@@ -0,0 +1,833 @@
+
+
+
+#include "ChessBitboard.h"
+
+namespace
+{
+	struct FSquareTable
+	{
+		uint64 Squares[BITBOARD_SQUARES];
+	};
+
+	template<int32 N>
+	constexpr FSquareTable MakeLeaperTable(const int32 (&dx)[N], const int32 (&dy)[N])
+	{
+		FSquareTable table = {};
+		for (int32 square = 0; square < BITBOARD_SQUARES; ++square)
+		{
+			uint64 attacks = 0;
+			for (int32 i = 0; i < N; ++i)
+			{
+				const int32 x = (square & 7) + dx[i];
+				const int32 y = (square >> 3) + dy[i];
+				if (x >= 0 && x < 8 && y >= 0 && y < 8)
+					attacks |= 1ull << (y * 8 + x);
+			}
+			table.Squares[square] = attacks;
+		}
+		return table;
+	}
+
+	constexpr int32 KnightDx[8] = { 1, 2, 2, 1, -1, -2, -2, -1 };
+	constexpr int32 KnightDy[8] = { 2, 1, -1, -2, -2, -1, 1, 2 };
+	constexpr int32 KingDx[8] = { 1, 1, 1, 0, -1, -1, -1, 0 };
+	constexpr int32 KingDy[8] = { 1, 0, -1, -1, -1, 0, 1, 1 };
+	constexpr int32 PawnDx[2] = { -1, 1 };
+	constexpr int32 WhitePawnDy[2] = { 1, 1 };
+	constexpr int32 BlackPawnDy[2] = { -1, -1 };
+
+	constexpr FSquareTable KnightAttacks = MakeLeaperTable(KnightDx, KnightDy);
+	constexpr FSquareTable KingAttacks = MakeLeaperTable(KingDx, KingDy);
+	constexpr FSquareTable PawnAttacks[EChessSide::COUNT] = { MakeLeaperTable(PawnDx, WhitePawnDy), MakeLeaperTable(PawnDx, BlackPawnDy) };
+
+	constexpr int32 RookDirections[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	constexpr int32 BishopDirections[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+
+	constexpr uint64 RANK_1 = 0xFFull;
+	constexpr uint64 RANK_8 = RANK_1 << 56;
+	constexpr uint64 FILE_A = 0x0101010101010101ull;
+	constexpr uint64 FILE_H = FILE_A << 7;
+
+	// Castling rights that survive a move touching the square
+	constexpr uint8 MakeCastlingMask(int32 square)
+	{
+		switch (square)
+		{
+		case 0: return ECastlingRights::All & ~ECastlingRights::WhiteQueenSide;
+		case 4: return ECastlingRights::All & ~(ECastlingRights::WhiteKingSide | ECastlingRights::WhiteQueenSide);
+		case 7: return ECastlingRights::All & ~ECastlingRights::WhiteKingSide;
+		case 56: return ECastlingRights::All & ~ECastlingRights::BlackQueenSide;
+		case 60: return ECastlingRights::All & ~(ECastlingRights::BlackKingSide | ECastlingRights::BlackQueenSide);
+		case 63: return ECastlingRights::All & ~ECastlingRights::BlackKingSide;
+		default: return ECastlingRights::All;
+		}
+	}
+
+	struct FZobristKeys
+	{
+		uint64 Pieces[EChessSide::COUNT][EBitboardPiece::COUNT][BITBOARD_SQUARES];
+		uint64 Castling[ECastlingRights::All + 1];
+		uint64 EnPassantFile[8];
+		uint64 BlackToMove;
+	};
+
+	constexpr FZobristKeys MakeZobristKeys()
+	{
+		// SplitMix64, fixed seed so keys are stable across runs
+		uint64 seed = 0x9E3779B97F4A7C15ull;
+		auto next = [&seed]()
+		{
+			seed += 0x9E3779B97F4A7C15ull;
+			uint64 z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		};
+
+		FZobristKeys keys = {};
+		for (auto& side : keys.Pieces)
+			for (auto& piece : side)
+				for (uint64& square : piece)
+					square = next();
+
+		for (uint64& castling : keys.Castling)
+			castling = next();
+
+		for (uint64& file : keys.EnPassantFile)
+			file = next();
+
+		keys.BlackToMove = next();
+		return keys;
+	}
+
+	constexpr FZobristKeys ZobristKeys = MakeZobristKeys();
+
+	uint64 GetStateKey(const FChessPositionState& state)
+	{
+		uint64 key = ZobristKeys.Castling[state.CastlingRights & ECastlingRights::All];
+		if (state.EnPassantSquare != INDEX_NONE)
+			key ^= ZobristKeys.EnPassantFile[GetSquareX(state.EnPassantSquare)];
+		if (state.SideToMove == EChessSide::Black)
+			key ^= ZobristKeys.BlackToMove;
+		return key;
+	}
+
+	uint64 SlideAttacks(int32 square, uint64 occupancy, const int32 (&directions)[4][2])
+	{
+		uint64 attacks = 0;
+		for (const auto& direction : directions)
+		{
+			int32 x = GetSquareX(square);
+			int32 y = GetSquareY(square);
+			for (;;)
+			{
+				x += direction[0];
+				y += direction[1];
+				if (x < 0 || x >= 8 || y < 0 || y >= 8)
+					break;
+
+				const uint64 bit = SquareBit(MakeSquare(x, y));
+				attacks |= bit;
+				if (occupancy & bit)
+					break;
+			}
+		}
+		return attacks;
+	}
+
+	struct FMagic
+	{
+		uint64 Mask;
+		uint64 Magic;
+		uint64* Attacks;
+		uint32 Shift;
+
+		FORCEINLINE uint32 GetIndex(uint64 occupancy) const { return static_cast<uint32>(((occupancy & Mask) * Magic) >> Shift); }
+	};
+
+	struct FMagicRandom
+	{
+		uint64 State;
+
+		uint64 Next()
+		{
+			State ^= State >> 12;
+			State ^= State << 25;
+			State ^= State >> 27;
+			return State * 2685821657736338717ull;
+		}
+
+		// Few set bits make good magic candidates
+		uint64 NextSparse() { return Next() & Next() & Next(); }
+	};
+
+	struct FSlidingAttackTables
+	{
+		FMagic Rook[BITBOARD_SQUARES];
+		FMagic Bishop[BITBOARD_SQUARES];
+		uint64 RookAttacks[0x19000];
+		uint64 BishopAttacks[0x1480];
+		uint64 Between[BITBOARD_SQUARES][BITBOARD_SQUARES];
+		uint64 Line[BITBOARD_SQUARES][BITBOARD_SQUARES];
+
+		FSlidingAttackTables()
+		{
+			FMagicRandom random{ 0x2545F4914F6CDD1Dull };
+			InitMagics(Rook, RookAttacks, RookDirections, random);
+			InitMagics(Bishop, BishopAttacks, BishopDirections, random);
+
+			for (int32 from = 0; from < BITBOARD_SQUARES; ++from)
+			{
+				for (int32 to = 0; to < BITBOARD_SQUARES; ++to)
+				{
+					Between[from][to] = 0;
+					Line[from][to] = 0;
+					if (from == to)
+						continue;
+
+					const FMagic* magics[2] = { Bishop, Rook };
+					for (const FMagic* magic : magics)
+					{
+						const uint64 fromAttacks = magic[from].Attacks[magic[from].GetIndex(0)];
+						if (!(fromAttacks & SquareBit(to)))
+							continue;
+
+						const uint64 toAttacks = magic[to].Attacks[magic[to].GetIndex(0)];
+						Line[from][to] = (fromAttacks & toAttacks) | SquareBit(from) | SquareBit(to);
+						Between[from][to] = magic[from].Attacks[magic[from].GetIndex(SquareBit(to))] & magic[to].Attacks[magic[to].GetIndex(SquareBit(from))];
+					}
+				}
+			}
+		}
+
+		static void InitMagics(FMagic* magics, uint64* table, const int32 (&directions)[4][2], FMagicRandom& random)
+		{
+			TArray<uint64> occupancies;
+			TArray<uint64> reference;
+			TArray<int32> epoch;
+			occupancies.SetNumUninitialized(4096);
+			reference.SetNumUninitialized(4096);
+			epoch.SetNumZeroed(4096);
+			int32 attempt = 0;
+
+			uint64* attacks = table;
+			for (int32 square = 0; square < BITBOARD_SQUARES; ++square)
+			{
+				// Board edges never block, unless the slider stands on them
+				const uint64 edges = ((RANK_1 | RANK_8) & ~(RANK_1 << (8 * GetSquareY(square)))) | ((FILE_A | FILE_H) & ~(FILE_A << GetSquareX(square)));
+
+				FMagic& magic = magics[square];
+				magic.Mask = SlideAttacks(square, 0, directions) & ~edges;
+				magic.Shift = 64 - FMath::CountBits(magic.Mask);
+				magic.Attacks = attacks;
+
+				// Enumerate every subset of the mask (Carry-Rippler)
+				int32 size = 0;
+				uint64 subset = 0;
+				do
+				{
+					occupancies[size] = subset;
+					reference[size] = SlideAttacks(square, subset, directions);
+					++size;
+					subset = (subset - magic.Mask) & magic.Mask;
+				} while (subset);
+
+				for (int32 i = 0; i < size;)
+				{
+					do
+					{
+						magic.Magic = random.NextSparse();
+					} while (FMath::CountBits((magic.Magic * magic.Mask) >> 56) < 6);
+
+					++attempt;
+					for (i = 0; i < size; ++i)
+					{
+						const uint32 idx = magic.GetIndex(occupancies[i]);
+						if (epoch[idx] < attempt)
+						{
+							epoch[idx] = attempt;
+							attacks[idx] = reference[i];
+						}
+						else if (attacks[idx] != reference[i])
+						{
+							break;
+						}
+					}
+				}
+
+				attacks += size;
+			}
+		}
+	};
+
+	const FSlidingAttackTables& GetSlidingTables()
+	{
+		static const FSlidingAttackTables tables;
+		return tables;
+	}
+}
+
+void FChessBitboardPosition::Clear()
+{
+	FMemory::Memzero(Pieces);
+	FMemory::Memzero(Occupancy);
+	FMemory::Memset(Board, BITBOARD_EMPTY);
+	State = FChessPositionState();
+	Key = GetStateKey(State);
+}
+
+void FChessBitboardPosition::AddPiece(int32 square, EChessSide::Type side, EBitboardPiece::Type piece)
+{
+	check(IsEmpty(square));
+	const uint64 bit = SquareBit(square);
+	Pieces[side][piece] |= bit;
+	Occupancy[side] |= bit;
+	Board[square] = static_cast<uint8>((side << 3) | piece);
+	Key ^= ZobristKeys.Pieces[side][piece][square];
+}
+
+void FChessBitboardPosition::RemovePiece(int32 square)
+{
+	if (IsEmpty(square))
+		return;
+
+	const uint64 bit = SquareBit(square);
+	Key ^= ZobristKeys.Pieces[GetSide(square)][GetPiece(square)][square];
+	Pieces[GetSide(square)][GetPiece(square)] &= ~bit;
+	Occupancy[GetSide(square)] &= ~bit;
+	Board[square] = BITBOARD_EMPTY;
+}
+
+int32 FChessBitboardPosition::GetKingSquare(EChessSide::Type side) const
+{
+	const uint64 king = Pieces[side][EBitboardPiece::King];
+	return king ? static_cast<int32>(FMath::CountTrailingZeros64(king)) : INDEX_NONE;
+}
+
+uint64 GetKnightAttacks(int32 square)
+{
+	return KnightAttacks.Squares[square];
+}
+
+uint64 GetKingAttacks(int32 square)
+{
+	return KingAttacks.Squares[square];
+}
+
+uint64 GetPawnAttacks(EChessSide::Type side, int32 square)
+{
+	return PawnAttacks[side].Squares[square];
+}
+
+uint64 GetBishopAttacks(int32 square, uint64 occupancy)
+{
+	const FMagic& magic = GetSlidingTables().Bishop[square];
+	return magic.Attacks[magic.GetIndex(occupancy)];
+}
+
+uint64 GetRookAttacks(int32 square, uint64 occupancy)
+{
+	const FMagic& magic = GetSlidingTables().Rook[square];
+	return magic.Attacks[magic.GetIndex(occupancy)];
+}
+
+uint64 GetQueenAttacks(int32 square, uint64 occupancy)
+{
+	return GetBishopAttacks(square, occupancy) | GetRookAttacks(square, occupancy);
+}
+
+uint64 GetBetweenSquares(int32 from, int32 to)
+{
+	return GetSlidingTables().Between[from][to];
+}
+
+uint64 GetLineSquares(int32 from, int32 to)
+{
+	return GetSlidingTables().Line[from][to];
+}
+
+uint64 GetAttackersTo(const FChessBitboardPosition& position, int32 square, uint64 occupancy)
+{
+	const auto& pieces = position.Pieces;
+	const uint64 bishops = pieces[0][EBitboardPiece::Bishop] | pieces[1][EBitboardPiece::Bishop] | pieces[0][EBitboardPiece::Queen] | pieces[1][EBitboardPiece::Queen];
+	const uint64 rooks = pieces[0][EBitboardPiece::Rook] | pieces[1][EBitboardPiece::Rook] | pieces[0][EBitboardPiece::Queen] | pieces[1][EBitboardPiece::Queen];
+
+	return (GetPawnAttacks(EChessSide::Black, square) & pieces[EChessSide::White][EBitboardPiece::Pawn])
+		| (GetPawnAttacks(EChessSide::White, square) & pieces[EChessSide::Black][EBitboardPiece::Pawn])
+		| (GetKnightAttacks(square) & (pieces[0][EBitboardPiece::Knight] | pieces[1][EBitboardPiece::Knight]))
+		| (GetKingAttacks(square) & (pieces[0][EBitboardPiece::King] | pieces[1][EBitboardPiece::King]))
+		| (GetBishopAttacks(square, occupancy) & bishops)
+		| (GetRookAttacks(square, occupancy) & rooks);
+}
+
+bool IsSquareAttacked(const FChessBitboardPosition& position, int32 square, EChessSide::Type attacker, uint64 occupancy)
+{
+	const uint64* pieces = position.Pieces[attacker];
+	const EChessSide::Type defender = attacker == EChessSide::White ? EChessSide::Black : EChessSide::White;
+
+	return (GetPawnAttacks(defender, square) & pieces[EBitboardPiece::Pawn])
+		|| (GetKnightAttacks(square) & pieces[EBitboardPiece::Knight])
+		|| (GetKingAttacks(square) & pieces[EBitboardPiece::King])
+		|| (GetBishopAttacks(square, occupancy) & (pieces[EBitboardPiece::Bishop] | pieces[EBitboardPiece::Queen]))
+		|| (GetRookAttacks(square, occupancy) & (pieces[EBitboardPiece::Rook] | pieces[EBitboardPiece::Queen]));
+}
+
+bool IsInCheck(const FChessBitboardPosition& position)
+{
+	const EChessSide::Type us = position.State.SideToMove;
+	const int32 kingSquare = position.GetKingSquare(us);
+	if (kingSquare == INDEX_NONE)
+		return false;
+
+	const EChessSide::Type them = us == EChessSide::White ? EChessSide::Black : EChessSide::White;
+	return IsSquareAttacked(position, kingSquare, them, position.GetOccupancy());
+}
+
+static void AddPawnMoves(int32 from, int32 to, uint8 flags, FChessMoveList& outMoves)
+{
+	const int32 y = GetSquareY(to);
+	if (y == 0 || y == 7)
+	{
+		for (EBitboardPiece::Type promotion : { EBitboardPiece::Queen, EBitboardPiece::Rook, EBitboardPiece::Bishop, EBitboardPiece::Knight })
+		{
+			outMoves.Add({ static_cast<uint8>(from), static_cast<uint8>(to), static_cast<uint8>(promotion), static_cast<uint8>(flags | EChessMoveFlags::Promotion) });
+		}
+	}
+	else
+	{
+		outMoves.Add({ static_cast<uint8>(from), static_cast<uint8>(to), EBitboardPiece::None, flags });
+	}
+}
+
+void GenerateLegalMoves(const FChessBitboardPosition& position, FChessMoveList& outMoves)
+{
+	const EChessSide::Type us = position.State.SideToMove;
+	const EChessSide::Type them = us == EChessSide::White ? EChessSide::Black : EChessSide::White;
+	const uint64 own = position.Occupancy[us];
+	const uint64 enemy = position.Occupancy[them];
+	const uint64 occupancy = own | enemy;
+	const uint64* ourPieces = position.Pieces[us];
+	const uint64* theirPieces = position.Pieces[them];
+
+	auto addMoves = [&outMoves, enemy](int32 from, uint64 targets)
+	{
+		while (targets)
+		{
+			const int32 to = PopSquare(targets);
+			outMoves.Add({ static_cast<uint8>(from), static_cast<uint8>(to), EBitboardPiece::None, static_cast<uint8>((enemy & SquareBit(to)) ? EChessMoveFlags::Capture : EChessMoveFlags::None) });
+		}
+	};
+
+	// Debug boards may lack a king, every pseudo legal move is legal then
+	const int32 kingSquare = position.GetKingSquare(us);
+	uint64 checkers = 0;
+	uint64 pinned = 0;
+	uint64 checkMask = ~0ull;
+
+	if (kingSquare != INDEX_NONE)
+	{
+		checkers = GetAttackersTo(position, kingSquare, occupancy) & enemy;
+
+		// The king can't hide behind itself from sliders
+		const uint64 occupancyWithoutKing = occupancy ^ SquareBit(kingSquare);
+		uint64 kingTargets = GetKingAttacks(kingSquare) & ~own;
+		while (kingTargets)
+		{
+			const int32 to = PopSquare(kingTargets);
+			if (!IsSquareAttacked(position, to, them, occupancyWithoutKing))
+				outMoves.Add({ static_cast<uint8>(kingSquare), static_cast<uint8>(to), EBitboardPiece::None, static_cast<uint8>((enemy & SquareBit(to)) ? EChessMoveFlags::Capture : EChessMoveFlags::None) });
+		}
+
+		if (FMath::CountBits(checkers) > 1)
+			return;
+
+		if (checkers)
+		{
+			const int32 checkerSquare = static_cast<int32>(FMath::CountTrailingZeros64(checkers));
+			checkMask = GetBetweenSquares(kingSquare, checkerSquare) | checkers;
+		}
+
+		uint64 snipers = (GetRookAttacks(kingSquare, 0) & (theirPieces[EBitboardPiece::Rook] | theirPieces[EBitboardPiece::Queen]))
+			| (GetBishopAttacks(kingSquare, 0) & (theirPieces[EBitboardPiece::Bishop] | theirPieces[EBitboardPiece::Queen]));
+		while (snipers)
+		{
+			const uint64 blockers = GetBetweenSquares(kingSquare, PopSquare(snipers)) & occupancy;
+			if (FMath::CountBits(blockers) == 1)
+				pinned |= blockers & own;
+		}
+	}
+
+	auto getTargets = [&](int32 from, uint64 targets)
+	{
+		targets &= checkMask;
+		if (pinned & SquareBit(from))
+			targets &= GetLineSquares(kingSquare, from);
+		return targets;
+	};
+
+	for (EBitboardPiece::Type piece : { EBitboardPiece::Knight, EBitboardPiece::Bishop, EBitboardPiece::Rook, EBitboardPiece::Queen })
+	{
+		uint64 pieces = ourPieces[piece];
+		while (pieces)
+		{
+			const int32 from = PopSquare(pieces);
+			uint64 attacks = 0;
+			switch (piece)
+			{
+			case EBitboardPiece::Knight: attacks = GetKnightAttacks(from); break;
+			case EBitboardPiece::Bishop: attacks = GetBishopAttacks(from, occupancy); break;
+			case EBitboardPiece::Rook: attacks = GetRookAttacks(from, occupancy); break;
+			default: attacks = GetQueenAttacks(from, occupancy); break;
+			}
+
+			addMoves(from, getTargets(from, attacks & ~own));
+		}
+	}
+
+	const int32 forward = us == EChessSide::White ? 8 : -8;
+	const int32 startRank = us == EChessSide::White ? 1 : 6;
+	uint64 pawns = ourPieces[EBitboardPiece::Pawn];
+	while (pawns)
+	{
+		const int32 from = PopSquare(pawns);
+
+		const int32 single = from + forward;
+		if (single >= 0 && single < BITBOARD_SQUARES && position.IsEmpty(single))
+		{
+			if (getTargets(from, SquareBit(single)))
+				AddPawnMoves(from, single, EChessMoveFlags::None, outMoves);
+
+			const int32 doublePush = single + forward;
+			if (GetSquareY(from) == startRank && position.IsEmpty(doublePush) && getTargets(from, SquareBit(doublePush)))
+				outMoves.Add({ static_cast<uint8>(from), static_cast<uint8>(doublePush), EBitboardPiece::None, EChessMoveFlags::DoublePush });
+		}
+
+		uint64 captures = getTargets(from, GetPawnAttacks(us, from) & enemy);
+		while (captures)
+		{
+			AddPawnMoves(from, PopSquare(captures), EChessMoveFlags::Capture, outMoves);
+		}
+
+		const int32 epSquare = position.State.EnPassantSquare;
+		if (epSquare != INDEX_NONE && (GetPawnAttacks(us, from) & SquareBit(epSquare)))
+		{
+			// Verify by occupancy, the capture removes two pieces from the same rank at once
+			const int32 capturedSquare = epSquare - forward;
+			const uint64 occupancyAfter = (occupancy ^ SquareBit(from) ^ SquareBit(capturedSquare)) | SquareBit(epSquare);
+			const bool exposesKing = kingSquare != INDEX_NONE && (GetAttackersTo(position, kingSquare, occupancyAfter) & enemy & ~SquareBit(capturedSquare) & occupancyAfter) != 0;
+			if (!exposesKing)
+				outMoves.Add({ static_cast<uint8>(from), static_cast<uint8>(epSquare), EBitboardPiece::None, EChessMoveFlags::Capture | EChessMoveFlags::EnPassant });
+		}
+	}
+
+	// Castling, king and rook on their home squares
+	const int32 homeRank = us == EChessSide::White ? 0 : 7;
+	const int32 homeKing = MakeSquare(4, homeRank);
+	if (checkers == 0 && kingSquare == homeKing)
+	{
+		const uint8 kingSide = us == EChessSide::White ? ECastlingRights::WhiteKingSide : ECastlingRights::BlackKingSide;
+		const uint8 queenSide = us == EChessSide::White ? ECastlingRights::WhiteQueenSide : ECastlingRights::BlackQueenSide;
+		const uint64 rooks = ourPieces[EBitboardPiece::Rook];
+
+		if ((position.State.CastlingRights & kingSide) && (rooks & SquareBit(homeKing + 3))
+			&& !(occupancy & GetBetweenSquares(homeKing, homeKing + 3))
+			&& !IsSquareAttacked(position, homeKing + 1, them, occupancy) && !IsSquareAttacked(position, homeKing + 2, them, occupancy))
+		{
+			outMoves.Add({ static_cast<uint8>(homeKing), static_cast<uint8>(homeKing + 2), EBitboardPiece::None, EChessMoveFlags::Castle });
+		}
+
+		if ((position.State.CastlingRights & queenSide) && (rooks & SquareBit(homeKing - 4))
+			&& !(occupancy & GetBetweenSquares(homeKing, homeKing - 4))
+			&& !IsSquareAttacked(position, homeKing - 1, them, occupancy) && !IsSquareAttacked(position, homeKing - 2, them, occupancy))
+		{
+			outMoves.Add({ static_cast<uint8>(homeKing), static_cast<uint8>(homeKing - 2), EBitboardPiece::None, EChessMoveFlags::Castle });
+		}
+	}
+}
+
+void ApplyMoveState(FChessBitboardPosition& position, int32 from, int32 to, EChessSide::Type side, EBitboardPiece::Type piece, bool capture)
+{
+	FChessPositionState& state = position.State;
+	position.Key ^= GetStateKey(state);
+
+	state.CastlingRights &= MakeCastlingMask(from) & MakeCastlingMask(to);
+	state.EnPassantSquare = (piece == EBitboardPiece::Pawn && FMath::Abs(to - from) == 16) ? static_cast<int8>((from + to) / 2) : INDEX_NONE;
+	state.HalfmoveClock = (piece == EBitboardPiece::Pawn || capture) ? 0 : static_cast<uint8>(FMath::Min(state.HalfmoveClock + 1, 255));
+
+	if (side == EChessSide::Black)
+		++state.FullmoveNumber;
+
+	state.SideToMove = side == EChessSide::White ? EChessSide::Black : EChessSide::White;
+	position.Key ^= GetStateKey(state);
+}
+
+void SetPositionState(FChessBitboardPosition& position, const FChessPositionState& state)
+{
+	position.Key ^= GetStateKey(position.State) ^ GetStateKey(state);
+	position.State = state;
+}
+
+void MakeMove(FChessBitboardPosition& position, const FChessMove& move)
+{
+	const EChessSide::Type us = position.GetSide(move.From);
+	const EBitboardPiece::Type piece = position.GetPiece(move.From);
+	const bool capture = !position.IsEmpty(move.To) || (move.Flags & EChessMoveFlags::EnPassant);
+
+	position.RemovePiece(move.From);
+	position.RemovePiece(move.To);
+
+	if (move.Flags & EChessMoveFlags::EnPassant)
+		position.RemovePiece(move.To + (us == EChessSide::White ? -8 : 8));
+
+	position.AddPiece(move.To, us, move.Promotion != EBitboardPiece::None ? static_cast<EBitboardPiece::Type>(move.Promotion) : piece);
+
+	if (move.Flags & EChessMoveFlags::Castle)
+	{
+		const bool kingSide = move.To > move.From;
+		const int32 rookFrom = kingSide ? move.To + 1 : move.To - 2;
+		const int32 rookTo = kingSide ? move.To - 1 : move.To + 1;
+		position.RemovePiece(rookFrom);
+		position.AddPiece(rookTo, us, EBitboardPiece::Rook);
+	}
+
+	ApplyMoveState(position, move.From, move.To, us, piece, capture);
+}
+
+uint64 Perft(const FChessBitboardPosition& position, int32 depth)
+{
+	if (depth <= 0)
+		return 1;
+
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+
+	// Bulk count at the last ply, the moves are legal already
+	if (depth == 1)
+		return moves.Num();
+
+	uint64 nodes = 0;
+	for (const FChessMove& move : moves)
+	{
+		FChessBitboardPosition child = position;
+		MakeMove(child, move);
+		nodes += Perft(child, depth - 1);
+	}
+	return nodes;
+}
+
+void MakeNullMove(FChessBitboardPosition& position)
+{
+	FChessPositionState state = position.State;
+	state.EnPassantSquare = INDEX_NONE;
+	state.SideToMove = state.SideToMove == EChessSide::White ? EChessSide::Black : EChessSide::White;
+	SetPositionState(position, state);
+}
+
+uint64 ComputePositionKey(const FChessBitboardPosition& position)
+{
+	uint64 key = GetStateKey(position.State);
+	for (int32 square = 0; square < BITBOARD_SQUARES; ++square)
+	{
+		if (!position.IsEmpty(square))
+			key ^= ZobristKeys.Pieces[position.GetSide(square)][position.GetPiece(square)][square];
+	}
+	return key;
+}
+
+bool ParseFEN(const TCHAR* fen, FChessBitboardPosition& outPosition)
+{
+	FChessBitboardPosition position;
+	const TCHAR* c = fen;
+
+	auto skipSpaces = [&c]()
+	{
+		while (*c == ' ')
+			++c;
+	};
+
+	auto parseNumber = [&c](int32& outValue)
+	{
+		if (*c < '0' || *c > '9')
+			return false;
+
+		outValue = 0;
+		while (*c >= '0' && *c <= '9' && outValue < 100000)
+			outValue = outValue * 10 + (*c++ - '0');
+		return true;
+	};
+
+	skipSpaces();
+
+	// Piece placement, rank 8 first
+	int32 x = 0;
+	int32 y = 7;
+	for (; *c != ' '; ++c)
+	{
+		if (*c == 0)
+			return false;
+
+		if (*c == '/')
+		{
+			if (x != 8 || y == 0)
+				return false;
+
+			x = 0;
+			--y;
+			continue;
+		}
+
+		if (*c >= '1' && *c <= '8')
+		{
+			x += *c - '0';
+			if (x > 8)
+				return false;
+			continue;
+		}
+
+		const TCHAR lower = (*c >= 'A' && *c <= 'Z') ? static_cast<TCHAR>(*c - 'A' + 'a') : *c;
+		EBitboardPiece::Type piece = EBitboardPiece::None;
+		switch (lower)
+		{
+		case 'p': piece = EBitboardPiece::Pawn; break;
+		case 'n': piece = EBitboardPiece::Knight; break;
+		case 'b': piece = EBitboardPiece::Bishop; break;
+		case 'r': piece = EBitboardPiece::Rook; break;
+		case 'q': piece = EBitboardPiece::Queen; break;
+		case 'k': piece = EBitboardPiece::King; break;
+		default: return false;
+		}
+
+		if (x >= 8)
+			return false;
+
+		position.AddPiece(MakeSquare(x++, y), lower == *c ? EChessSide::Black : EChessSide::White, piece);
+	}
+
+	if (x != 8 || y != 0)
+		return false;
+
+	if (FMath::CountBits(position.Pieces[EChessSide::White][EBitboardPiece::King]) != 1 || FMath::CountBits(position.Pieces[EChessSide::Black][EBitboardPiece::King]) != 1)
+		return false;
+
+	FChessPositionState state;
+
+	skipSpaces();
+	if (*c != 'w' && *c != 'b')
+		return false;
+	state.SideToMove = *c++ == 'w' ? EChessSide::White : EChessSide::Black;
+
+	skipSpaces();
+	state.CastlingRights = ECastlingRights::None;
+	if (*c == '-')
+	{
+		++c;
+	}
+	else
+	{
+		for (; *c != ' ' && *c != 0; ++c)
+		{
+			switch (*c)
+			{
+			case 'K': state.CastlingRights |= ECastlingRights::WhiteKingSide; break;
+			case 'Q': state.CastlingRights |= ECastlingRights::WhiteQueenSide; break;
+			case 'k': state.CastlingRights |= ECastlingRights::BlackKingSide; break;
+			case 'q': state.CastlingRights |= ECastlingRights::BlackQueenSide; break;
+			default: return false;
+			}
+		}
+	}
+
+	skipSpaces();
+	if (*c == '-')
+	{
+		++c;
+	}
+	else
+	{
+		if (c[0] < 'a' || c[0] > 'h' || (c[1] != '3' && c[1] != '6'))
+			return false;
+
+		state.EnPassantSquare = static_cast<int8>(MakeSquare(c[0] - 'a', c[1] - '1'));
+		c += 2;
+	}
+
+	skipSpaces();
+	int32 halfmoveClock = 0;
+	int32 fullmoveNumber = 1;
+	if (parseNumber(halfmoveClock))
+	{
+		skipSpaces();
+		parseNumber(fullmoveNumber);
+	}
+	state.HalfmoveClock = static_cast<uint8>(FMath::Min(halfmoveClock, 255));
+	state.FullmoveNumber = static_cast<uint16>(FMath::Clamp(fullmoveNumber, 1, 65535));
+
+	SetPositionState(position, state);
+	outPosition = position;
+	return true;
+}
+
+FString WriteFEN(const FChessBitboardPosition& position)
+{
+	static const TCHAR PieceChars[EBitboardPiece::COUNT] = { 'p', 'n', 'b', 'r', 'q', 'k' };
+
+	FString fen;
+	fen.Reserve(90);
+
+	for (int32 y = 7; y >= 0; --y)
+	{
+		int32 emptyCount = 0;
+		for (int32 x = 0; x < 8; ++x)
+		{
+			const int32 square = MakeSquare(x, y);
+			if (position.IsEmpty(square))
+			{
+				++emptyCount;
+				continue;
+			}
+
+			if (emptyCount > 0)
+				fen.AppendChar(static_cast<TCHAR>('0' + emptyCount));
+			emptyCount = 0;
+
+			const TCHAR pieceChar = PieceChars[position.GetPiece(square)];
+			fen.AppendChar(position.GetSide(square) == EChessSide::White ? static_cast<TCHAR>(pieceChar - 'a' + 'A') : pieceChar);
+		}
+
+		if (emptyCount > 0)
+			fen.AppendChar(static_cast<TCHAR>('0' + emptyCount));
+		if (y > 0)
+			fen.AppendChar('/');
+	}
+
+	const FChessPositionState& state = position.State;
+	fen.AppendChar(' ');
+	fen.AppendChar(state.SideToMove == EChessSide::White ? 'w' : 'b');
+	fen.AppendChar(' ');
+
+	if (state.CastlingRights == ECastlingRights::None)
+		fen.AppendChar('-');
+	if (state.CastlingRights & ECastlingRights::WhiteKingSide)
+		fen.AppendChar('K');
+	if (state.CastlingRights & ECastlingRights::WhiteQueenSide)
+		fen.AppendChar('Q');
+	if (state.CastlingRights & ECastlingRights::BlackKingSide)
+		fen.AppendChar('k');
+	if (state.CastlingRights & ECastlingRights::BlackQueenSide)
+		fen.AppendChar('q');
+
+	fen.AppendChar(' ');
+	if (state.EnPassantSquare == INDEX_NONE)
+	{
+		fen.AppendChar('-');
+	}
+	else
+	{
+		fen.AppendChar(static_cast<TCHAR>('a' + GetSquareX(state.EnPassantSquare)));
+		fen.AppendChar(static_cast<TCHAR>('1' + GetSquareY(state.EnPassantSquare)));
+	}
+
+	fen.Appendf(TEXT(" %d %d"), state.HalfmoveClock, state.FullmoveNumber);
+	return fen;
+}
@@ -0,0 +1,158 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Squares are indexed y * 8 + x, x being the file and y the rank. White starts on the low ranks.
+constexpr int32 BITBOARD_SQUARES = 64;
+constexpr uint8 BITBOARD_EMPTY = 0xFF;
+
+namespace EChessSide
+{
+	enum Type : uint8
+	{
+		White,
+		Black,
+
+		COUNT = 2
+	};
+}
+
+namespace EBitboardPiece
+{
+	enum Type : uint8
+	{
+		Pawn,
+		Knight,
+		Bishop,
+		Rook,
+		Queen,
+		King,
+
+		COUNT = 6,
+		None = 0x0F
+	};
+}
+
+namespace ECastlingRights
+{
+	enum Type : uint8
+	{
+		None = 0,
+		WhiteKingSide = 1 << 0,
+		WhiteQueenSide = 1 << 1,
+		BlackKingSide = 1 << 2,
+		BlackQueenSide = 1 << 3,
+
+		All = WhiteKingSide | WhiteQueenSide | BlackKingSide | BlackQueenSide
+	};
+}
+
+namespace EChessMoveFlags
+{
+	enum Type : uint8
+	{
+		None = 0,
+		Capture = 1 << 0,
+		DoublePush = 1 << 1,
+		EnPassant = 1 << 2,
+		Castle = 1 << 3,
+		Promotion = 1 << 4,
+	};
+}
+
+FORCEINLINE int32 MakeSquare(int32 x, int32 y) { return y * 8 + x; }
+FORCEINLINE int32 GetSquareX(int32 square) { return square & 7; }
+FORCEINLINE int32 GetSquareY(int32 square) { return square >> 3; }
+FORCEINLINE uint64 SquareBit(int32 square) { return 1ull << square; }
+FORCEINLINE int32 PopSquare(uint64& bitboard)
+{
+	const int32 square = static_cast<int32>(FMath::CountTrailingZeros64(bitboard));
+	bitboard &= bitboard - 1;
+	return square;
+}
+
+// 4 bytes, cheap to copy around and store in history
+struct FChessMove
+{
+	uint8 From = 0;
+	uint8 To = 0;
+	uint8 Promotion = EBitboardPiece::None;
+	uint8 Flags = EChessMoveFlags::None;
+
+	bool IsCapture() const { return (Flags & EChessMoveFlags::Capture) != 0; }
+	bool IsUnderpromotion() const { return Promotion != EBitboardPiece::None && Promotion != EBitboardPiece::Queen; }
+	bool operator==(const FChessMove& other) const { return From == other.From && To == other.To && Promotion == other.Promotion; }
+	bool operator!=(const FChessMove& other) const { return !(*this == other); }
+};
+
+using FChessMoveList = TArray<FChessMove, TInlineAllocator<256>>;
+
+// Irreversible part of the position, saved to undo a move
+struct FChessPositionState
+{
+	EChessSide::Type SideToMove = EChessSide::White;
+	uint8 CastlingRights = ECastlingRights::None;
+	int8 EnPassantSquare = INDEX_NONE;
+	uint8 HalfmoveClock = 0;
+	uint16 FullmoveNumber = 1;
+};
+
+struct FChessBitboardPosition
+{
+	uint64 Pieces[EChessSide::COUNT][EBitboardPiece::COUNT];
+	uint64 Occupancy[EChessSide::COUNT];
+	uint8 Board[BITBOARD_SQUARES]; // (side << 3) | piece, BITBOARD_EMPTY if empty
+	FChessPositionState State;
+	uint64 Key; // Zobrist key, kept up to date by every modifier below
+
+	FChessBitboardPosition() { Clear(); }
+	void Clear();
+	void AddPiece(int32 square, EChessSide::Type side, EBitboardPiece::Type piece);
+	void RemovePiece(int32 square);
+
+	uint64 GetOccupancy() const { return Occupancy[EChessSide::White] | Occupancy[EChessSide::Black]; }
+	bool IsEmpty(int32 square) const { return Board[square] == BITBOARD_EMPTY; }
+	EChessSide::Type GetSide(int32 square) const { return static_cast<EChessSide::Type>(Board[square] >> 3); }
+	EBitboardPiece::Type GetPiece(int32 square) const { return Board[square] == BITBOARD_EMPTY ? EBitboardPiece::None : static_cast<EBitboardPiece::Type>(Board[square] & 7); }
+	int32 GetKingSquare(EChessSide::Type side) const;
+};
+
+uint64 GetKnightAttacks(int32 square);
+uint64 GetKingAttacks(int32 square);
+uint64 GetPawnAttacks(EChessSide::Type side, int32 square);
+uint64 GetBishopAttacks(int32 square, uint64 occupancy);
+uint64 GetRookAttacks(int32 square, uint64 occupancy);
+uint64 GetQueenAttacks(int32 square, uint64 occupancy);
+uint64 GetBetweenSquares(int32 from, int32 to); // Exclusive of both ends, 0 if not aligned
+uint64 GetLineSquares(int32 from, int32 to); // Full line through both squares, 0 if not aligned
+
+// Pieces of both sides attacking the square given the occupancy
+uint64 GetAttackersTo(const FChessBitboardPosition& position, int32 square, uint64 occupancy);
+bool IsSquareAttacked(const FChessBitboardPosition& position, int32 square, EChessSide::Type attacker, uint64 occupancy);
+bool IsInCheck(const FChessBitboardPosition& position);
+
+// Legal moves of the side to move, handling checks, pins, castling and en passant
+void GenerateLegalMoves(const FChessBitboardPosition& position, FChessMoveList& outMoves);
+
+// Updates side to move, castling rights, en passant and clocks for a piece moving between squares. Does not touch the bitboards.
+void ApplyMoveState(FChessBitboardPosition& position, int32 from, int32 to, EChessSide::Type side, EBitboardPiece::Type piece, bool capture);
+void SetPositionState(FChessBitboardPosition& position, const FChessPositionState& state);
+
+// Leaf node count of the legal move tree, the standard move generator check
+uint64 Perft(const FChessBitboardPosition& position, int32 depth);
+
+// Applies a move produced by GenerateLegalMoves
+void MakeMove(FChessBitboardPosition& position, const FChessMove& move);
+// Passes the turn, used by null move pruning
+void MakeNullMove(FChessBitboardPosition& position);
+
+// Full Zobrist key recompute, the incremental key must always match it
+uint64 ComputePositionKey(const FChessBitboardPosition& position);
+
+constexpr const TCHAR* START_POSITION_FEN = TEXT("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+// Forsyth-Edwards notation, the move counters are optional. Returns false on malformed input or if a king is missing.
+bool ParseFEN(const TCHAR* fen, FChessBitboardPosition& outPosition);
+FString WriteFEN(const FChessBitboardPosition& position);
@@ -0,0 +1,53 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ChessBitboard.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+namespace EChessBookSelection
+{
+	enum Type : uint8
+	{
+		WeightedRandom, // Moves are picked in proportion to their weight, as Polyglot intends
+		Best, // Always the move with the highest weight
+	};
+}
+
+// Read only Polyglot opening book (.bin). The file is memory mapped and binary searched in place,
+// opening costs no reads however large the book is and probes never allocate.
+class FChessOpeningBook
+{
+public:
+	static constexpr int32 NUM_RANDOMS = 781;
+	static constexpr int32 ENTRY_SIZE = 16; // Key (8) | move (2) | weight (2) | learn (4), big endian
+
+	FChessOpeningBook();
+	~FChessOpeningBook();
+
+	bool Open(const TCHAR* bookPath);
+	void Close();
+	bool IsOpen() const { return m_Entries != nullptr; }
+	int64 GetNumEntries() const { return m_NumEntries; }
+
+	// Polyglot key of the position, unrelated to the position's own Zobrist key
+	static uint64 ComputeKey(const FChessBitboardPosition& position);
+
+	// False if the position isn't in the book or none of its book moves are legal.
+	// inOutRandom is a nonzero xorshift state, only used by weighted random selection.
+	bool Probe(const FChessBitboardPosition& position, EChessBookSelection::Type selection, uint32& inOutRandom, FChessMove& outMove) const;
+
+private:
+	int64 FindFirstEntry(uint64 key) const;
+	uint64 GetEntryKey(int64 entryIdx) const;
+	// Legal move the entry stands for, null if the book move isn't legal in the position
+	const FChessMove* FindEntryMove(int64 entryIdx, const FChessBitboardPosition& position, const FChessMoveList& legalMoves) const;
+
+	TUniquePtr<IMappedFileHandle> m_File;
+	TUniquePtr<IMappedFileRegion> m_Region; // Declared after m_File, the region has to be unmapped first
+	const uint8* m_Entries = nullptr;
+	int64 m_NumEntries = 0;
+};
@@ -3,19 +3,76 @@
 
 #include "ChessExperience.h"
 
+#include "ChessBook.h"
+#include "ChessNotation.h"
+#include "ChessSnapshot.h"
+#include "ChessTablebase.h"
+#include "ChessStats.h"
 #include "Components/InstancedStaticMeshComponent.h"
+#include "Components/BoxComponent.h"
 #include "Components/ShapeComponent.h"
-
+#include "Engine/CollisionProfile.h"
+#include "Engine/AssetManager.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
+
+#include "Algo/Reverse.h"
+#include "Algo/StableSort.h"
+#include "Async/Async.h"
 #include "Containers/BitArray.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+
+UE_TRACE_CHANNEL_DEFINE(ChessChannel);
+
+DECLARE_CYCLE_STAT(TEXT("Game Tick"), STAT_ChessGameTick, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Evaluate Instruction"), STAT_ChessEvaluateInstruction, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Flush Instructions"), STAT_ChessFlushInstructions, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Undo/Redo"), STAT_ChessUndoRedo, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Update Anim"), STAT_ChessUpdateAnim, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Setup Piece Renderer"), STAT_ChessSetupPieceRenderer, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Update Pieces Renderer"), STAT_ChessUpdatePiecesRenderer, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Renderer Update Instances"), STAT_ChessRendererUpdateInstances, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Renderer Flush"), STAT_ChessRendererFlush, STATGROUP_Chess);
+DECLARE_CYCLE_STAT(TEXT("Visuals Updated"), STAT_ChessVisualsUpdated, STATGROUP_Chess);
+
+// Counters reset every frame, accumulators hold across frames
+DECLARE_DWORD_COUNTER_STAT(TEXT("Ticking Boards"), STAT_ChessTickingBoards, STATGROUP_Chess);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Instructions Applied"), STAT_ChessInstructionsApplied, STATGROUP_Chess);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Instances Updated"), STAT_ChessInstancesUpdated, STATGROUP_Chess);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Active Anims"), STAT_ChessActiveAnims, STATGROUP_Chess);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Finished Anims"), STAT_ChessFinishedAnims, STATGROUP_Chess);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Undo Depth"), STAT_ChessUndoDepth, STATGROUP_Chess);
+
+static TAutoConsoleVariable<int32> CVarChessPositionVerify(
+	TEXT("Chess.Position.Verify"),
+	0,
+	TEXT("0: off, 1: check the incremental position key against a full recompute after every instruction, 2: also check the bitboards against the game board"));
+
+static TAutoConsoleVariable<int32> CVarChessTickThrottle(
+	TEXT("Chess.Tick.Throttle"),
+	1,
+	TEXT("0: busy boards always tick every frame, 1: off-screen or distant boards tick at their ThrottledTickInterval"));
+
+// Touched tile mask forcing a full resync
+static constexpr uint64 ALL_TILES = ~0ull;
 
 AChessPieceRenderer::AChessPieceRenderer()
 {
-	PrimaryActorTick.bCanEverTick = false;
+	// Only ticks to flush instance writes queued during the frame
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+
+	m_Root = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+	SetRootComponent(m_Root);
 
 	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
 	{
 		FName nameId(FString::Printf(TEXT("InstancedMesh_%i"), pieceId));
 		InstancedMeshes[pieceId] = CreateDefaultSubobject<UInstancedStaticMeshComponent>(nameId);
+		InstancedMeshes[pieceId]->SetupAttachment(m_Root);
 	}
 }
 
@@ -28,71 +85,248 @@ void AChessPieceRenderer::SetupMeshes(TArrayView<UStaticMesh*> meshes)
 	}
 }
 
-TArray<FChessInstancedMesh> AChessPieceRenderer::SetupInstances(TArrayView<FChessPieceInfo> pieces, TArrayView<FTransform> transforms, bool worldSpace)
+void AChessPieceRenderer::UpdateInstances(EChessPieceType::Type pieceId, TArrayView<const FPrimitiveInstanceId> instanceIds, TArrayView<const FTransform> instances, bool worldSpace)
 {
-	check(pieces.Num() == transforms.Num());
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessRendererUpdateInstances);
 
-	TArray<FChessInstancedMesh> result;
-	result.Reserve(pieces.Num());
+	check(instanceIds.Num() == instances.Num());
 
-	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+	for(int32 i = 0; i < instanceIds.Num(); ++i)
+		QueueInstanceUpdate(pieceId, instanceIds[i], instances[i], worldSpace);
+}
+
+void AChessPieceRenderer::UpdateInstances(const TArray<int32>& indices, TArrayView<FChessInstancedMesh> instancedMeshes, bool worldSpace)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessRendererUpdateInstances);
+
+	for (int32 idx : indices)
+	{
+		EChessPieceType::Type pieceId = instancedMeshes[idx].PieceType;
+		FPrimitiveInstanceId instanceId = instancedMeshes[idx].InstanceId;
+
+		QueueInstanceUpdate(pieceId, instanceId, instancedMeshes[idx].Transform, worldSpace);
+	}
+}
+
+void AChessPieceRenderer::QueueInstanceUpdate(EChessPieceType::Type pieceId, FPrimitiveInstanceId instanceId, const FTransform& transform, bool worldSpace)
+{
+	m_PendingWrites[pieceId].Add({ instanceId, transform, worldSpace });
+
+	if (!IsActorTickEnabled())
+		SetActorTickEnabled(true);
+}
+
+void AChessPieceRenderer::FlushInstanceUpdates()
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessRendererFlush);
+
+	if (m_FlushFrame != GFrameCounter)
 	{
-		InstancedMeshes[pieceId]->ClearInstances();
+		m_FlushFrame = GFrameCounter;
+		m_FlushedInstanceCount = 0;
 	}
 
-	for (int32 i = 0; i < pieces.Num(); ++i)
+	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
 	{
-		FChessInstancedMesh instanceInfo;
-		instanceInfo.PieceIdx = pieces[i].PieceIdx;
-		instanceInfo.PieceType = pieces[i].PieceType;
-		instanceInfo.Transform = transforms[i];
+		TArray<FChessInstanceWrite>& writes = m_PendingWrites[pieceId];
+		if (writes.Num() == 0)
+			continue;
+
+		// Stable, so the last write to an instance ends up last in its run
+		Algo::StableSortBy(writes, [](const FChessInstanceWrite& write) { return write.InstanceId.Id; });
+
+		UInstancedStaticMeshComponent* instancedMesh = InstancedMeshes[pieceId];
+		for (int32 i = 0; i < writes.Num(); ++i)
+		{
+			if (i + 1 < writes.Num() && writes[i + 1].InstanceId.Id == writes[i].InstanceId.Id)
+				continue;
 
-		instanceInfo.InstanceId = InstancedMeshes[instanceInfo.PieceType]->AddInstanceById(transforms[i], worldSpace);
+			const int32 instanceIndex = instancedMesh->GetInstanceIndexForId(writes[i].InstanceId);
+			if (instanceIndex == INDEX_NONE)
+				continue;
+
+			instancedMesh->UpdateInstanceTransform(instanceIndex, writes[i].Transform, writes[i].WorldSpace, false, true);
+			++m_FlushedInstanceCount;
+			INC_DWORD_STAT(STAT_ChessInstancesUpdated);
+		}
 
-		result.Add(MoveTemp(instanceInfo));
+		instancedMesh->MarkRenderStateDirty();
+		writes.Reset();
 	}
+}
 
-	return result;
+void AChessPieceRenderer::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	FlushInstanceUpdates();
+	SetActorTickEnabled(false);
+}
+
+// Zero scale instances are culled, hiding one doesn't shift the indices of the others
+static const FTransform HiddenInstanceTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+
+static bool IsHiddenInstance(const FTransform& transform)
+{
+	return transform.GetScale3D().IsZero();
 }
 
-AChessPieceRenderer::InstanceIds AChessPieceRenderer::SetupInstances(TArrayView<TArray<FTransform>> instances, bool worldSpace)
+int32 AChessPieceRenderer::RegisterBoard(bool worldSpace)
 {
-	verify(instances.Num() == EChessPieceType::COUNT);
+	int32 boardIdx = INDEX_NONE;
+	if (m_FreeBoards.Num() > 0)
+	{
+		// Ranges of a removed board are already hidden
+		boardIdx = m_FreeBoards.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		boardIdx = m_Boards.AddDefaulted();
+		FChessRenderBoard& board = m_Boards[boardIdx];
+		for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+		{
+			board.Transforms[pieceId].Init(HiddenInstanceTransform, GetBoardInstanceCapacity(static_cast<EChessPieceType::Type>(pieceId)));
+			board.InstanceIds[pieceId] = InstancedMeshes[pieceId]->AddInstancesById(board.Transforms[pieceId], worldSpace, false);
+		}
+	}
+
+	FChessRenderBoard& board = m_Boards[boardIdx];
+	board.WorldSpace = worldSpace;
+	board.Visible = true;
+	board.Registered = true;
+	return boardIdx;
+}
 
-	InstanceIds ids;
+void AChessPieceRenderer::UnregisterBoard(int32 board)
+{
+	if (!m_Boards.IsValidIndex(board) || !m_Boards[board].Registered)
+		return;
 
 	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
 	{
-		InstancedMeshes[pieceId]->ClearInstances();
-		ids[pieceId] = InstancedMeshes[pieceId]->AddInstancesById(instances[pieceId], worldSpace, false);
+		HideBoardInstances(board, static_cast<EChessPieceType::Type>(pieceId), 0);
 	}
 
-	return ids;
+	m_Boards[board].Registered = false;
+	m_FreeBoards.Add(board);
 }
 
-/*
-void AChessPieceRenderer::UpdateInstances(EChessPieceType::Type pieceId, TArrayView<FPrimitiveInstanceId> instanceIds, TArrayView<FTransform> instances, bool worldSpace)
+void AChessPieceRenderer::PostInitializeComponents()
 {
-	auto& instancedMesh = InstancedMeshes[pieceId];
+	Super::PostInitializeComponents();
 
-	for(int32 i = 0; i < instanceIds.Num(); ++i)
-		instancedMesh->UpdateInstanceTransformById(instanceIds[i], instances[i], worldSpace);
+	// The whole pool is created up front, bodies rest hidden and without collision until a capture hands them a piece
+	for (int32 poolIdx = m_KnockoffBodies.Num(); poolIdx < KnockoffPoolSize; ++poolIdx)
+	{
+		UBoxComponent* body = NewObject<UBoxComponent>(this, FName(FString::Printf(TEXT("KnockoffBody_%i"), poolIdx)));
+		body->SetupAttachment(m_Root);
+		body->SetMobility(EComponentMobility::Movable);
+		body->SetCollisionProfileName(UCollisionProfile::PhysicsActor_ProfileName);
+		body->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		body->RegisterComponent();
+		m_KnockoffBodies.Add(body);
+
+		UStaticMeshComponent* mesh = NewObject<UStaticMeshComponent>(this, FName(FString::Printf(TEXT("KnockoffMesh_%i"), poolIdx)));
+		mesh->SetupAttachment(body);
+		mesh->SetMobility(EComponentMobility::Movable);
+		mesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		mesh->SetVisibility(false);
+		mesh->RegisterComponent();
+		m_KnockoffMeshes.Add(mesh);
+
+		m_FreeKnockoffBodies.Add(poolIdx);
+	}
 }
-*/
 
-void AChessPieceRenderer::UpdateInstances(const TArray<int32>& indices, TArrayView<FChessInstancedMesh> instancedMeshes, bool worldSpace)
+int32 AChessPieceRenderer::AcquireKnockoffBody()
 {
-	for (int32 idx : indices)
+	return m_FreeKnockoffBodies.Num() > 0 ? m_FreeKnockoffBodies.Pop(EAllowShrinking::No) : INDEX_NONE;
+}
+
+void AChessPieceRenderer::ReleaseKnockoffBody(int32 poolIdx)
+{
+	// Simulated bodies detach from the renderer, put it back in place for the next capture
+	UBoxComponent* body = m_KnockoffBodies[poolIdx];
+	FinishKnockoff(body);
+	body->AttachToComponent(m_Root, FAttachmentTransformRules::SnapToTargetIncludingScale);
+	m_KnockoffMeshes[poolIdx]->SetVisibility(false);
+
+	m_FreeKnockoffBodies.Add(poolIdx);
+}
+
+void AChessPieceRenderer::SetBoardInstance(int32 board, EChessPieceType::Type pieceType, int32 typeSlot, const FTransform& transform)
+{
+	FChessRenderBoard& renderBoard = m_Boards[board];
+	check(renderBoard.Registered);
+
+	renderBoard.Transforms[pieceType][typeSlot] = transform;
+	if (renderBoard.Visible)
+		QueueInstanceUpdate(pieceType, renderBoard.InstanceIds[pieceType][typeSlot], transform, renderBoard.WorldSpace);
+}
+
+void AChessPieceRenderer::HideBoardInstances(int32 board, EChessPieceType::Type pieceType, int32 firstTypeSlot)
+{
+	FChessRenderBoard& renderBoard = m_Boards[board];
+	TArray<FTransform>& transforms = renderBoard.Transforms[pieceType];
+	for (int32 typeSlot = firstTypeSlot; typeSlot < transforms.Num(); ++typeSlot)
 	{
-		EChessPieceType::Type pieceId = instancedMeshes[idx].PieceType;
-		FPrimitiveInstanceId instanceId = instancedMeshes[idx].InstanceId;
+		if (IsHiddenInstance(transforms[typeSlot]))
+			continue;
+
+		transforms[typeSlot] = HiddenInstanceTransform;
+		if (renderBoard.Visible)
+			QueueInstanceUpdate(pieceType, renderBoard.InstanceIds[pieceType][typeSlot], HiddenInstanceTransform, renderBoard.WorldSpace);
+	}
+}
+
+void AChessPieceRenderer::SetBoardVisible(int32 board, bool visible)
+{
+	if (!m_Boards.IsValidIndex(board) || m_Boards[board].Visible == visible)
+		return;
+
+	// Only the board's own ranges are written, unused instances stay hidden either way
+	FChessRenderBoard& renderBoard = m_Boards[board];
+	renderBoard.Visible = visible;
+	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+	{
+		const TArray<FTransform>& transforms = renderBoard.Transforms[pieceId];
+		for (int32 typeSlot = 0; typeSlot < transforms.Num(); ++typeSlot)
+		{
+			if (IsHiddenInstance(transforms[typeSlot]))
+				continue;
+
+			QueueInstanceUpdate(static_cast<EChessPieceType::Type>(pieceId), renderBoard.InstanceIds[pieceId][typeSlot],
+				visible ? transforms[typeSlot] : HiddenInstanceTransform, renderBoard.WorldSpace);
+		}
+	}
+}
+
+void FChessPieceStore::Reset()
+{
+	KnownPieces = 0;
+	ResetInstances();
+}
+
+void FChessPieceStore::ResetInstances()
+{
+	for (int32 slot = 0; slot < MAX_BOARD_PIECES; ++slot)
+	{
+		InstanceIndices[slot] = INDEX_NONE;
+	}
 
-		InstancedMeshes[pieceId]->UpdateInstanceTransformById(instanceId, instancedMeshes[idx].Transform, worldSpace);
+	for (int32& offset : TypeOffsets)
+	{
+		offset = 0;
 	}
 }
 
 AChessGame::AChessGame()
 {
+	// Only ticks while instructions, anims or knockoffs are pending, see UpdateTickState
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+
 	m_Root = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
 	m_BoardSurfaceMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("BoardSurfaceMesh"));
 	m_BoardBodyMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("BoardBodyMesh"));
@@ -104,54 +338,149 @@ AChessGame::AChessGame()
 	SetRootComponent(m_Root);
 	m_BoardSurfaceMesh->SetupAttachment(m_Root);
 	m_BoardBodyMesh->SetupAttachment(m_Root);
+
+	// Picking reads the cached frame, it is refreshed whenever the board moves at runtime or in the editor
+	m_Root->TransformUpdated.AddUObject(this, &AChessGame::OnBoardTransformUpdated);
+
+	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+	{
+		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+		{
+			m_TilePieces[x][y] = Chess::PIECE_IDX_NONE;
+		}
+	}
+
+	for (EChessSide::Type& side : m_PieceSides)
+	{
+		side = EChessSide::White;
+	}
+
+	for (uint32& anim : m_PieceAnims)
+	{
+		anim = ANIM_HANDLE_NONE;
+	}
+
+	for (int32& graveSlot : m_GraveyardSlots)
+	{
+		graveSlot = INDEX_NONE;
+	}
 }
 
 void AChessGame::Setup(APlayerController* player, AController* ai)
 {
+	ResetGame(player, ai);
+	UpdatePiecesPositions(m_Renderer);
+}
+
+void AChessGame::ResetGame(APlayerController* player, AController* ai)
+{
+	CancelAIMove();
 	SetupGame(player, ai, m_Game);
 	m_PlayerController = player;
 	m_AIController = ai;
+	m_InstructionRecords.Reset();
+	m_RedoInstructions.Reset();
+	m_TrimmedHistory = 0;
+	m_QueuedInstructions.Reset();
+	UpdateUndoDepthStat(0);
 
-	UpdatePiecesPositions(m_Renderer);
+	SetupPosition();
+}
+
+void AChessGame::UpdateUndoDepthStat(int32 depth)
+{
+	// Every board adds its own depth to the accumulator
+	if (depth > m_StatUndoDepth)
+		INC_DWORD_STAT_BY(STAT_ChessUndoDepth, depth - m_StatUndoDepth);
+	else if (depth < m_StatUndoDepth)
+		DEC_DWORD_STAT_BY(STAT_ChessUndoDepth, m_StatUndoDepth - depth);
+
+	m_StatUndoDepth = depth;
 }
 
 void AChessGame::SetupTileSizes()
 {
 	float tileWidth = 1.0f;
 	float tileDepth = 1.0f;
-
 	GetTileBaseSize(tileWidth, tileDepth);
-	float boardWidth = tileWidth * Chess::BOARD_SIZE;
-	float boardDepth = tileDepth * Chess::BOARD_SIZE;
 
-	const float scale = GetActorScale().GetMax();
-	tileWidth *= scale;
-	tileDepth *= scale;
-	boardWidth *= scale;
-	boardDepth *= scale;
+	// Sizes stay in board space, the actor scale is applied by the board transform
+	m_BoardFrame.SetTileSize(FVector2D(tileWidth, tileDepth));
+	m_BoardFrame.BoardToWorld = GetActorTransform();
+}
 
-	FVector2D origin;
-	origin.X = GetActorLocation().X - (boardWidth * 0.5f) + (tileWidth * 0.5f);
-	origin.Y = GetActorLocation().Y - (boardDepth * 0.5f) + (tileDepth * 0.5f);
+void AChessGame::OnBoardTransformUpdated(USceneComponent* component, EUpdateTransformFlags flags, ETeleportType teleport)
+{
+	m_BoardFrame.BoardToWorld = component->GetComponentTransform();
 
-	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+	// Attached renderers follow on their own. Shared ones are for boards that stay put, a move is still rewritten so it shows correctly.
+	if (m_Renderer && m_RendererBoard != INDEX_NONE && !m_RendererLocal)
 	{
-		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+		if (HasActorBegunPlay() && !m_WarnedSharedMove)
 		{
-			m_TilePositions[x][y].X = origin.X + (tileWidth * x);
-			m_TilePositions[x][y].Y = origin.Y + (tileDepth * y);
+			m_WarnedSharedMove = true;
+			UE_LOG(LogTemp, Warning, TEXT("%s moves while sharing a renderer, every move rewrites all of its instances"), *GetName());
 		}
+		UpdatePiecesRenderer(*m_Renderer);
 	}
 }
 
+bool AChessGame::GetCursorTile(APlayerController* player, int32& tileX, int32& tileY) const
+{
+	FVector rayOrigin;
+	FVector rayDirection;
+	if (!player || !player->DeprojectMousePositionToWorld(rayOrigin, rayDirection))
+		return false;
+
+	return m_BoardFrame.RayToTile(rayOrigin, rayDirection, tileX, tileY);
+}
+
 void AChessGame::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
 	Super::PostEditChangeProperty(PropertyChangedEvent);
 
-	if (PropertyChangedEvent.GetPropertyName().IsEqual(TEXT("RelativeScale3D")))
+	// Transform edits only move the board frame, see OnBoardTransformUpdated
+	const FName propertyName = PropertyChangedEvent.GetPropertyName();
+	if (propertyName == USceneComponent::GetRelativeLocationPropertyName() || propertyName == USceneComponent::GetRelativeRotationPropertyName() || propertyName == USceneComponent::GetRelativeScale3DPropertyName())
+		return;
+
+	if (propertyName == GET_MEMBER_NAME_CHECKED(AChessGame, bOwnsRenderer))
+	{
+		AChessPieceRenderer* renderer = m_Renderer;
+		SetRenderer(nullptr);
+		SetRenderer(renderer);
+		return;
+	}
+
+	// Anything else may change the tile layout
+	SetupTileSizes();
+	UpdatePiecesPositions(m_Renderer);
+}
+
+void AChessGame::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// The task holds its own reference to the search state, it only needs to be told to stop
+	CancelAIMove();
+
+	// A shared renderer outlives the board, give the ranges and bodies back
+	if (IsValid(m_Renderer))
 	{
-		UE_LOG(LogTemp, Log, TEXT("Scale changed!"));
+		ReturnKnockoffBodies();
+		m_Renderer->UnregisterBoard(m_RendererBoard);
 	}
+	m_KnockoffMarkers.Reset();
+	m_RendererBoard = INDEX_NONE;
+	m_RendererLocal = false;
+
+	for (const FChessKnockoff& knockoff : m_Knockoffs)
+	{
+		FinishKnockoff(knockoff.Body.Get());
+	}
+	m_Knockoffs.Reset();
+
+	UpdateUndoDepthStat(0);
+
+	Super::EndPlay(EndPlayReason);
 }
 
 void AChessGame::SetupGame(APlayerController* player, AController* ai, ChessGame& game)
@@ -169,19 +498,15 @@ void AChessGame::SetupGame(APlayerController* player, AController* ai, ChessGame
 
 void AChessGame::DebugDrawTiles()
 {
-	FVector3f extent;
-	extent.Z = 1.0f;
-	extent *= GetActorScale().GetMax();
+	const FTransform& boardToWorld = m_BoardFrame.BoardToWorld;
+	const FVector extent = FVector(m_BoardFrame.TileSize * 0.5, 1.0) * boardToWorld.GetScale3D();
 
-	GetTileBaseSize(extent.X, extent.Y);
-	extent.X *= 0.5f;
-	extent.Y *= 0.5f;
 	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
 	{
 		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
 		{
 			DrawDebugPoint(GetWorld(), GetTilePosition(x, y), 6.0F, FColor::Red);
-			DrawDebugBox(GetWorld(), GetTilePosition(x,y), FVector(extent), FColor::Green);
+			DrawDebugBox(GetWorld(), GetTilePosition(x,y), extent, boardToWorld.GetRotation(), FColor::Green);
 		}
 	}
 }
@@ -192,9 +517,42 @@ void AChessGame::GetTileBaseSize(float& outX, float& outY) const
 	outY = GetVisual().BaseTileWidth;
 }
 
-FVector AChessGame::GetTilePosition(int32 tileX, int32 tileY) const
+void FChessBoardFrame::SetTileSize(const FVector2D& tileSize)
+{
+	TileSize = tileSize;
+	InvTileSize = FVector2D(1.0 / tileSize.X, 1.0 / tileSize.Y);
+	Origin = -0.5 * (Chess::BOARD_SIZE - 1) * tileSize;
+}
+
+bool FChessBoardFrame::LocalToTile(const FVector2D& local, int32& outX, int32& outY) const
 {
-	return FVector(m_TilePositions[tileX][tileY], GetActorLocation().Z);
+	// Tile edges are half a tile off the centers
+	const FVector2D tile = (local - Origin) * InvTileSize + FVector2D(0.5);
+	outX = FMath::FloorToInt32(tile.X);
+	outY = FMath::FloorToInt32(tile.Y);
+
+	return outX >= 0 && outX < Chess::BOARD_SIZE && outY >= 0 && outY < Chess::BOARD_SIZE;
+}
+
+bool FChessBoardFrame::WorldToTile(const FVector& world, int32& outX, int32& outY) const
+{
+	const FVector local = BoardToWorld.InverseTransformPosition(world);
+	return LocalToTile(FVector2D(local), outX, outY);
+}
+
+bool FChessBoardFrame::RayToTile(const FVector& rayOrigin, const FVector& rayDirection, int32& outX, int32& outY) const
+{
+	// The ray parameter is the same in both spaces, the direction doesn't need to be normalized
+	const FVector localOrigin = BoardToWorld.InverseTransformPosition(rayOrigin);
+	const FVector localDirection = BoardToWorld.InverseTransformVector(rayDirection);
+	if (FMath::IsNearlyZero(localDirection.Z))
+		return false;
+
+	const double t = -localOrigin.Z / localDirection.Z;
+	if (t < 0.0)
+		return false;
+
+	return LocalToTile(FVector2D(localOrigin + localDirection * t), outX, outY);
 }
 
 void AChessGame::SetVisual(FDataTableRowHandle row)
@@ -205,12 +563,92 @@ void AChessGame::SetVisual(FDataTableRowHandle row)
 	if (row.DataTable.Get()->RowStruct != FChessBoardVisual::StaticStruct())
 		return;
 
-	m_Visual = *(FChessBoardVisual*)row.DataTable->FindRowUnchecked(row.RowName);
-	OnVisualsUpdated(m_Visual);
+	const FChessBoardVisual* visual = (FChessBoardVisual*)row.DataTable->FindRowUnchecked(row.RowName);
+	if (!visual)
+		return;
+
+	m_PendingVisualRow = FDataTableRowHandle();
+
+	TSharedPtr<FStreamableHandle> handle = bAsyncVisualSwap ? RequestVisual(row, *visual) : nullptr;
+	if (!handle.IsValid() || handle->HasLoadCompleted())
+	{
+		m_Visual = *visual;
+		OnVisualsUpdated(m_Visual);
+		return;
+	}
+
+	m_PendingVisualRow = row;
+	handle->BindCompleteDelegate(FStreamableDelegate::CreateUObject(this, &AChessGame::OnVisualLoaded, row));
+}
+
+void AChessGame::OnVisualLoaded(FDataTableRowHandle row)
+{
+	// Superseded by a later SetVisual
+	if (row != m_PendingVisualRow || !row.DataTable)
+		return;
+
+	m_PendingVisualRow = FDataTableRowHandle();
+
+	if (const FChessBoardVisual* visual = (FChessBoardVisual*)row.DataTable->FindRowUnchecked(row.RowName))
+	{
+		m_Visual = *visual;
+		OnVisualsUpdated(m_Visual);
+	}
+}
+
+TSharedPtr<FStreamableHandle> AChessGame::RequestVisual(const FDataTableRowHandle& row, const FChessBoardVisual& visual)
+{
+	const int32 cachedIdx = m_VisualCache.IndexOfByPredicate([&row](const FChessVisualCacheEntry& entry) { return entry.Row == row; });
+	if (cachedIdx != INDEX_NONE)
+	{
+		FChessVisualCacheEntry entry = MoveTemp(m_VisualCache[cachedIdx]);
+		m_VisualCache.RemoveAt(cachedIdx, EAllowShrinking::No);
+		return m_VisualCache.Add_GetRef(MoveTemp(entry)).Handle;
+	}
+
+	TArray<FSoftObjectPath> paths;
+	GetVisualAssetPaths(visual, paths);
+
+	TSharedPtr<FStreamableHandle> handle;
+	if (paths.Num() > 0)
+	{
+		handle = UAssetManager::GetStreamableManager().RequestAsyncLoad(MoveTemp(paths));
+	}
+
+	while (m_VisualCache.Num() >= FMath::Max(VisualCacheSize, 1))
+	{
+		if (m_VisualCache[0].Handle.IsValid())
+			m_VisualCache[0].Handle->ReleaseHandle();
+
+		m_VisualCache.RemoveAt(0, EAllowShrinking::No);
+	}
+
+	m_VisualCache.Add({ row, handle });
+	return handle;
+}
+
+void AChessGame::PrefetchVisuals(UDataTable* visuals)
+{
+	if (!visuals || visuals->RowStruct != FChessBoardVisual::StaticStruct())
+		return;
+
+	TArray<FSoftObjectPath> paths;
+	visuals->ForeachRow<FChessBoardVisual>(TEXT("PrefetchVisuals"), [&paths](const FName& key, const FChessBoardVisual& visual)
+	{
+		GetVisualAssetPaths(visual, paths);
+	});
+
+	if (m_PrefetchHandle.IsValid())
+		m_PrefetchHandle->ReleaseHandle();
+
+	m_PrefetchHandle = paths.Num() > 0 ? UAssetManager::GetStreamableManager().RequestAsyncLoad(MoveTemp(paths)) : nullptr;
 }
 
 void AChessGame::OnVisualsUpdated(const FChessBoardVisual& newVisuals)
 {
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessVisualsUpdated);
+
+	// Resolves immediately when the visual was streamed in
 	m_BoardBodyMesh->SetStaticMesh(newVisuals.BoardBodyMesh.LoadSynchronous());
 	m_BoardSurfaceMesh->SetStaticMesh(newVisuals.BoardSurfaceMesh.LoadSynchronous());
 	m_BoardSurfaceMesh->SetMaterial(0, newVisuals.SurfaceMaterial.LoadSynchronous());
@@ -223,11 +661,32 @@ void AChessGame::SetRenderer(AChessPieceRenderer* renderer)
 {
 	if (renderer != m_Renderer)
 	{
+		if (m_Renderer)
+		{
+			ReturnKnockoffBodies();
+			m_Renderer->UnregisterBoard(m_RendererBoard);
+			if (m_RendererLocal)
+				m_Renderer->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+		}
+		m_RendererBoard = INDEX_NONE;
+		m_RendererLocal = false;
+
 		m_Renderer = renderer;
 		SetupPieceRenderer(m_Renderer);
 	}
 }
 
+void AChessGame::SetPiecesVisible(bool visible)
+{
+	if (m_Renderer)
+		m_Renderer->SetBoardVisible(m_RendererBoard, visible);
+}
+
+bool AChessGame::ArePiecesVisible() const
+{
+	return m_Renderer && m_Renderer->IsBoardVisible(m_RendererBoard);
+}
+
 void AChessGame::SetupPiecesPositions(AChessPieceRenderer* renderer)
 {
 	const Chess::Board& board = m_Game.GetBoard();
@@ -239,104 +698,1592 @@ void AChessGame::SetupPiecesPositions(AChessPieceRenderer* renderer)
 			if (idx == Chess::PIECE_IDX_NONE)
 				continue;
 
-			FTransform& transform = m_PieceTransforms.FindOrAdd(idx);
-			const FVector pos = GetTilePosition(x, y);
-			transform.SetTranslation(pos);
+			SetPiecePosition(idx, x, y);
 		}
 	}
 }
 
+bool AChessGame::SetPiecePosition(Chess::PieceIdx idx, int32 tileX, int32 tileY)
+{
+	const int32 slot = GetPieceSlot(idx);
+	m_Pieces.Positions[slot] = m_BoardFrame.GetLocalTileCenter(tileX, tileY);
+	m_Pieces.Heights[slot] = 0.0f;
+	m_Pieces.KnownPieces |= 1ull << slot;
+
+	if (m_Pieces.InstanceIndices[slot] == INDEX_NONE)
+		return true;
+
+	// Promotions change the type, and with it the instance range of the piece
+	return m_Pieces.PieceTypes[slot] != Into<EChessPieceType::Type>(m_Game.GetPieceType(idx));
+}
+
 void AChessGame::SetupPieceRenderer(AChessPieceRenderer* renderer)
 {
-	if (m_Renderer)
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessSetupPieceRenderer);
+
+	m_Pieces.ResetInstances();
+
+	if (renderer)
 	{
-		m_Renderer->SetupMeshes(TArrayView<UStaticMesh*>(PieceMeshes));
+		check(renderer == m_Renderer);
+		renderer->SetupMeshes(TArrayView<UStaticMesh*>(PieceMeshes));
 
-		TArray<FTransform> pieceTransforms[EChessPieceType::COUNT];
-		for (const auto pair : m_PieceTransforms)
+		if (m_RendererBoard == INDEX_NONE)
 		{
-			EChessPieceType::Type pieceId = static_cast<EChessPieceType::Type>(m_Game.GetPieceType(pair.Key));
-			pieceTransforms[pieceId].Add(pair.Value);
+			// A renderer serving this board alone rides along with it, its instances stay in board space
+			m_RendererLocal = bOwnsRenderer && renderer->GetNumBoards() == 0;
+			if (m_RendererLocal)
+				renderer->AttachToActor(this, FAttachmentTransformRules::SnapToTargetIncludingScale);
+			m_RendererBoard = renderer->RegisterBoard(!m_RendererLocal);
+
+			// Now shared, the board it rides along with registers again in world space
+			AChessGame* localBoard = Cast<AChessGame>(renderer->GetAttachParentActor());
+			if (!m_RendererLocal && localBoard && localBoard != this && localBoard->m_Renderer == renderer)
+			{
+				localBoard->SetRenderer(nullptr);
+				localBoard->SetRenderer(renderer);
+			}
 		}
 
-		m_RendererInstanceIds = m_Renderer->SetupInstances(pieceTransforms, true);
-	}
-	else
-	{
-		for (auto& instances : m_RendererInstanceIds)
-			instances.Empty();
+		int32 typeCounts[EChessPieceType::COUNT] = {};
+		for (int32 slot = 0; slot < MAX_BOARD_PIECES; ++slot)
+		{
+			if (!m_Pieces.IsKnown(slot))
+				continue;
+
+			m_Pieces.PieceTypes[slot] = Into<EChessPieceType::Type>(m_Game.GetPieceType(static_cast<Chess::PieceIdx>(slot)));
+			++typeCounts[m_Pieces.PieceTypes[slot]];
+		}
+
+		int32 typeCursors[EChessPieceType::COUNT];
+		for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+		{
+			typeCursors[pieceId] = m_Pieces.TypeOffsets[pieceId];
+			m_Pieces.TypeOffsets[pieceId + 1] = m_Pieces.TypeOffsets[pieceId] + typeCounts[pieceId];
+		}
+
+		for (int32 slot = 0; slot < MAX_BOARD_PIECES; ++slot)
+		{
+			if (!m_Pieces.IsKnown(slot))
+				continue;
+
+			const int32 instanceIdx = typeCursors[m_Pieces.PieceTypes[slot]]++;
+			m_Pieces.InstanceIndices[slot] = instanceIdx;
+			m_Pieces.InstancePieces[instanceIdx] = static_cast<Chess::PieceIdx>(slot);
+			// Pieces carried by a knockoff body keep their instance hidden
+			const FVector scale = FindKnockoffBody(slot) == INDEX_NONE ? FVector::OneVector : FVector::ZeroVector;
+			m_Pieces.InstanceTransforms[instanceIdx] = FTransform(FQuat::Identity, FVector(m_Pieces.Positions[slot], m_Pieces.Heights[slot]), scale);
+		}
+
+		for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+		{
+			const EChessPieceType::Type pieceType = static_cast<EChessPieceType::Type>(pieceId);
+			check(typeCounts[pieceId] <= GetBoardInstanceCapacity(pieceType));
+
+			for (int32 typeSlot = 0; typeSlot < typeCounts[pieceId]; ++typeSlot)
+			{
+				renderer->SetBoardInstance(m_RendererBoard, pieceType, typeSlot, GetRendererTransform(m_Pieces.InstanceTransforms[m_Pieces.TypeOffsets[pieceId] + typeSlot]));
+			}
+			renderer->HideBoardInstances(m_RendererBoard, pieceType, typeCounts[pieceId]);
+		}
+
+		m_DirtyPieces.Reset();
 	}
 }
 
 void AChessGame::UpdatePiecesPositions(AChessPieceRenderer* renderer)
 {
+	// Full resyncs snap every piece
+	StopPieceAnims();
+	bool needsSetup = false;
+	uint64 boardPieces = 0;
+
 	const Chess::Board& board = m_Game.GetBoard();
 	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
 	{
 		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
 		{
 			Chess::PieceIdx idx = board.At(x, y);
+			m_TilePieces[x][y] = idx;
 			if (idx == Chess::PIECE_IDX_NONE)
 				continue;
 
-			FTransform& transform = m_PieceTransforms.FindOrAdd(idx);
-			const FVector pos = GetTilePosition(x, y);
-			transform.SetTranslation(pos);
+			const int32 slot = GetPieceSlot(idx);
+			boardPieces |= 1ull << slot;
+			if (IsCaptured(slot))
+				RevivePiece(slot);
+
+			needsSetup |= SetPiecePosition(idx, x, y);
 		}
 	}
 
+	// Pieces gone from the board go straight to the graveyard
+	uint64 capturedPieces = m_Pieces.KnownPieces & ~boardPieces & ~m_CapturedPieces;
+	while (capturedPieces)
+	{
+		const int32 slot = FMath::CountTrailingZeros64(capturedPieces);
+		capturedPieces &= capturedPieces - 1;
+		CapturePiece(slot, false);
+	}
+
 	if (renderer)
 	{
-		UpdatePiecesRenderer(*renderer);
+		if (needsSetup)
+			SetupPieceRenderer(renderer);
+		else
+			UpdatePiecesRenderer(*renderer);
 	}
 }
 
-void AChessGame::UpdatePiecesRenderer(AChessPieceRenderer& renderer)
+void AChessGame::UpdatePiecesPositions(AChessPieceRenderer* renderer, TArrayView<const FIntPoint> tiles)
 {
-	TArray<FTransform> pieceTransforms[EChessPieceType::COUNT];
-	for (const auto pair : m_PieceTransforms)
+	m_LastDelta.Tiles.Reset();
+	m_LastDelta.Pieces.Reset();
+	bool needsSetup = false;
+	uint64 removedPieces = 0;
+	uint64 placedPieces = 0;
+
+	const Chess::Board& board = m_Game.GetBoard();
+	for (const FIntPoint& tile : tiles)
 	{
-		EChessPieceType::Type pieceId = Into<EChessPieceType::Type>(m_Game.GetPieceType(pair.Key));
-		pieceTransforms[pieceId].Add(pair.Value);
+		Chess::PieceIdx& cachedIdx = m_TilePieces[tile.X][tile.Y];
+		const Chess::PieceIdx idx = board.At(tile.X, tile.Y);
+		if (idx == cachedIdx)
+			continue;
+
+		m_LastDelta.Tiles.Add(tile);
+		if (cachedIdx != Chess::PIECE_IDX_NONE)
+		{
+			m_LastDelta.Pieces.AddUnique(cachedIdx);
+			removedPieces |= 1ull << GetPieceSlot(cachedIdx);
+		}
+
+		cachedIdx = idx;
+		if (idx == Chess::PIECE_IDX_NONE)
+			continue;
+
+		m_LastDelta.Pieces.AddUnique(idx);
+
+		// Undone captures come back from the graveyard
+		const int32 slot = GetPieceSlot(idx);
+		placedPieces |= 1ull << slot;
+		if (IsCaptured(slot))
+			RevivePiece(slot);
+
+		// Moved pieces glide from wherever they are drawn, which may be halfway through an earlier anim
+		const int32 instanceIdx = m_Pieces.InstanceIndices[slot];
+		const bool animate = renderer && MoveAnimSeconds > 0.0f && instanceIdx != INDEX_NONE;
+		const FVector2D from = animate ? FVector2D(m_Pieces.InstanceTransforms[instanceIdx].GetTranslation()) : FVector2D::ZeroVector;
+
+		needsSetup |= SetPiecePosition(idx, tile.X, tile.Y);
+
+		if (animate && !from.Equals(m_Pieces.Positions[slot]))
+			StartPieceAnim(slot, from);
 	}
 
-	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+	if (renderer)
 	{
-		renderer.UpdateInstances(static_cast<EChessPieceType::Type>(pieceId), instanceIds, pieceTransforms[pieceId], true);
+		if (needsSetup)
+			SetupPieceRenderer(renderer);
+		else if (m_LastDelta.Pieces.Num() > 0)
+			UpdatePiecesRenderer(*renderer, m_LastDelta.Pieces);
 	}
+
+	// Pieces that left the board without landing on another tile were captured or killed
+	uint64 capturedPieces = removedPieces & ~placedPieces & ~m_CapturedPieces;
+	while (capturedPieces)
+	{
+		const int32 slot = FMath::CountTrailingZeros64(capturedPieces);
+		capturedPieces &= capturedPieces - 1;
+		CapturePiece(slot, renderer != nullptr);
+	}
+}
+
+void AChessGame::UpdatePiecesRenderer(AChessPieceRenderer& renderer)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessUpdatePiecesRenderer);
+
+	for (int32 instanceIdx = 0; instanceIdx < m_Pieces.TypeOffsets[EChessPieceType::COUNT]; ++instanceIdx)
+	{
+		// Animated pieces stay where they are drawn, the tick moves them on
+		const int32 slot = GetPieceSlot(m_Pieces.InstancePieces[instanceIdx]);
+		if (m_PieceAnims[slot] == ANIM_HANDLE_NONE)
+			m_Pieces.InstanceTransforms[instanceIdx].SetTranslation(FVector(m_Pieces.Positions[slot], m_Pieces.Heights[slot]));
+	}
+
+	for (uint8 pieceId = 0; pieceId < EChessPieceType::COUNT; ++pieceId)
+	{
+		const EChessPieceType::Type pieceType = static_cast<EChessPieceType::Type>(pieceId);
+		for (int32 typeSlot = 0; typeSlot < m_Pieces.NumInstances(pieceType); ++typeSlot)
+		{
+			renderer.SetBoardInstance(m_RendererBoard, pieceType, typeSlot, GetRendererTransform(m_Pieces.InstanceTransforms[m_Pieces.TypeOffsets[pieceId] + typeSlot]));
+		}
+	}
+
+	// Everything was just written
+	m_DirtyPieces.Reset();
+}
+
+void AChessGame::UpdatePiecesRenderer(AChessPieceRenderer& renderer, TArrayView<const Chess::PieceIdx> pieces)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessUpdatePiecesRenderer);
+
+	for (Chess::PieceIdx idx : pieces)
+	{
+		// Animated pieces are moved on by the tick
+		const int32 slot = GetPieceSlot(idx);
+		if (m_PieceAnims[slot] != ANIM_HANDLE_NONE)
+			continue;
+
+		SetPieceInstancePosition(slot, m_Pieces.Positions[slot]);
+	}
+
+	WriteDirtyPieces(renderer);
+}
+
+void AChessGame::SetPieceInstancePosition(int32 slot, const FVector2D& position)
+{
+	const int32 instanceIdx = m_Pieces.InstanceIndices[slot];
+	if (instanceIdx == INDEX_NONE)
+		return;
+
+	m_Pieces.InstanceTransforms[instanceIdx].SetTranslation(FVector(position, m_Pieces.Heights[slot]));
+	m_DirtyPieces.Mark(static_cast<Chess::PieceIdx>(slot));
+}
+
+void AChessGame::WriteDirtyPieces(AChessPieceRenderer& renderer)
+{
+	// InstanceIndices is the reverse index, so only the dirty pieces are visited
+	while (!m_DirtyPieces.IsEmpty())
+	{
+		const int32 slot = m_DirtyPieces.PopSlot();
+		const int32 instanceIdx = m_Pieces.InstanceIndices[slot];
+		if (instanceIdx == INDEX_NONE)
+			continue;
+
+		const EChessPieceType::Type pieceType = m_Pieces.PieceTypes[slot];
+		renderer.SetBoardInstance(m_RendererBoard, pieceType, instanceIdx - m_Pieces.TypeOffsets[pieceType], GetRendererTransform(m_Pieces.InstanceTransforms[instanceIdx]));
+	}
+}
+
+void AChessGame::EvaluateInstruction(const Chess::FBoardInstruction& instruction)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessEvaluateInstruction);
+
+	uint64 touchedTiles = 0;
+	if (!ApplyInstruction(instruction, touchedTiles))
+	{
+		m_LastDelta.Tiles.Reset();
+		m_LastDelta.Pieces.Reset();
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_ChessInstructionsApplied);
+	OnInstructionsApplied(touchedTiles);
+}
+
+int32 AChessGame::UndoInstructions(int32 count)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessUndoRedo);
+
+	uint64 touchedTiles = 0;
+	int32 numUndone = 0;
+	while (numUndone < count && RevertInstruction(touchedTiles))
+	{
+		++numUndone;
+	}
+
+	if (numUndone > 0)
+	{
+		CancelAIMove();
+		RefreshTiles(touchedTiles);
+		VerifyPosition();
+	}
+
+	return numUndone;
+}
+
+int32 AChessGame::RedoInstructions(int32 count)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessUndoRedo);
+
+	uint64 touchedTiles = 0;
+	int32 numRedone = 0;
+	while (numRedone < count && m_RedoInstructions.Num() > 0)
+	{
+		const TOptional<Chess::FBoardInstruction> instruction = DecodeInstruction(m_RedoInstructions.Pop(EAllowShrinking::No));
+		if (!instruction.IsSet() || !ApplyInstruction(instruction.GetValue(), touchedTiles))
+		{
+			// The rest of the redo stack builds on the instruction that failed
+			m_RedoInstructions.Reset();
+			break;
+		}
+
+		++numRedone;
+	}
+
+	if (numRedone > 0)
+	{
+		CancelAIMove();
+		RefreshTiles(touchedTiles);
+		VerifyPosition();
+	}
+
+	return numRedone;
+}
+
+void AChessGame::Tick(float DeltaSeconds)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessGameTick);
+	INC_DWORD_STAT(STAT_ChessTickingBoards);
+
+	Super::Tick(DeltaSeconds);
+
+	// Throttled ticks get the time since the last tick, anims and knockoffs catch up in one step
+	FlushInstructions();
+	TickPieceAnims(DeltaSeconds);
+	TickKnockoffs(DeltaSeconds);
+
+	UpdateTickState();
+}
+
+bool AChessGame::HasPendingWork() const
+{
+	return m_QueuedInstructions.Num() > 0 || m_Anims.Pieces.Num() > 0 || m_Anims.StoppedAnims.Num() > 0 || m_Knockoffs.Num() > 0;
+}
+
+void AChessGame::UpdateTickState()
+{
+	if (!HasPendingWork())
+	{
+		if (IsActorTickEnabled())
+			SetActorTickEnabled(false);
+		return;
+	}
+
+	// Queued instructions are promised to the next tick, they are never throttled
+	const float interval = m_QueuedInstructions.Num() == 0 && ShouldThrottleTick() ? ThrottledTickInterval : 0.0f;
+	if (GetActorTickInterval() != interval)
+		SetActorTickInterval(interval);
+
+	if (!IsActorTickEnabled())
+		SetActorTickEnabled(true);
+}
+
+bool AChessGame::ShouldThrottleTick() const
+{
+	if (CVarChessTickThrottle.GetValueOnGameThread() == 0 || ThrottledTickInterval <= 0.0f)
+		return false;
+
+	if (!WasRecentlyRendered())
+		return true;
+
+	if (ThrottleDistance <= 0.0f)
+		return false;
+
+	const APlayerController* player = GetWorld() ? GetWorld()->GetFirstPlayerController() : nullptr;
+	if (!player || !player->PlayerCameraManager)
+		return false;
+
+	return FVector::DistSquared(player->PlayerCameraManager->GetCameraLocation(), GetActorLocation()) > FMath::Square(ThrottleDistance);
+}
+
+void AChessGame::StartPieceAnim(int32 slot, const FVector2D& from)
+{
+	if (m_PieceAnims[slot] != ANIM_HANDLE_NONE)
+		StopAnim(m_Anims, m_PieceAnims[slot]);
+
+	m_Anims.AnimDurationSeconds = MoveAnimSeconds;
+	m_PieceAnims[slot] = AddAnim(m_Anims, static_cast<Chess::PieceIdx>(slot), from, m_Pieces.Positions[slot]);
+
+	UpdateTickState();
+}
+
+void AChessGame::StopPieceAnims()
+{
+	for (uint32& anim : m_PieceAnims)
+	{
+		if (anim == ANIM_HANDLE_NONE)
+			continue;
+
+		StopAnim(m_Anims, anim);
+		anim = ANIM_HANDLE_NONE;
+	}
+
+	// The caller snaps the pieces, nothing is left to report
+	m_Anims.StoppedAnims.Reset();
+}
+
+void AChessGame::TickPieceAnims(float deltaSeconds)
+{
+	if (m_Anims.Pieces.Num() == 0 && m_Anims.StoppedAnims.Num() == 0)
+		return;
+
+	INC_DWORD_STAT_BY(STAT_ChessActiveAnims, m_Anims.Pieces.Num());
+	UpdateAnim(m_Anims, FChessAnimUpdate{ deltaSeconds });
+	INC_DWORD_STAT_BY(STAT_ChessFinishedAnims, m_Anims.FinishedAnims.Num());
+
+	if (!m_Renderer)
+		return;
+
+	for (int32 i = 0; i < m_Anims.Pieces.Num(); ++i)
+	{
+		SetPieceInstancePosition(GetPieceSlot(m_Anims.Pieces[i]), m_Anims.Positions[i]);
+	}
+
+	for (const FChessAnimInstance& anim : m_Anims.FinishedAnims)
+	{
+		// Stopped anims may have been replaced by a newer one for the same piece
+		const int32 slot = GetPieceSlot(anim.PieceIdx);
+		if (m_PieceAnims[slot] != anim.Id)
+			continue;
+
+		m_PieceAnims[slot] = ANIM_HANDLE_NONE;
+		SetPieceInstancePosition(slot, m_Pieces.Positions[slot]);
+	}
+
+	WriteDirtyPieces(*m_Renderer);
+}
+
+void AChessGame::StartKnockoff(UShapeComponent* body, FVector2D direction)
+{
+	if (!body)
+		return;
+
+	TriggerKnockoff(body, direction, KnockoffImpulse, KnockoffDither);
+
+	// A body knocked again restarts its timer
+	m_Knockoffs.RemoveAllSwap([body](const FChessKnockoff& knockoff) { return knockoff.Body.Get() == body; }, EAllowShrinking::No);
+	m_Knockoffs.Add(FChessKnockoff{ body, 0.0f });
+
+	UpdateTickState();
+}
+
+void AChessGame::TickKnockoffs(float deltaSeconds)
+{
+	for (int32 i = m_Knockoffs.Num() - 1; i >= 0; --i)
+	{
+		FChessKnockoff& knockoff = m_Knockoffs[i];
+		knockoff.ElapsedSeconds += deltaSeconds;
+
+		UShapeComponent* body = knockoff.Body.Get();
+		if (body && knockoff.ElapsedSeconds < KnockoffSeconds && body->IsAnyRigidBodyAwake())
+			continue;
+
+		const int32 poolIdx = knockoff.PoolIdx;
+		m_Knockoffs.RemoveAtSwap(i, EAllowShrinking::No);
+
+		if (poolIdx != INDEX_NONE)
+			ReturnKnockoffBody(poolIdx);
+		else
+			FinishKnockoff(body);
+	}
+}
+
+void AChessGame::CapturePiece(int32 slot, bool knockoff)
+{
+	const EChessSide::Type side = m_PieceSides[slot];
+	const int32 graveSlot = FMath::CountTrailingZeros(~m_GraveyardUsed[side]);
+	m_GraveyardUsed[side] |= 1u << graveSlot;
+	m_GraveyardSlots[slot] = graveSlot;
+	m_CapturedPieces |= 1ull << slot;
+
+	if (m_PieceAnims[slot] != ANIM_HANDLE_NONE)
+	{
+		StopAnim(m_Anims, m_PieceAnims[slot]);
+		m_PieceAnims[slot] = ANIM_HANDLE_NONE;
+	}
+
+	m_Pieces.Positions[slot] = GetGraveyardPosition(side, graveSlot);
+	m_Pieces.Heights[slot] = 0.0f;
+
+	const int32 instanceIdx = m_Pieces.InstanceIndices[slot];
+	if (!knockoff || !m_Renderer || instanceIdx == INDEX_NONE)
+		return;
+
+	FTransform& transform = m_Pieces.InstanceTransforms[instanceIdx];
+	const FVector2D from(transform.GetTranslation());
+
+	const int32 poolIdx = bKnockoffCaptures ? m_Renderer->AcquireKnockoffBody() : INDEX_NONE;
+	if (poolIdx == INDEX_NONE)
+	{
+		// Every body is in flight, the piece slides over instead
+		if (MoveAnimSeconds > 0.0f)
+		{
+			StartPieceAnim(slot, from);
+		}
+		else
+		{
+			SetPieceInstancePosition(slot, m_Pieces.Positions[slot]);
+			WriteDirtyPieces(*m_Renderer);
+		}
+		return;
+	}
+
+	m_KnockoffMarkers.Add(FPieceRigidBodyMarker{ slot, poolIdx });
+
+	UBoxComponent* body = m_Renderer->GetKnockoffBody(poolIdx);
+	UStaticMeshComponent* mesh = m_Renderer->GetKnockoffMesh(poolIdx);
+	UStaticMesh* pieceMesh = PieceMeshes[m_Pieces.PieceTypes[slot]];
+	const FBox bounds = pieceMesh ? pieceMesh->GetBoundingBox() : FBox(FVector(-1.0), FVector(1.0));
+
+	// The body takes over exactly where the instance was drawn, its box is centered on the mesh bounds
+	const FTransform worldTransform = transform * m_BoardFrame.BoardToWorld;
+	mesh->SetStaticMesh(pieceMesh);
+	mesh->SetRelativeLocation(-bounds.GetCenter());
+	mesh->SetVisibility(true);
+	body->SetBoxExtent(bounds.GetExtent(), false);
+	body->SetWorldTransform(FTransform(worldTransform.GetRotation(), worldTransform.TransformPosition(bounds.GetCenter()), worldTransform.GetScale3D()));
+
+	transform.SetScale3D(FVector::ZeroVector);
+	SetPieceInstancePosition(slot, from);
+	WriteDirtyPieces(*m_Renderer);
+
+	// Knocked towards the graveyard it will end up in
+	const FVector direction = m_BoardFrame.BoardToWorld.TransformVectorNoScale(FVector(m_Pieces.Positions[slot] - from, 0.0)).GetSafeNormal2D();
+	TriggerKnockoff(body, FVector2D(direction), KnockoffImpulse, KnockoffDither);
+
+	m_Knockoffs.Add(FChessKnockoff{ body, 0.0f, poolIdx });
+	UpdateTickState();
+}
+
+void AChessGame::RevivePiece(int32 slot)
+{
+	const int32 poolIdx = FindKnockoffBody(slot);
+	if (poolIdx != INDEX_NONE)
+	{
+		m_Knockoffs.RemoveAllSwap([poolIdx](const FChessKnockoff& knockoff) { return knockoff.PoolIdx == poolIdx; }, EAllowShrinking::No);
+		ReturnKnockoffBody(poolIdx);
+	}
+
+	m_GraveyardUsed[m_PieceSides[slot]] &= ~(1u << m_GraveyardSlots[slot]);
+	m_GraveyardSlots[slot] = INDEX_NONE;
+	m_CapturedPieces &= ~(1ull << slot);
+}
+
+void AChessGame::ReturnKnockoffBody(int32 poolIdx)
+{
+	const int32 markerIdx = m_KnockoffMarkers.IndexOfByPredicate([poolIdx](const FPieceRigidBodyMarker& marker) { return marker.PoolIdx == poolIdx; });
+	if (markerIdx == INDEX_NONE)
+		return;
+
+	const int32 slot = m_KnockoffMarkers[markerIdx].PieceActorIdx;
+	m_KnockoffMarkers.RemoveAtSwap(markerIdx, EAllowShrinking::No);
+	m_Renderer->ReleaseKnockoffBody(poolIdx);
+
+	// The instance shows up again in the graveyard slot of the piece
+	const int32 instanceIdx = m_Pieces.InstanceIndices[slot];
+	if (instanceIdx == INDEX_NONE)
+		return;
+
+	m_Pieces.InstanceTransforms[instanceIdx].SetScale3D(FVector::OneVector);
+	SetPieceInstancePosition(slot, m_Pieces.Positions[slot]);
+	WriteDirtyPieces(*m_Renderer);
+}
+
+void AChessGame::ReturnKnockoffBodies()
+{
+	m_Knockoffs.RemoveAllSwap([](const FChessKnockoff& knockoff) { return knockoff.PoolIdx != INDEX_NONE; }, EAllowShrinking::No);
+	while (m_KnockoffMarkers.Num() > 0)
+	{
+		ReturnKnockoffBody(m_KnockoffMarkers.Last().PoolIdx);
+	}
+}
+
+int32 AChessGame::FindKnockoffBody(int32 slot) const
+{
+	const FPieceRigidBodyMarker* marker = m_KnockoffMarkers.FindByPredicate([slot](const FPieceRigidBodyMarker& carried) { return carried.PieceActorIdx == slot; });
+	return marker ? marker->PoolIdx : INDEX_NONE;
+}
+
+FVector2D AChessGame::GetGraveyardPosition(EChessSide::Type side, int32 graveSlot) const
+{
+	// Rows of eight along the ranks, one tile off the outer file on each player's side
+	const int32 row = graveSlot / Chess::BOARD_SIZE;
+	const int32 tileX = side == EChessSide::White ? -2 - row : Chess::BOARD_SIZE + 1 + row;
+	return m_BoardFrame.GetLocalTileCenter(tileX, graveSlot % Chess::BOARD_SIZE);
+}
+
+int32 AChessGame::EnqueueInstruction(const Chess::FBoardInstruction& instruction)
+{
+	m_QueuedInstructions.Add(instruction);
+	UpdateTickState();
+
+	return m_NextTicket++;
+}
+
+int32 AChessGame::EnqueueMove(int32 fromX, int32 fromY, int32 toX, int32 toY)
+{
+	return EnqueueInstruction(MakeMoveInstruction(fromX, fromY, toX, toY));
+}
+
+int32 AChessGame::EnqueueKill(int32 x, int32 y)
+{
+	return EnqueueInstruction(MakeKillInstruction(x, y));
+}
+
+int32 AChessGame::FlushInstructions()
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessFlushInstructions);
+
+	if (m_QueuedInstructions.Num() == 0)
+		return 0;
+
+	m_FlushFirstTicket = m_NextTicket - m_QueuedInstructions.Num();
+	m_FlushResults.Reset();
+
+	// The bitboard is kept in step, so every instruction is validated against the position left by the previous one
+	uint64 touchedTiles = 0;
+	int32 numApplied = 0;
+	for (const Chess::FBoardInstruction& instruction : m_QueuedInstructions)
+	{
+		EChessInstructionResult::Type result = EChessInstructionResult::Illegal;
+		if (!bValidateQueuedMoves || IsLegalInstruction(instruction))
+			result = ApplyInstruction(instruction, touchedTiles) ? EChessInstructionResult::Applied : EChessInstructionResult::Rejected;
+
+		numApplied += result == EChessInstructionResult::Applied ? 1 : 0;
+		m_FlushResults.Add(result);
+	}
+
+	m_QueuedInstructions.Reset();
+	INC_DWORD_STAT_BY(STAT_ChessInstructionsApplied, numApplied);
+
+	if (numApplied > 0)
+		OnInstructionsApplied(touchedTiles);
+
+	return numApplied;
+}
+
+TEnumAsByte<EChessInstructionResult::Type> AChessGame::GetInstructionResult(int32 ticket) const
+{
+	if (ticket >= m_NextTicket - m_QueuedInstructions.Num() && ticket < m_NextTicket)
+		return EChessInstructionResult::Pending;
+
+	const int32 resultIdx = ticket - m_FlushFirstTicket;
+	if (m_FlushResults.IsValidIndex(resultIdx))
+		return m_FlushResults[resultIdx];
+
+	return EChessInstructionResult::Unknown;
+}
+
+bool AChessGame::IsLegalInstruction(const Chess::FBoardInstruction& instruction) const
+{
+	// Only moves are checked, other instructions are up to the rules engine
+	const Chess::FMoveTileCmd* moveCmd = instruction.TryGet<Chess::FMoveTileCmd>();
+	if (!moveCmd)
+		return true;
+
+	if (moveCmd->From.X < 0 || moveCmd->From.X >= Chess::BOARD_SIZE || moveCmd->From.Y < 0 || moveCmd->From.Y >= Chess::BOARD_SIZE
+		|| moveCmd->To.X < 0 || moveCmd->To.X >= Chess::BOARD_SIZE || moveCmd->To.Y < 0 || moveCmd->To.Y >= Chess::BOARD_SIZE)
+	{
+		return false;
+	}
+
+	const int32 from = MakeSquare(moveCmd->From.X, moveCmd->From.Y);
+	const int32 to = MakeSquare(moveCmd->To.X, moveCmd->To.Y);
+
+	FChessMoveList moves;
+	GenerateLegalMoves(m_Position, moves);
+	return moves.ContainsByPredicate([from, to](const FChessMove& move) { return move.From == from && move.To == to; });
+}
+
+bool AChessGame::ApplyInstruction(const Chess::FBoardInstruction& instruction, uint64& inOutTouchedTiles)
+{
+	const FChessInstructionRecord record = MakeInstructionRecord(instruction, m_Position);
+
+	const int32 historyNum = m_Game.GetHistory().Num();
+	if (m_TrimmedHistory + m_InstructionRecords.Num() != historyNum)
+	{
+		// Records are out of step with the history, nothing before this point can be undone
+		m_InstructionRecords.Reset();
+		m_TrimmedHistory = historyNum;
+	}
+
+	if (!PlayInstruction(m_Game, m_PieceSides, instruction, m_Position, inOutTouchedTiles))
+		return false;
+
+	m_InstructionRecords.Add(record);
+	return true;
+}
+
+bool AChessGame::PlayInstruction(ChessGame& game, const EChessSide::Type* pieceSides, const Chess::FBoardInstruction& instruction, FChessBitboardPosition& inOutPosition, uint64& inOutTouchedTiles)
+{
+	const bool isOpaque = MakeInstructionRecord(instruction, inOutPosition).GetKind() == EChessRecordKind::Opaque;
+
+	// The moving piece has to be read before the board changes
+	const Chess::FMoveTileCmd* moveCmd = instruction.TryGet<Chess::FMoveTileCmd>();
+	const int32 from = moveCmd ? MakeSquare(moveCmd->From.X, moveCmd->From.Y) : INDEX_NONE;
+	const int32 to = moveCmd ? MakeSquare(moveCmd->To.X, moveCmd->To.Y) : INDEX_NONE;
+	const bool isPieceMove = moveCmd && from >= 0 && from < BITBOARD_SQUARES && to >= 0 && to < BITBOARD_SQUARES && !inOutPosition.IsEmpty(from);
+	const EChessSide::Type movedSide = isPieceMove ? inOutPosition.GetSide(from) : EChessSide::White;
+	const EBitboardPiece::Type movedPiece = isPieceMove ? inOutPosition.GetPiece(from) : EBitboardPiece::None;
+	const bool isCapture = isPieceMove && (!inOutPosition.IsEmpty(to) || (movedPiece == EBitboardPiece::Pawn && to == inOutPosition.State.EnPassantSquare));
+
+	const int32 historyNum = game.GetHistory().Num();
+	game.EvaluateInstruction(Chess::FBoardInstruction(instruction));
+	if (game.GetHistory().Num() <= historyNum)
+		return false;
+
+	FChessTileList tiles;
+	if (!isOpaque && GetInstructionTiles(instruction, tiles))
+	{
+		SyncPosition(game, pieceSides, tiles, inOutPosition);
+		for (const FIntPoint& tile : tiles)
+		{
+			inOutTouchedTiles |= SquareBit(MakeSquare(tile.X, tile.Y));
+		}
+	}
+	else
+	{
+		RebuildPosition(game, pieceSides, inOutPosition);
+		inOutTouchedTiles = ALL_TILES;
+	}
+
+	if (isPieceMove)
+	{
+		ApplyMoveState(inOutPosition, from, to, movedSide, movedPiece, isCapture);
+	}
+
+	return true;
+}
+
+bool AChessGame::RevertInstruction(uint64& inOutTouchedTiles)
+{
+	// Instructions older than the records were trimmed and can't be undone
+	const int32 historyNum = m_Game.GetHistory().Num();
+	if (m_InstructionRecords.Num() == 0 || m_TrimmedHistory + m_InstructionRecords.Num() != historyNum)
+		return false;
+
+	m_Game.UndoInstruction();
+	if (m_Game.GetHistory().Num() >= historyNum)
+		return false;
+
+	const FChessInstructionRecord record = m_InstructionRecords.Pop(EAllowShrinking::No);
+	const TOptional<Chess::FBoardInstruction> instruction = DecodeInstruction(record.Instruction);
+
+	FChessTileList tiles;
+	if (instruction.IsSet() && GetInstructionTiles(instruction.GetValue(), tiles))
+	{
+		SyncPosition(m_Game, m_PieceSides, tiles, m_Position);
+		for (const FIntPoint& tile : tiles)
+		{
+			inOutTouchedTiles |= SquareBit(MakeSquare(tile.X, tile.Y));
+		}
+	}
+	else
+	{
+		RebuildPosition(m_Game, m_PieceSides, m_Position);
+		inOutTouchedTiles = ALL_TILES;
+	}
+
+	SetPositionState(m_Position, GetRecordState(record, m_Position.State));
+
+	// Nothing undone past an opaque instruction can be replayed
+	if (instruction.IsSet())
+		m_RedoInstructions.Add(record.Instruction);
+	else
+		m_RedoInstructions.Reset();
+
+	return true;
+}
+
+void AChessGame::RefreshTiles(uint64 touchedTiles)
+{
+	UpdateUndoDepthStat(m_InstructionRecords.Num());
+
+	if (touchedTiles == ALL_TILES)
+	{
+		UpdatePiecesPositions(m_Renderer);
+		return;
+	}
+
+	TArray<FIntPoint, TInlineAllocator<BITBOARD_SQUARES>> tiles;
+	while (touchedTiles)
+	{
+		const int32 square = PopSquare(touchedTiles);
+		tiles.Add(FIntPoint(GetSquareX(square), GetSquareY(square)));
+	}
+
+	UpdatePiecesPositions(m_Renderer, tiles);
+}
+
+void AChessGame::OnInstructionsApplied(uint64 touchedTiles)
+{
+	// A new instruction branches off whatever was undone
+	m_RedoInstructions.Reset();
+
+	RefreshTiles(touchedTiles);
+	VerifyPosition();
+	CancelAIMove();
+
+	if (bAIAutoMove && m_AIController && m_Position.State.SideToMove == EChessSide::Black)
+		RequestAIMove();
+}
+
+void AChessGame::GetReversibleKeys(TArray<uint64>& outKeys) const
+{
+	outKeys.Reset();
+
+	// Since the last capture or pawn move every move is a plain piece move (or a castle), undone by moving the piece back.
+	// Kills and opaque instructions can't be walked back, nothing before them can repeat either.
+	FChessBitboardPosition position = m_Position;
+	const int32 oldest = FMath::Max(0, m_InstructionRecords.Num() - m_Position.State.HalfmoveClock);
+	for (int32 i = m_InstructionRecords.Num() - 1; i >= oldest; --i)
+	{
+		const FChessInstructionRecord& record = m_InstructionRecords[i];
+		const int32 from = record.GetFrom();
+		const int32 to = record.GetTo();
+		if (record.GetKind() != EChessRecordKind::Move || position.IsEmpty(to) || !position.IsEmpty(from))
+			break;
+
+		const EChessSide::Type side = position.GetSide(to);
+		const EBitboardPiece::Type piece = position.GetPiece(to);
+		position.RemovePiece(to);
+		position.AddPiece(from, side, piece);
+
+		if (piece == EBitboardPiece::King && FMath::Abs(to - from) == 2)
+		{
+			const int32 rookFrom = to > from ? from + 3 : from - 4;
+			const int32 rookTo = to > from ? from + 1 : from - 1;
+			if (!position.IsEmpty(rookTo) && position.IsEmpty(rookFrom))
+			{
+				position.RemovePiece(rookTo);
+				position.AddPiece(rookFrom, side, EBitboardPiece::Rook);
+			}
+		}
+
+		SetPositionState(position, GetRecordState(record, position.State));
+		outKeys.Add(position.Key);
+	}
+
+	Algo::Reverse(outKeys);
+}
+
+void AChessGame::SetupPosition()
+{
+	SetupGamePosition(m_Game, m_PieceSides, m_Position);
+	m_StartPosition = m_Position;
+
+	VerifyPosition();
+}
+
+void AChessGame::SetupGamePosition(const ChessGame& game, EChessSide::Type* outPieceSides, FChessBitboardPosition& outPosition)
+{
+	// Factions aren't tracked per piece, every piece starts on its own half of the board
+	const Chess::Board& board = game.GetBoard();
+	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+	{
+		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+		{
+			Chess::PieceIdx idx = board.At(x, y);
+			if (idx == Chess::PIECE_IDX_NONE)
+				continue;
+
+			outPieceSides[GetPieceSlot(idx)] = y < Chess::BOARD_SIZE / 2 ? EChessSide::White : EChessSide::Black;
+		}
+	}
+
+	SetPositionState(outPosition, FChessPositionState());
+	RebuildPosition(game, outPieceSides, outPosition);
+
+	// Castling is available wherever king and rook still stand on their home squares
+	auto isPiece = [&outPosition](int32 x, int32 y, EChessSide::Type side, EBitboardPiece::Type piece)
+	{
+		const int32 square = MakeSquare(x, y);
+		return outPosition.GetPiece(square) == piece && outPosition.GetSide(square) == side;
+	};
+
+	uint8 castlingRights = ECastlingRights::None;
+	if (isPiece(4, 0, EChessSide::White, EBitboardPiece::King))
+	{
+		castlingRights |= isPiece(7, 0, EChessSide::White, EBitboardPiece::Rook) ? ECastlingRights::WhiteKingSide : 0;
+		castlingRights |= isPiece(0, 0, EChessSide::White, EBitboardPiece::Rook) ? ECastlingRights::WhiteQueenSide : 0;
+	}
+	if (isPiece(4, 7, EChessSide::Black, EBitboardPiece::King))
+	{
+		castlingRights |= isPiece(7, 7, EChessSide::Black, EBitboardPiece::Rook) ? ECastlingRights::BlackKingSide : 0;
+		castlingRights |= isPiece(0, 7, EChessSide::Black, EBitboardPiece::Rook) ? ECastlingRights::BlackQueenSide : 0;
+	}
+	FChessPositionState state = outPosition.State;
+	state.CastlingRights = castlingRights;
+	SetPositionState(outPosition, state);
+}
+
+void AChessGame::RebuildPosition(const ChessGame& game, const EChessSide::Type* pieceSides, FChessBitboardPosition& inOutPosition)
+{
+	static_assert(Chess::BOARD_SIZE == 8, "Bitboards assume an 8x8 board");
+
+	const FChessPositionState state = inOutPosition.State;
+	inOutPosition.Clear();
+	SetPositionState(inOutPosition, state);
+
+	const Chess::Board& board = game.GetBoard();
+	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+	{
+		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+		{
+			Chess::PieceIdx idx = board.At(x, y);
+			if (idx == Chess::PIECE_IDX_NONE)
+				continue;
+
+			const EBitboardPiece::Type piece = GetBitboardPiece(Into<EChessPieceType::Type>(game.GetPieceType(idx)));
+			inOutPosition.AddPiece(MakeSquare(x, y), pieceSides[GetPieceSlot(idx)], piece);
+		}
+	}
+}
+
+void AChessGame::SyncPosition(const ChessGame& game, const EChessSide::Type* pieceSides, TArrayView<const FIntPoint> tiles, FChessBitboardPosition& inOutPosition)
+{
+	const Chess::Board& board = game.GetBoard();
+	for (const FIntPoint& tile : tiles)
+	{
+		const int32 square = MakeSquare(tile.X, tile.Y);
+		inOutPosition.RemovePiece(square);
+
+		const Chess::PieceIdx idx = board.At(tile.X, tile.Y);
+		if (idx == Chess::PIECE_IDX_NONE)
+			continue;
+
+		const EBitboardPiece::Type piece = GetBitboardPiece(Into<EChessPieceType::Type>(game.GetPieceType(idx)));
+		inOutPosition.AddPiece(square, pieceSides[GetPieceSlot(idx)], piece);
+	}
+}
+
+void AChessGame::VerifyPosition() const
+{
+	const int32 verifyMode = CVarChessPositionVerify.GetValueOnGameThread();
+	if (verifyMode <= 0)
+		return;
+
+	const uint64 fullKey = ComputePositionKey(m_Position);
+	ensureMsgf(m_Position.Key == fullKey, TEXT("Incremental position key %016llx differs from the recomputed %016llx"), m_Position.Key, fullKey);
+
+	if (verifyMode < 2)
+		return;
+
+	const Chess::Board& board = m_Game.GetBoard();
+	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+	{
+		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+		{
+			const Chess::PieceIdx idx = board.At(x, y);
+			const int32 square = MakeSquare(x, y);
+			const EBitboardPiece::Type expectedPiece = idx == Chess::PIECE_IDX_NONE ? EBitboardPiece::None : GetBitboardPiece(Into<EChessPieceType::Type>(m_Game.GetPieceType(idx)));
+			const bool matches = m_Position.GetPiece(square) == expectedPiece
+				&& (idx == Chess::PIECE_IDX_NONE || m_Position.GetSide(square) == m_PieceSides[GetPieceSlot(idx)]);
+			ensureMsgf(matches, TEXT("Bitboard position out of sync with the game board at tile %d,%d"), x, y);
+		}
+	}
+}
+
+int32 AChessGame::GetRepetitionCount() const
+{
+	// Only positions with the same side to move can match, every other key
+	TArray<uint64> keys;
+	GetReversibleKeys(keys);
+
+	int32 count = 0;
+	for (int32 i = keys.Num() - 2; i >= 0; i -= 2)
+	{
+		if (keys[i] == m_Position.Key)
+			++count;
+	}
+	return count;
+}
+
+void AChessGame::GetLegalMoves(FChessMoveList& outMoves) const
+{
+	GenerateLegalMoves(m_Position, outMoves);
+}
+
+TArray<FIntPoint> AChessGame::GetLegalMoveTargets(int32 tileX, int32 tileY) const
+{
+	TArray<FIntPoint> targets;
+	if (tileX < 0 || tileX >= Chess::BOARD_SIZE || tileY < 0 || tileY >= Chess::BOARD_SIZE)
+		return targets;
+
+	const int32 from = MakeSquare(tileX, tileY);
+	if (m_Position.IsEmpty(from) || m_Position.GetSide(from) != m_Position.State.SideToMove)
+		return targets;
+
+	FChessMoveList moves;
+	GenerateLegalMoves(m_Position, moves);
+	for (const FChessMove& move : moves)
+	{
+		if (move.From == from)
+			targets.AddUnique(FIntPoint(GetSquareX(move.To), GetSquareY(move.To)));
+	}
+
+	return targets;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// AI
+bool AChessGame::LoadPGN(const FString& pgn, int32 gameIndex)
+{
+	FChessPGNReader reader;
+	reader.OpenText(pgn);
+	return LoadPGNGame(reader, gameIndex);
+}
+
+bool AChessGame::LoadPGNFile(const FString& path, int32 gameIndex)
+{
+	FChessPGNReader reader;
+	if (!reader.OpenFile(*path))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Could not open PGN file %s"), *path);
+		return false;
+	}
+
+	return LoadPGNGame(reader, gameIndex);
+}
+
+bool AChessGame::LoadPGNGame(FChessPGNReader& reader, int32 gameIndex)
+{
+	for (int32 skipped = 0; skipped < gameIndex; ++skipped)
+	{
+		if (!reader.SkipGame())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("PGN holds %d games, game %d can't be loaded"), skipped, gameIndex);
+			return false;
+		}
+	}
+
+	FChessPGNGame game;
+	reader.SetKeepTags(false);
+	if (!reader.ReadGame(game))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("PGN holds %d games, game %d can't be loaded"), gameIndex, gameIndex);
+		return false;
+	}
+
+	if (game.HasCustomStart)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("PGN game %d starts from a FEN position, the rules engine only plays from the standard setup"), gameIndex);
+		return false;
+	}
+
+	ResetGame(m_PlayerController, m_AIController);
+
+	uint64 touchedTiles = ALL_TILES;
+	int32 numApplied = 0;
+	for (const FChessMove& move : game.Moves)
+	{
+		if (!ApplyInstruction(MakeMoveInstruction(move), touchedTiles))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("PGN game %d: the rules engine refused ply %d"), gameIndex, numApplied + 1);
+			break;
+		}
+		++numApplied;
+	}
+
+	OnInstructionsApplied(touchedTiles);
+
+	if (!game.Error.IsEmpty())
+		UE_LOG(LogTemp, Warning, TEXT("PGN game %d: %s"), gameIndex, *game.Error);
+
+	return numApplied == game.Moves.Num() && game.Error.IsEmpty();
+}
+
+FString AChessGame::GetPGN() const
+{
+	if (m_TrimmedHistory > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("The game history holds instructions without records, the game can't be exported"));
+		return FString();
+	}
+
+	FChessBitboardPosition position = m_StartPosition;
+	TArray<FChessMove> moves;
+	moves.Reserve(m_InstructionRecords.Num());
+
+	FChessMoveList legalMoves;
+	for (const FChessInstructionRecord& record : m_InstructionRecords)
+	{
+		const TOptional<Chess::FBoardInstruction> instruction = DecodeInstruction(record.Instruction);
+		const Chess::FMoveTileCmd* moveCmd = instruction.IsSet() ? instruction.GetValue().TryGet<Chess::FMoveTileCmd>() : nullptr;
+		if (!moveCmd)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("The history holds instructions that aren't moves, the game can't be exported"));
+			return FString();
+		}
+
+		// Records don't keep the promotion piece, the rules engine promotes to a queen
+		const int32 from = MakeSquare(moveCmd->From.X, moveCmd->From.Y);
+		const int32 to = MakeSquare(moveCmd->To.X, moveCmd->To.Y);
+		GenerateLegalMoves(position, legalMoves);
+		const FChessMove* move = legalMoves.FindByPredicate([from, to](const FChessMove& legalMove)
+		{
+			return legalMove.From == from && legalMove.To == to && (legalMove.Promotion == EBitboardPiece::None || legalMove.Promotion == EBitboardPiece::Queen);
+		});
+
+		if (!move)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Recorded move %d isn't legal, the game can't be exported"), moves.Num() + 1);
+			return FString();
+		}
+
+		moves.Add(*move);
+		MakeMove(position, *move);
+	}
+
+	FString result = TEXT("*");
+	GenerateLegalMoves(position, legalMoves);
+	if (legalMoves.Num() == 0)
+		result = !IsInCheck(position) ? TEXT("1/2-1/2") : position.State.SideToMove == EChessSide::White ? TEXT("0-1") : TEXT("1-0");
+
+	const TPair<FString, FString> tags[] =
+	{
+		{ TEXT("Event"), TEXT("Chess3D") },
+		{ TEXT("Site"), TEXT("?") },
+		{ TEXT("Date"), FDateTime::Now().ToString(TEXT("%Y.%m.%d")) },
+		{ TEXT("Round"), TEXT("-") },
+		{ TEXT("White"), m_PlayerController ? m_PlayerController->GetName() : TEXT("?") },
+		{ TEXT("Black"), m_AIController ? m_AIController->GetName() : TEXT("?") },
+		{ TEXT("Result"), result },
+	};
+
+	return WritePGN(m_StartPosition, moves, tags, result);
+}
+
+bool AChessGame::SavePGNFile(const FString& path) const
+{
+	const FString pgn = GetPGN();
+	return !pgn.IsEmpty() && FFileHelper::SaveStringToFile(pgn, *path);
+}
+
+bool AChessGame::SaveSnapshot(FChessSnapshot& outSnapshot) const
+{
+	outSnapshot.Reset();
+
+	// Snapshots replay from the standard setup, every instruction since has to have its record
+	if (m_TrimmedHistory > 0 || m_InstructionRecords.Num() != m_Game.GetHistory().Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("The game history holds instructions without records, the game can't be saved"));
+		return false;
+	}
+
+	for (const FChessInstructionRecord& record : m_InstructionRecords)
+	{
+		if (record.GetKind() == EChessRecordKind::Opaque)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("The history holds instructions that can't be encoded, the game can't be saved"));
+			return false;
+		}
+
+		if (!outSnapshot.AddInstruction(record.Instruction))
+			return false;
+	}
+
+	outSnapshot.SetPosition(m_Position);
+	return true;
+}
+
+bool AChessGame::LoadSnapshot(const FChessSnapshot& snapshot)
+{
+	TArray<uint16> instructions;
+	if (!snapshot.DecodeHistory(instructions))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Snapshot history is corrupt"));
+		return false;
+	}
+
+	// Replayed on a scratch game first, the current game is only reset once the whole history is known to load
+	{
+		ChessGame scratchGame;
+		SetupGame(m_PlayerController, m_AIController, scratchGame);
+
+		EChessSide::Type scratchSides[MAX_BOARD_PIECES];
+		FChessBitboardPosition scratchPosition;
+		SetupGamePosition(scratchGame, scratchSides, scratchPosition);
+
+		uint64 scratchTiles = 0;
+		for (int32 i = 0; i < instructions.Num(); ++i)
+		{
+			const TOptional<Chess::FBoardInstruction> instruction = DecodeInstruction(instructions[i]);
+			if (!instruction.IsSet() || !PlayInstruction(scratchGame, scratchSides, instruction.GetValue(), scratchPosition, scratchTiles))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Snapshot: the rules engine refused instruction %d"), i + 1);
+				return false;
+			}
+		}
+
+		FChessSnapshot replayed;
+		replayed.SetPosition(scratchPosition);
+		if (FMemory::Memcmp(replayed.Header.Board, snapshot.Header.Board, sizeof(replayed.Header.Board)) != 0 || replayed.Header.Key != snapshot.Header.Key)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Snapshot position doesn't match its history"));
+			return false;
+		}
+	}
+
+	ResetGame(m_PlayerController, m_AIController);
+
+	// Setup already touched every tile, so the replay ends in one full refresh
+	uint64 touchedTiles = ALL_TILES;
+	for (uint16 encoded : instructions)
+	{
+		verify(ApplyInstruction(DecodeInstruction(encoded).GetValue(), touchedTiles));
+	}
+
+	OnInstructionsApplied(touchedTiles);
+	return true;
+}
+
+bool AChessGame::ApplySnapshotDiff(const FChessSnapshotDiff& diff)
+{
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessUndoRedo);
+
+	if (diff.FromKey != m_Position.Key)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Snapshot diff doesn't start from the current position"));
+		return false;
+	}
+
+	// Everything that can be checked up front is, the undone instructions also have to be replayable for a rollback
+	const int32 numRecords = m_InstructionRecords.Num();
+	if (diff.NumUndo > numRecords || m_TrimmedHistory + numRecords != m_Game.GetHistory().Num())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Snapshot diff undoes more instructions than the game can"));
+		return false;
+	}
+
+	for (int32 i = numRecords - diff.NumUndo; i < numRecords; ++i)
+	{
+		if (m_InstructionRecords[i].GetKind() == EChessRecordKind::Opaque)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Snapshot diff undoes instructions that can't be encoded"));
+			return false;
+		}
+	}
+
+	for (uint16 encoded : diff.Instructions)
+	{
+		if (!DecodeInstruction(encoded).IsSet())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Snapshot diff instructions are corrupt"));
+			return false;
+		}
+	}
+
+	const TArray<uint16> redoInstructions = m_RedoInstructions;
+	TArray<uint16, TInlineAllocator<16>> undoneInstructions; // Most recent first
+
+	uint64 touchedTiles = 0;
+	int32 numUndone = 0;
+	while (numUndone < diff.NumUndo)
+	{
+		const uint16 encoded = m_InstructionRecords.Last().Instruction;
+		if (!RevertInstruction(touchedTiles))
+			break;
+
+		undoneInstructions.Add(encoded);
+		++numUndone;
+	}
+
+	int32 numApplied = 0;
+	if (numUndone == diff.NumUndo)
+	{
+		while (numApplied < diff.Instructions.Num() && ApplyInstruction(DecodeInstruction(diff.Instructions[numApplied]).GetValue(), touchedTiles))
+		{
+			++numApplied;
+		}
+	}
+
+	if (numUndone != diff.NumUndo || numApplied != diff.Instructions.Num() || m_Position.Key != diff.ToKey)
+	{
+		// Back to the from position, redo list included
+		for (int32 i = 0; i < numApplied; ++i)
+		{
+			verify(RevertInstruction(touchedTiles));
+		}
+		for (int32 i = numUndone - 1; i >= 0; --i)
+		{
+			verify(ApplyInstruction(DecodeInstruction(undoneInstructions[i]).GetValue(), touchedTiles));
+		}
+		m_RedoInstructions = redoInstructions;
+
+		RefreshTiles(touchedTiles);
+		VerifyPosition();
+
+		UE_LOG(LogTemp, Warning, TEXT("Snapshot diff was refused after %d undone and %d played instructions, rolled back"), numUndone, numApplied);
+		return false;
+	}
+
+	if (numApplied > 0)
+	{
+		OnInstructionsApplied(touchedTiles);
+	}
+	else if (numUndone > 0)
+	{
+		CancelAIMove();
+		RefreshTiles(touchedTiles);
+		VerifyPosition();
+	}
+
+	return true;
+}
+
+bool AChessGame::SaveSnapshotFile(const FString& path) const
+{
+	FChessSnapshot snapshot;
+	if (!SaveSnapshot(snapshot))
+		return false;
+
+	TArray<uint8> bytes;
+	snapshot.WriteBytes(bytes);
+	return FFileHelper::SaveArrayToFile(bytes, *path);
+}
+
+bool AChessGame::LoadSnapshotFile(const FString& path)
+{
+	TArray<uint8> bytes;
+	if (!FFileHelper::LoadFileToArray(bytes, *path))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Couldn't read snapshot %s"), *path);
+		return false;
+	}
+
+	FChessSnapshot snapshot;
+	if (!snapshot.ReadBytes(bytes))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s isn't a snapshot of a supported version"), *path);
+		return false;
+	}
+
+	return LoadSnapshot(snapshot);
+}
+
+void AChessGame::RequestAIMove()
+{
+	if (m_AIThinking)
+		return;
+
+	FChessMoveList moves;
+	GenerateLegalMoves(m_Position, moves);
+	if (moves.Num() == 0)
+		return;
+
+	FChessMove instantMove;
+	if (ProbeAIBook(instantMove))
+	{
+		PostAIMove(instantMove);
+		return;
+	}
+
+	// A cancelled search may still be unwinding on its task, never share its state with a new one
+	const bool taskRunning = m_AITask.IsValid() && !m_AITask.IsCompleted();
+	if (!m_AIState.IsValid() || taskRunning || m_AIState->HashSizeMB != AIHashSizeMB || m_AIState->NumThreads != AIThreads)
+	{
+		m_AIState = MakeShared<FChessAIState>(AIHashSizeMB, AIThreads);
+	}
+
+	FChessSearchLimits limits;
+	limits.MaxSeconds = AIThinkSeconds;
+	limits.MaxNodes = static_cast<uint64>(FMath::Max(AIMaxNodes, 0));
+	// The rules engine always promotes to a queen, any other promotion would be played as a different move than the one scored
+	limits.NoRootUnderpromotions = true;
+
+	// The search only looks for repetitions since the last irreversible move
+	TArray<uint64> gameKeys;
+	GetReversibleKeys(gameKeys);
+
+	const uint32 requestId = ++m_AIRequestId;
+	m_AISearchKey = m_Position.Key;
+	m_AIThinking = true;
+
+	TWeakObjectPtr<AChessGame> weakThis(this);
+	m_AITask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [weakThis, state = m_AIState, tablebase = GetTablebase(), root = m_Position, limits, gameKeys = MoveTemp(gameKeys), requestId]()
+	{
+		// A tablebase hit replaces the search unless it underpromotes, table reads may hit the disk so they stay off the game thread too
+		FChessSearchResult result;
+		EChessWDL::Type wdl = EChessWDL::Draw;
+		int32 dtz = 0;
+		if (tablebase.IsValid() && tablebase->ProbeRoot(root, result.BestMove, wdl, dtz) && !result.BestMove.IsUnderpromotion())
+		{
+			UE_LOG(LogTemp, Verbose, TEXT("AI tablebase move wdl %d dtz %d"), static_cast<int32>(wdl), dtz);
+			result.HasMove = true;
+		}
+		else
+		{
+			result = state->Search.Search(root, limits, gameKeys);
+		}
+
+		AsyncTask(ENamedThreads::GameThread, [weakThis, requestId, result = MoveTemp(result)]()
+		{
+			if (AChessGame* chessGame = weakThis.Get())
+			{
+				chessGame->OnAIMoveFound(requestId, result);
+			}
+		});
+	});
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-// Debug Instructions
-void AChessGame::MoveInstruction(AChessGame* chessGame, int32 x1, int32 y1, int32 x2, int32 y2)
+void AChessGame::CancelAIMove()
 {
-	Chess::FMoveTileCmd moveCmd;
-	moveCmd.From.X = x1;
-	moveCmd.From.Y = y1;
-	moveCmd.To.X = x2;
-	moveCmd.To.Y = y2;
-	moveCmd.ResolutionHint = Chess::EMoveResolution::MOVE;
+	if (!m_AIThinking)
+		return;
 
-	chessGame->m_Game.EvaluateInstruction(Chess::FBoardInstruction(TInPlaceType<Chess::FMoveTileCmd>(), MoveTemp(moveCmd)));
+	++m_AIRequestId;
+	m_AIThinking = false;
 
-	chessGame->UpdatePiecesPositions(chessGame->m_Renderer);
+	if (m_AIState.IsValid())
+	{
+		m_AIState->Search.Stop();
+	}
 }
 
-void AChessGame::KillInstruction(AChessGame* chessGame, int32 x, int32 y)
+void AChessGame::OnAIMoveFound(uint32 requestId, const FChessSearchResult& result)
 {
-	Chess::FKillCmd killCmd;
-	killCmd.X = x;
-	killCmd.Y = y;
+	// The board may have changed under a search that was not cancelled explicitly
+	if (requestId != m_AIRequestId || !m_AIThinking)
+		return;
+
+	m_AIThinking = false;
+
+	if (!result.HasMove || m_Position.Key != m_AISearchKey)
+		return;
+
+	UE_LOG(LogTemp, Verbose, TEXT("AI move depth %d score %d nodes %llu in %.2fs"), result.Depth, result.Score, result.Nodes, result.Seconds);
+
+	if (!ensureMsgf(!result.BestMove.IsUnderpromotion(), TEXT("The AI picked an underpromotion, the rules engine can only queen")))
+		return;
+
+	EvaluateInstruction(MakeMoveInstruction(result.BestMove));
+}
+
+void AChessGame::PostAIMove(const FChessMove& move)
+{
+	// Played on the next game thread turn like a search result, so cancels and stale positions are handled the same way
+	FChessSearchResult result;
+	result.BestMove = move;
+	result.HasMove = true;
+
+	const uint32 requestId = ++m_AIRequestId;
+	m_AISearchKey = m_Position.Key;
+	m_AIThinking = true;
+
+	TWeakObjectPtr<AChessGame> weakThis(this);
+	AsyncTask(ENamedThreads::GameThread, [weakThis, requestId, result = MoveTemp(result)]()
+	{
+		if (AChessGame* chessGame = weakThis.Get())
+		{
+			chessGame->OnAIMoveFound(requestId, result);
+		}
+	});
+}
+
+TSharedPtr<FChessTablebase> AChessGame::GetTablebase()
+{
+	if (AITablebaseDirectory.IsEmpty())
+	{
+		m_Tablebase.Reset();
+		m_TablebaseDirectory.Reset();
+		m_TablebaseEvaluation = FTablebaseEvaluation();
+		return nullptr;
+	}
+
+	// Nothing is read here, the first probe lists the directory and maps the tables it needs
+	if (AITablebaseDirectory != m_TablebaseDirectory || AITablebaseCacheBlocks != m_TablebaseCacheBlocks)
+	{
+		m_TablebaseDirectory = AITablebaseDirectory;
+		m_TablebaseCacheBlocks = AITablebaseCacheBlocks;
+		m_Tablebase = MakeShared<FChessTablebase>(m_TablebaseDirectory, m_TablebaseCacheBlocks);
+		m_TablebaseEvaluation = FTablebaseEvaluation();
+	}
+
+	return m_Tablebase;
+}
+
+bool AChessGame::GetTablebaseEvaluation(int32& wdl, int32& dtz)
+{
+	wdl = 0;
+	dtz = 0;
+
+	TSharedPtr<FChessTablebase> tablebase = GetTablebase();
+	if (!tablebase.IsValid())
+		return false;
+
+	if (!m_TablebaseEvaluation.Requested || m_TablebaseEvaluation.Key != m_Position.Key)
+	{
+		m_TablebaseEvaluation = FTablebaseEvaluation();
+		m_TablebaseEvaluation.Key = m_Position.Key;
+		m_TablebaseEvaluation.Requested = true;
+
+		TWeakObjectPtr<AChessGame> weakThis(this);
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [weakThis, tablebase, position = m_Position]()
+		{
+			EChessWDL::Type result = EChessWDL::Draw;
+			int32 distance = 0;
+			const bool found = tablebase->ProbeWDL(position, result) && tablebase->ProbeDTZ(position, distance);
+
+			AsyncTask(ENamedThreads::GameThread, [weakThis, tablebase, key = position.Key, found, result, distance]()
+			{
+				// Dropped if the board or the tablebase changed while probing, the next call asks again
+				AChessGame* chessGame = weakThis.Get();
+				if (!chessGame || chessGame->m_Tablebase != tablebase || chessGame->m_TablebaseEvaluation.Key != key)
+					return;
+
+				chessGame->m_TablebaseEvaluation.Found = found;
+				chessGame->m_TablebaseEvaluation.WDL = result;
+				chessGame->m_TablebaseEvaluation.DTZ = distance;
+			});
+		});
+	}
+
+	if (!m_TablebaseEvaluation.Found)
+		return false;
+
+	wdl = m_TablebaseEvaluation.WDL;
+	dtz = m_TablebaseEvaluation.DTZ;
+	return true;
+}
+
+bool AChessGame::ProbeAIBook(FChessMove& outMove)
+{
+	if (AIBookPath.IsEmpty())
+	{
+		m_AIBook.Reset();
+		m_AIBookPath.Reset();
+		return false;
+	}
+
+	// A book that failed to open stays null until its path changes, so it's only reported once
+	if (AIBookPath != m_AIBookPath)
+	{
+		m_AIBookPath = AIBookPath;
+		m_AIBook = MakeShared<FChessOpeningBook>();
+		if (!m_AIBook->Open(*m_AIBookPath))
+			m_AIBook.Reset();
+	}
 
-	chessGame->m_Game.EvaluateInstruction(Chess::FBoardInstruction(TInPlaceType<Chess::FKillCmd>(), MoveTemp(killCmd)));
+	if (!m_AIBook.IsValid())
+		return false;
+
+	if (m_AIBookRandom == 0)
+		m_AIBookRandom = FPlatformTime::Cycles() | 1;
+
+	// Underpromotions can't be played, the search picks the move instead
+	const EChessBookSelection::Type selection = bAIBookBestMove ? EChessBookSelection::Best : EChessBookSelection::WeightedRandom;
+	return m_AIBook->Probe(m_Position, selection, m_AIBookRandom, outMove) && !outMove.IsUnderpromotion();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Debug Instructions
+void AChessGame::MoveInstruction(AChessGame* chessGame, int32 x1, int32 y1, int32 x2, int32 y2)
+{
+	chessGame->EvaluateInstruction(MakeMoveInstruction(x1, y1, x2, y2));
+}
 
-	chessGame->UpdatePiecesPositions(chessGame->m_Renderer);
+void AChessGame::KillInstruction(AChessGame* chessGame, int32 x, int32 y)
+{
+	chessGame->EvaluateInstruction(MakeKillInstruction(x, y));
 }
 
 int32 AChessGame::GetUndoCount(AChessGame* chessGame)
 {
 	if(chessGame)
-		return chessGame->m_Game.GetHistory().Num();
+		return chessGame->m_InstructionRecords.Num();
 
 	return 0;
 }
@@ -345,8 +2292,7 @@ void AChessGame::UndoInstruction(AChessGame* chessGame)
 {
 	if (chessGame)
 	{
-		chessGame->m_Game.UndoInstruction();
-		chessGame->UpdatePiecesPositions(chessGame->m_Renderer);
+		chessGame->UndoLastInstruction();
 	}
 }
 
@@ -354,9 +2300,8 @@ void AChessGame::UndoInstruction(AChessGame* chessGame)
 // Sets default values
 AChessExperience::AChessExperience()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
-
+	// Nothing to do per frame, boards tick themselves while they have work pending
+	PrimaryActorTick.bCanEverTick = false;
 }
 
 // Called when the game starts or when spawned
@@ -366,24 +2311,54 @@ void AChessExperience::BeginPlay()
 	
 }
 
-// Called every frame
-void AChessExperience::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-}
-
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 FVector GetDitheredVector(const FVector& dir, float dither)
 {
 	return (dir + (dither* FMath::VRand())).GetSafeNormal();
 }
 
-constexpr float GetEasedAlpha(float t)
+static TAutoConsoleVariable<int32> CVarChessAnimBatchMode(
+	TEXT("Chess.Anim.BatchMode"),
+	1,
+	TEXT("0: scalar anim evaluation, 1: vectorized, 2: vectorized and verified against scalar"));
+
+float GetEasedAlpha(EChessAnimEasing::Type easing, float t)
+{
+	switch (easing)
+	{
+	case EChessAnimEasing::Linear:
+		return t;
+	case EChessAnimEasing::CubicOut:
+		return ((t - 1) * (t - 1)) * (t - 1) + 1;
+	case EChessAnimEasing::SmoothStep:
+		return (t * t) * (3 - (2 * t));
+	case EChessAnimEasing::QuadOut:
+	default:
+		return GetEasedAlpha(t);
+	}
+}
+
+// Mirrors the scalar GetEasedAlpha operation for operation so both paths round identically
+static VectorRegister4Float GetEasedAlpha(EChessAnimEasing::Type easing, const VectorRegister4Float& t)
 {
-	return -((t - 1) * (t - 1)) + 1;
+	const VectorRegister4Float one = VectorSetFloat1(1.0f);
+	const VectorRegister4Float u = VectorSubtract(t, one);
+
+	switch (easing)
+	{
+	case EChessAnimEasing::Linear:
+		return t;
+	case EChessAnimEasing::CubicOut:
+		return VectorAdd(VectorMultiply(VectorMultiply(u, u), u), one);
+	case EChessAnimEasing::SmoothStep:
+		return VectorMultiply(VectorMultiply(t, t), VectorSubtract(VectorSetFloat1(3.0f), VectorMultiply(VectorSetFloat1(2.0f), t)));
+	case EChessAnimEasing::QuadOut:
+	default:
+		return VectorSubtract(one, VectorMultiply(u, u));
+	}
 }
 
-FVector2D CalculateAnim(float time, float animDuration, const FVector2D& initial, const FVector2D& target)
+FVector2D CalculateAnim(float time, float animDuration, const FVector2D& initial, const FVector2D& target, EChessAnimEasing::Type easing)
 {
 	if (animDuration <= 0.0f)
 	{
@@ -395,17 +2370,68 @@ FVector2D CalculateAnim(float time, float animDuration, const FVector2D& initial
 		return target;
 
 	float t = (time) / animDuration;
-	t = GetEasedAlpha(t);
+	t = GetEasedAlpha(easing, t);
 
 	FVector2D result = FMath::Lerp(initial, target, t);
 	
 	return result;
 }
 
+void CalculateAnimBatchScalar(EChessAnimEasing::Type easing, float animDuration, TArrayView<const float> elapsed, TArrayView<const FVector2D> initial, TArrayView<const FVector2D> target, TArrayView<FVector2D> outPositions)
+{
+	for (int32 i = 0; i < elapsed.Num(); ++i)
+	{
+		outPositions[i] = CalculateAnim(elapsed[i], animDuration, initial[i], target[i], easing);
+	}
+}
+
+void CalculateAnimBatch(EChessAnimEasing::Type easing, float animDuration, TArrayView<const float> elapsed, TArrayView<const FVector2D> initial, TArrayView<const FVector2D> target, TArrayView<FVector2D> outPositions)
+{
+	const int32 num = elapsed.Num();
+	check(initial.Num() == num && target.Num() == num && outPositions.Num() == num);
+
+	if (animDuration <= 0.0f)
+	{
+		CalculateAnimBatchScalar(easing, animDuration, elapsed, initial, target, outPositions);
+		return;
+	}
+
+	const VectorRegister4Float duration = VectorSetFloat1(animDuration);
+	const VectorRegister4Double durationDouble = VectorRegister4Double(duration);
+
+	int32 i = 0;
+	for (; i + 4 <= num; i += 4)
+	{
+		const VectorRegister4Float time = VectorLoad(&elapsed[i]);
+		const VectorRegister4Float alpha = GetEasedAlpha(easing, VectorDivide(time, duration));
+
+		// FVector2D is two doubles, so each double register holds two anims (X0, Y0, X1, Y1)
+		const VectorRegister4Float lanes[2][2] =
+		{
+			{ VectorSwizzle(alpha, 0, 0, 1, 1), VectorSwizzle(time, 0, 0, 1, 1) },
+			{ VectorSwizzle(alpha, 2, 2, 3, 3), VectorSwizzle(time, 2, 2, 3, 3) },
+		};
+
+		for (int32 half = 0; half < 2; ++half)
+		{
+			const int32 idx = i + half * 2;
+			const VectorRegister4Double from = VectorLoad(&initial[idx].X);
+			const VectorRegister4Double to = VectorLoad(&target[idx].X);
+			const VectorRegister4Double alphaDouble = VectorRegister4Double(lanes[half][0]);
+			const VectorRegister4Double finished = VectorCompareGT(VectorRegister4Double(lanes[half][1]), durationDouble);
+
+			const VectorRegister4Double lerped = VectorAdd(from, VectorMultiply(alphaDouble, VectorSubtract(to, from)));
+			VectorStore(VectorSelect(finished, to, lerped), &outPositions[idx].X);
+		}
+	}
+
+	CalculateAnimBatchScalar(easing, animDuration, elapsed.Slice(i, num - i), initial.Slice(i, num - i), target.Slice(i, num - i), outPositions.Slice(i, num - i));
+}
+
 FVector2D UpdateAnim(float dt, float animDuration, FPieceAnimInfo& animData, bool& finished)
 {
 	float time = animData.ElapsedSeconds + dt;
-	if (time >= animData.ElapsedSeconds)
+	if (time >= animDuration)
 		finished = true;
 
 	animData.ElapsedSeconds = time;
@@ -419,7 +2445,7 @@ void TriggerKnockoff(UShapeComponent* knockoffBody, const FVector2D& direction,
 		FVector ditheredImpulse = GetDitheredVector(FVector(direction, 0.0f), dither);
 		knockoffBody->SetSimulatePhysics(true);
 		knockoffBody->SetCollisionEnabled(ECollisionEnabled::PhysicsOnly);
-		knockoffBody->AddImpulse(ditheredImpulse);
+		knockoffBody->AddImpulse(ditheredImpulse * multiplier, NAME_None, true);
 	}
 }
 
@@ -432,75 +2458,381 @@ void FinishKnockoff(UShapeComponent* knockoffBody)
 	}
 }
 
-void UpdateAnimInstances(const FChessAnimUpdate& updateInfo, TArray<FChessAnimInstance>& active, TArray<FChessAnimInstance>& outFinished, TArray<FTransform>& outTransform)
+void UpdateAnimInstances(const FChessAnimUpdate& updateInfo, float animDuration, EChessAnimEasing::Type easing, TArrayView<const FVector2D> initial, TArrayView<const FVector2D> target, TArrayView<float> elapsed, TArrayView<FVector2D> outPositions, TArray<int32>& outFinished)
 {
-	constexpr float animSpeed = 2.0f;
-	outTransform.Reserve(active.Num());
-		
-	TBitArray finishedArr(false, active.Num());
-	for (int32 i = 0; i < active.Num(); ++i)
+	const int32 num = elapsed.Num();
+	check(initial.Num() == num && target.Num() == num && outPositions.Num() == num);
+
+	for (int32 i = 0; i < num; ++i)
+	{
+		const float time = elapsed[i] + updateInfo.DeltaTime;
+		elapsed[i] = time;
+
+		if (time >= animDuration)
+			outFinished.Add(i);
+	}
+
+	const int32 batchMode = CVarChessAnimBatchMode.GetValueOnGameThread();
+	if (batchMode == 0)
+	{
+		CalculateAnimBatchScalar(easing, animDuration, elapsed, initial, target, outPositions);
+		return;
+	}
+
+	CalculateAnimBatch(easing, animDuration, elapsed, initial, target, outPositions);
+
+	if (batchMode == 2)
 	{
-		bool finished = false;
-		UpdateAnim(updateInfo.DeltaTime, animSpeed, active[i].AnimInfo, finished);
-		finishedArr[i] = finished;
+		for (int32 i = 0; i < num; ++i)
+		{
+			const FVector2D expected = CalculateAnim(elapsed[i], animDuration, initial[i], target[i], easing);
+			ensureMsgf(expected == outPositions[i], TEXT("Vectorized anim %d diverged: %s vs %s"), i, *outPositions[i].ToString(), *expected.ToString());
+		}
 	}
+}
+
+static uint32 MakeAnimHandle(uint32 slot, uint32 generation)
+{
+	return (generation << ANIM_HANDLE_SLOT_BITS) | slot;
+}
+
+static int32 FindAnim(const FChessAnimContext& ctx, uint32 instance)
+{
+	const uint32 slot = instance & ANIM_HANDLE_SLOT_MASK;
+	if (!ctx.SlotToDense.IsValidIndex(slot) || ctx.SlotGenerations[slot] != (instance >> ANIM_HANDLE_SLOT_BITS))
+		return INDEX_NONE;
+
+	return ctx.SlotToDense[slot];
+}
+
+static FChessAnimInstance GetAnimInstance(const FChessAnimContext& ctx, int32 denseIdx)
+{
+	const uint32 slot = ctx.DenseToSlot[denseIdx];
+
+	FChessAnimInstance animInstance;
+	animInstance.Id = MakeAnimHandle(slot, ctx.SlotGenerations[slot]);
+	animInstance.PieceIdx = ctx.Pieces[denseIdx];
+	animInstance.AnimInfo.Initial = ctx.Initial[denseIdx];
+	animInstance.AnimInfo.Target = ctx.Target[denseIdx];
+	animInstance.AnimInfo.ElapsedSeconds = ctx.Elapsed[denseIdx];
+	return animInstance;
+}
 
-	outFinished.Reserve(finishedArr.CountSetBits());
+static void RemoveAnimAt(FChessAnimContext& ctx, int32 denseIdx)
+{
+	const uint32 slot = ctx.DenseToSlot[denseIdx];
+	const int32 lastIdx = ctx.Pieces.Num() - 1;
+
+	// The last anim is swapped into the removed spot
+	if (denseIdx != lastIdx)
+		ctx.SlotToDense[ctx.DenseToSlot[lastIdx]] = denseIdx;
+
+	ctx.Pieces.RemoveAtSwap(denseIdx, EAllowShrinking::No);
+	ctx.Initial.RemoveAtSwap(denseIdx, EAllowShrinking::No);
+	ctx.Target.RemoveAtSwap(denseIdx, EAllowShrinking::No);
+	ctx.Elapsed.RemoveAtSwap(denseIdx, EAllowShrinking::No);
+	ctx.Positions.RemoveAtSwap(denseIdx, EAllowShrinking::No);
+	ctx.DenseToSlot.RemoveAtSwap(denseIdx, EAllowShrinking::No);
+
+	// Bump the generation so outstanding handles to this slot go stale, zero is reserved for ANIM_HANDLE_NONE
+	uint32& generation = ctx.SlotGenerations[slot];
+	generation = (generation + 1) & (MAX_uint32 >> ANIM_HANDLE_SLOT_BITS);
+	if (generation == 0)
+		generation = 1;
+
+	ctx.SlotToDense[slot] = INDEX_NONE;
+	ctx.FreeSlots.Add(slot);
 }
 
 uint32 AddAnim(FChessAnimContext& ctx, Chess::PieceIdx piece, const FVector2D& from, const FVector2D& to)
 {
-	return uint32();
+	uint32 slot = 0;
+	if (ctx.FreeSlots.Num() > 0)
+	{
+		slot = ctx.FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		slot = ctx.SlotToDense.Num();
+		if (!ensureMsgf(slot <= ANIM_HANDLE_SLOT_MASK, TEXT("Too many active chess anims")))
+			return ANIM_HANDLE_NONE;
+
+		ctx.SlotToDense.Add(INDEX_NONE);
+		ctx.SlotGenerations.Add(1);
+	}
+
+	const int32 denseIdx = ctx.Pieces.Add(piece);
+	ctx.Initial.Add(from);
+	ctx.Target.Add(to);
+	ctx.Elapsed.Add(0.0f);
+	ctx.Positions.Add(from);
+	ctx.DenseToSlot.Add(slot);
+	ctx.SlotToDense[slot] = denseIdx;
+
+	return MakeAnimHandle(slot, ctx.SlotGenerations[slot]);
 }
 
 void StopAnim(FChessAnimContext& ctx, uint32 instance)
 {
+	const int32 denseIdx = FindAnim(ctx, instance);
+	if (denseIdx == INDEX_NONE)
+		return;
+
+	ctx.StoppedAnims.Add(GetAnimInstance(ctx, denseIdx));
+	RemoveAnimAt(ctx, denseIdx);
+}
+
+bool IsAnimActive(const FChessAnimContext& ctx, uint32 instance)
+{
+	return FindAnim(ctx, instance) != INDEX_NONE;
 }
 
 void UpdateAnim(FChessAnimContext& ctx, FChessAnimUpdate updateInfo)
 {
-	ctx.FinishedAnims.Empty(ctx.FinishedAnims.Num());
+	CHESS_SCOPE_CYCLE_COUNTER(STAT_ChessUpdateAnim);
+
+	ctx.FinishedAnims.Reset();
+	ctx.FinishedAnims.Append(ctx.StoppedAnims);
+	ctx.StoppedAnims.Reset();
+
+	ctx.FinishedIndices.Reset();
+	UpdateAnimInstances(updateInfo, ctx.AnimDurationSeconds, ctx.Easing, ctx.Initial, ctx.Target, ctx.Elapsed, ctx.Positions, ctx.FinishedIndices);
 
-	// Process stops
-	for (int32 i = 0; i < ctx.ActiveAnims.Num(); ++i)
+	// Remove back to front so the swapped in anims were already processed
+	for (int32 i = ctx.FinishedIndices.Num() - 1; i >= 0; --i)
 	{
-		FChessAnimInstance animInstance = ctx.ActiveAnims[i];
-		if (ctx.PendingStop.Contains(animInstance.Id))
-		{
-			ctx.ActiveAnims.RemoveAtSwap(i, EAllowShrinking::No);
-			ctx.FinishedAnims.Add(MoveTemp(animInstance));
-		}
+		const int32 denseIdx = ctx.FinishedIndices[i];
+		ctx.FinishedAnims.Add(GetAnimInstance(ctx, denseIdx));
+		RemoveAnimAt(ctx, denseIdx);
 	}
+}
 
-	ctx.ActiveAnims.Shrink();
-
-	// Calculate anims and get the resulting transforms
-	TArray<FTransform> transforms;
-	UpdateAnimInstances(updateInfo, ctx.ActiveAnims, ctx.FinishedAnims, transforms);
+void FChessDirtyPieces::Mark(TArrayView<const Chess::PieceIdx> pieces)
+{
+	for (Chess::PieceIdx idx : pieces)
+	{
+		Mark(idx);
+	}
 }
 
-TArray<int32> CollectUpdatingInstancedMeshes(TArrayView<FChessInstancedMesh> instancedMeshes, TArrayView<FChessAnimInstance> animInstances)
+void FChessInstancedMeshLookup::Reset()
 {
-	TSet<Chess::PieceIdx> updatingPieces;
-	for (const FChessAnimInstance& animInstance : animInstances)
+	for (int32& meshIdx : MeshIndices)
 	{
-		updatingPieces.Add(animInstance.PieceIdx);
+		meshIdx = INDEX_NONE;
 	}
+}
 
-	TArray<int32> indices;
-	indices.Reserve(updatingPieces.Num());
+void FChessInstancedMeshLookup::Build(TArrayView<const FChessInstancedMesh> instancedMeshes)
+{
+	Reset();
 	for (int32 i = 0; i < instancedMeshes.Num(); ++i)
 	{
-		if (updatingPieces.Contains(instancedMeshes[i].PieceIdx))
-			indices.Add(i);
+		int32& meshIdx = MeshIndices[GetPieceSlot(instancedMeshes[i].PieceIdx)];
+		ensureMsgf(meshIdx == INDEX_NONE, TEXT("Piece %d has more than one instanced mesh"), static_cast<int32>(instancedMeshes[i].PieceIdx));
+		meshIdx = i;
 	}
+}
 
-	verify(Algo::IsSorted(indices));
-
-	return indices;
+void CollectUpdatingInstancedMeshes(const FChessInstancedMeshLookup& lookup, FChessDirtyPieces& dirty, TArray<int32>& outIndices)
+{
+	outIndices.Reset();
+	while (!dirty.IsEmpty())
+	{
+		const int32 meshIdx = lookup.MeshIndices[dirty.PopSlot()];
+		if (meshIdx != INDEX_NONE)
+			outIndices.Add(meshIdx);
+	}
 }
 
 void GetPieceTypes(const ChessGame& game, TArrayView<Chess::PieceIdx> pieceIndices, TArray<EChessPieceType::Type>& outTypes)
 {
 	Algo::Transform(pieceIndices, outTypes, [&game](Chess::PieceIdx pieceIdx) { return Into<EChessPieceType::Type>(game.GetPieceType(pieceIdx)); });
 }
+
+Chess::FBoardInstruction MakeMoveInstruction(int32 fromX, int32 fromY, int32 toX, int32 toY)
+{
+	Chess::FMoveTileCmd moveCmd;
+	moveCmd.From.X = fromX;
+	moveCmd.From.Y = fromY;
+	moveCmd.To.X = toX;
+	moveCmd.To.Y = toY;
+	moveCmd.ResolutionHint = Chess::EMoveResolution::MOVE;
+
+	return Chess::FBoardInstruction(TInPlaceType<Chess::FMoveTileCmd>(), MoveTemp(moveCmd));
+}
+
+Chess::FBoardInstruction MakeMoveInstruction(const FChessMove& move)
+{
+	return MakeMoveInstruction(GetSquareX(move.From), GetSquareY(move.From), GetSquareX(move.To), GetSquareY(move.To));
+}
+
+Chess::FBoardInstruction MakeKillInstruction(int32 x, int32 y)
+{
+	Chess::FKillCmd killCmd;
+	killCmd.X = x;
+	killCmd.Y = y;
+
+	return Chess::FBoardInstruction(TInPlaceType<Chess::FKillCmd>(), MoveTemp(killCmd));
+}
+
+uint16 EncodeInstruction(const Chess::FBoardInstruction& instruction)
+{
+	auto isTile = [](int32 x, int32 y)
+	{
+		return x >= 0 && x < Chess::BOARD_SIZE && y >= 0 && y < Chess::BOARD_SIZE;
+	};
+
+	if (const Chess::FMoveTileCmd* moveCmd = instruction.TryGet<Chess::FMoveTileCmd>())
+	{
+		if (moveCmd->ResolutionHint == Chess::EMoveResolution::MOVE && isTile(moveCmd->From.X, moveCmd->From.Y) && isTile(moveCmd->To.X, moveCmd->To.Y))
+			return static_cast<uint16>(MakeSquare(moveCmd->From.X, moveCmd->From.Y) | (MakeSquare(moveCmd->To.X, moveCmd->To.Y) << 6) | (EChessRecordKind::Move << 12));
+	}
+	else if (const Chess::FKillCmd* killCmd = instruction.TryGet<Chess::FKillCmd>())
+	{
+		if (isTile(killCmd->X, killCmd->Y))
+			return static_cast<uint16>(MakeSquare(killCmd->X, killCmd->Y) | (EChessRecordKind::Kill << 12));
+	}
+
+	return static_cast<uint16>(EChessRecordKind::Opaque << 12);
+}
+
+TOptional<Chess::FBoardInstruction> DecodeInstruction(uint16 encoded)
+{
+	const int32 from = encoded & 0x3F;
+	const int32 to = (encoded >> 6) & 0x3F;
+
+	switch ((encoded >> 12) & 0x3)
+	{
+	case EChessRecordKind::Move:
+		return MakeMoveInstruction(GetSquareX(from), GetSquareY(from), GetSquareX(to), GetSquareY(to));
+	case EChessRecordKind::Kill:
+		return MakeKillInstruction(GetSquareX(from), GetSquareY(from));
+	default:
+		return {};
+	}
+}
+
+FChessInstructionRecord MakeInstructionRecord(const Chess::FBoardInstruction& instruction, const FChessBitboardPosition& position)
+{
+	const FChessPositionState& state = position.State;
+
+	FChessInstructionRecord record;
+	record.Instruction = EncodeInstruction(instruction) | static_cast<uint16>(state.SideToMove << 14);
+	record.CastlingEnPassant = static_cast<uint8>((state.CastlingRights & ECastlingRights::All) | ((state.EnPassantSquare != INDEX_NONE ? GetSquareX(state.EnPassantSquare) + 1 : 0) << 4));
+	record.HalfmoveClock = state.HalfmoveClock;
+	return record;
+}
+
+FChessPositionState GetRecordState(const FChessInstructionRecord& record, const FChessPositionState& stateAfter)
+{
+	FChessPositionState state;
+	state.SideToMove = static_cast<EChessSide::Type>((record.Instruction >> 14) & 1);
+	state.CastlingRights = record.CastlingEnPassant & ECastlingRights::All;
+	state.HalfmoveClock = record.HalfmoveClock;
+
+	// The en passant square lies behind a pawn of the side that just moved
+	const int32 enPassantFile = (record.CastlingEnPassant >> 4) - 1;
+	state.EnPassantSquare = enPassantFile >= 0 ? static_cast<int8>(MakeSquare(enPassantFile, state.SideToMove == EChessSide::White ? 5 : 2)) : INDEX_NONE;
+
+	// Black completing a move is what advanced the counter
+	const bool blackMoved = state.SideToMove == EChessSide::Black && stateAfter.SideToMove != state.SideToMove;
+	state.FullmoveNumber = blackMoved ? FMath::Max<uint16>(stateAfter.FullmoveNumber - 1, 1) : stateAfter.FullmoveNumber;
+	return state;
+}
+
+bool GetInstructionTiles(const Chess::FBoardInstruction& instruction, FChessTileList& outTiles)
+{
+	auto addTile = [&outTiles](int32 x, int32 y)
+	{
+		if (x >= 0 && x < Chess::BOARD_SIZE && y >= 0 && y < Chess::BOARD_SIZE)
+			outTiles.AddUnique(FIntPoint(x, y));
+	};
+
+	if (const Chess::FMoveTileCmd* moveCmd = instruction.TryGet<Chess::FMoveTileCmd>())
+	{
+		addTile(moveCmd->From.X, moveCmd->From.Y);
+		addTile(moveCmd->To.X, moveCmd->To.Y);
+
+		const int32 dx = moveCmd->To.X - moveCmd->From.X;
+		const int32 dy = moveCmd->To.Y - moveCmd->From.Y;
+
+		// Castling also relocates the rook
+		if (FMath::Abs(dx) == 2 && dy == 0)
+		{
+			addTile(dx > 0 ? Chess::BOARD_SIZE - 1 : 0, moveCmd->From.Y);
+			addTile(moveCmd->From.X + dx / 2, moveCmd->From.Y);
+		}
+
+		// En passant removes the pawn beside the destination
+		if (FMath::Abs(dx) == 1 && FMath::Abs(dy) == 1)
+		{
+			addTile(moveCmd->To.X, moveCmd->From.Y);
+		}
+
+		return true;
+	}
+
+	if (const Chess::FKillCmd* killCmd = instruction.TryGet<Chess::FKillCmd>())
+	{
+		addTile(killCmd->X, killCmd->Y);
+		return true;
+	}
+
+	return false;
+}
+
+void GetVisualAssetPaths(const FChessBoardVisual& visual, TArray<FSoftObjectPath>& outPaths)
+{
+	if (!visual.BoardSurfaceMesh.IsNull())
+		outPaths.AddUnique(visual.BoardSurfaceMesh.ToSoftObjectPath());
+
+	if (!visual.SurfaceMaterial.IsNull())
+		outPaths.AddUnique(visual.SurfaceMaterial.ToSoftObjectPath());
+
+	if (!visual.BoardBodyMesh.IsNull())
+		outPaths.AddUnique(visual.BoardBodyMesh.ToSoftObjectPath());
+}
+
+bool MatchesGameBoard(const ChessGame& game, const FChessBitboardPosition& position)
+{
+	const Chess::Board& board = game.GetBoard();
+	for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+	{
+		for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+		{
+			const Chess::PieceIdx idx = board.At(x, y);
+			const EBitboardPiece::Type expectedPiece = idx == Chess::PIECE_IDX_NONE ? EBitboardPiece::None : GetBitboardPiece(Into<EChessPieceType::Type>(game.GetPieceType(idx)));
+			if (position.GetPiece(MakeSquare(x, y)) != expectedPiece)
+				return false;
+		}
+	}
+	return true;
+}
+
+EBitboardPiece::Type GetBitboardPiece(EChessPieceType::Type pieceType)
+{
+	switch (pieceType)
+	{
+	case EChessPieceType::King: return EBitboardPiece::King;
+	case EChessPieceType::Queen: return EBitboardPiece::Queen;
+	case EChessPieceType::Bishop: return EBitboardPiece::Bishop;
+	case EChessPieceType::Rook: return EBitboardPiece::Rook;
+	case EChessPieceType::Knight: return EBitboardPiece::Knight;
+	case EChessPieceType::Pawn: return EBitboardPiece::Pawn;
+	default: return EBitboardPiece::None;
+	}
+}
+
+EChessPieceType::Type GetChessPieceType(EBitboardPiece::Type piece)
+{
+	switch (piece)
+	{
+	case EBitboardPiece::King: return EChessPieceType::King;
+	case EBitboardPiece::Queen: return EChessPieceType::Queen;
+	case EBitboardPiece::Bishop: return EChessPieceType::Bishop;
+	case EBitboardPiece::Rook: return EChessPieceType::Rook;
+	case EBitboardPiece::Knight: return EChessPieceType::Knight;
+	default: return EChessPieceType::Pawn;
+	}
+}
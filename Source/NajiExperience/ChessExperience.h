@@ -6,8 +6,21 @@
 #include "GameFramework/Actor.h"
 #include "Chess3D/Public/ChessGame.h"
 #include "Engine/DataTable.h"
+#include "Engine/StreamableManager.h"
+#include "Misc/Optional.h"
+#include "Tasks/Task.h"
+#include "ChessBitboard.h"
+#include "ChessSearch.h"
 #include "ChessExperience.generated.h"
 
+class FChessPGNReader;
+struct FChessSnapshot;
+struct FChessSnapshotDiff;
+class FChessOpeningBook;
+class FChessTablebase;
+class UShapeComponent;
+class UBoxComponent;
+
 template<typename U, typename T>
 static U Into(const T& val) = delete;
 
@@ -32,6 +45,12 @@ namespace EChessPieceType
 }
 IMPL_INTO_ENUM(Chess::EPieceId, EChessPieceType::Type)
 
+EBitboardPiece::Type GetBitboardPiece(EChessPieceType::Type pieceType);
+EChessPieceType::Type GetChessPieceType(EBitboardPiece::Type piece);
+
+// Piece types only, the rules engine board doesn't tell the sides apart
+bool MatchesGameBoard(const ChessGame& game, const FChessBitboardPosition& position);
+
 USTRUCT(BlueprintType)
 struct FChessBoardVisual : public FTableRowBase
 {
@@ -53,9 +72,20 @@ struct FChessBoardVisual : public FTableRowBase
 	TSoftObjectPtr<UStaticMesh> BoardBodyMesh;
 };
 
+// Keeps the assets of a board visual resident while cached
+struct FChessVisualCacheEntry
+{
+	FDataTableRowHandle Row;
+	TSharedPtr<FStreamableHandle> Handle;
+};
+
+void GetVisualAssetPaths(const FChessBoardVisual& visual, TArray<FSoftObjectPath>& outPaths);
+
+// Knockoff body of the renderer's pool, carries a captured piece until it comes to rest
 struct FPieceRigidBodyMarker
 {
-	int32 PieceActorIdx = INDEX_NONE;
+	int32 PieceActorIdx = INDEX_NONE; // Piece slot carried by the body
+	int32 PoolIdx = INDEX_NONE;
 };
 
 struct FPieceAnimInfo
@@ -65,20 +95,35 @@ struct FPieceAnimInfo
 	float ElapsedSeconds;
 };
 
-struct FChessAnimContext
-{
-	float AnimDurationSeconds = 2.0f;
-	float KnockoffForceMultiplier = 1.0f;
-	float KnockoffDirectionDither = 0.0f;
-};
-
 // Randomly offset direction with some dither delta, normalized.
 FVector GetDitheredVector(const FVector& dir, float dither);
 
+UENUM(BlueprintType)
+namespace EChessAnimEasing
+{
+	enum Type : uint8
+	{
+		Linear,
+		QuadOut,
+		CubicOut,
+		SmoothStep,
+	};
+}
+
 // Square ease out function
-constexpr float GetEasedAlpha(float t);
-FVector2D CalculateAnim(float time, float animDuration, const FVector2D& initial, const FVector2D& target);
+constexpr float GetEasedAlpha(float t)
+{
+	return -((t - 1) * (t - 1)) + 1;
+}
+
+float GetEasedAlpha(EChessAnimEasing::Type easing, float t);
+FVector2D CalculateAnim(float time, float animDuration, const FVector2D& initial, const FVector2D& target, EChessAnimEasing::Type easing = EChessAnimEasing::QuadOut);
+
+// Evaluates CalculateAnim for a whole batch of anims, 4 at a time with vector registers. The scalar version yields bit identical results.
+void CalculateAnimBatch(EChessAnimEasing::Type easing, float animDuration, TArrayView<const float> elapsed, TArrayView<const FVector2D> initial, TArrayView<const FVector2D> target, TArrayView<FVector2D> outPositions);
+void CalculateAnimBatchScalar(EChessAnimEasing::Type easing, float animDuration, TArrayView<const float> elapsed, TArrayView<const FVector2D> initial, TArrayView<const FVector2D> target, TArrayView<FVector2D> outPositions);
 FVector2D UpdateAnim(float dt, float animDuration, FPieceAnimInfo& animData, bool& finished);
+// The multiplier is the velocity change along the dithered direction, independent of the body mass
 void TriggerKnockoff(UShapeComponent* knockoffBody, const FVector2D& direction, float multiplier, float dither);
 void FinishKnockoff(UShapeComponent* knockoffBody);
 
@@ -94,17 +139,42 @@ struct FChessAnimUpdate
 	float DeltaTime;
 };
 
+// Anim handles pack a slot index with the generation of that slot, stale handles fail the generation check
+constexpr uint32 ANIM_HANDLE_NONE = 0;
+constexpr uint32 ANIM_HANDLE_SLOT_BITS = 16;
+constexpr uint32 ANIM_HANDLE_SLOT_MASK = (1u << ANIM_HANDLE_SLOT_BITS) - 1;
+
 struct FChessAnimContext
 {
-	TArray<FChessAnimInstance> ActiveAnims;
+	float AnimDurationSeconds = 2.0f;
+	float KnockoffForceMultiplier = 1.0f;
+	float KnockoffDirectionDither = 0.0f;
+	EChessAnimEasing::Type Easing = EChessAnimEasing::QuadOut;
+
+	// Active anims, densely packed (structure of arrays)
+	TArray<Chess::PieceIdx> Pieces;
+	TArray<FVector2D> Initial;
+	TArray<FVector2D> Target;
+	TArray<float> Elapsed;
+	TArray<FVector2D> Positions; // Output of the last update, parallel to Pieces
+	TArray<uint32> DenseToSlot;
+
+	// Handle slots, indexed by the slot bits of a handle
+	TArray<int32> SlotToDense;
+	TArray<uint32> SlotGenerations;
+	TArray<uint32> FreeSlots;
+
+	// Anims that finished or were stopped since the last update, pieces should be snapped to their target
 	TArray<FChessAnimInstance> FinishedAnims;
-	TSet<uint32> PendingStop;
+	TArray<FChessAnimInstance> StoppedAnims;
+	TArray<int32> FinishedIndices;
 };
 
-// Calculates and update anim state, returns the indices of anim instances that finished
-void UpdateAnimInstances(const FChessAnimUpdate& updateInfo, TArray<FChessAnimInstance>& active, TArray<FChessAnimInstance>& outFinished, TArray<FTransform>& outTransform);
+// Advances every anim by the delta time and writes the eased positions, outFinished receives the (ascending) indices of anims that finished
+void UpdateAnimInstances(const FChessAnimUpdate& updateInfo, float animDuration, EChessAnimEasing::Type easing, TArrayView<const FVector2D> initial, TArrayView<const FVector2D> target, TArrayView<float> elapsed, TArrayView<FVector2D> outPositions, TArray<int32>& outFinished);
 uint32 AddAnim(FChessAnimContext& ctx, Chess::PieceIdx piece, const FVector2D& from, const FVector2D& to);
 void StopAnim(FChessAnimContext& ctx, uint32 instance);
+bool IsAnimActive(const FChessAnimContext& ctx, uint32 instance);
 void UpdateAnim(FChessAnimContext& ctx, FChessAnimUpdate updateInfo);
 
 struct FChessInstancedMesh
@@ -115,7 +185,14 @@ struct FChessInstancedMesh
 	FPrimitiveInstanceId InstanceId;
 };
 
-TArray<int32> CollectUpdatingInstancedMeshes(TArrayView<FChessInstancedMesh> instancedMeshes, TArrayView<FChessAnimInstance> animInstances);
+// Knockoff body in flight, handed back to rest once it sleeps or runs out of time
+struct FChessKnockoff
+{
+	TWeakObjectPtr<UShapeComponent> Body;
+	float ElapsedSeconds = 0.0f;
+	int32 PoolIdx = INDEX_NONE; // Set for bodies of the renderer's pool
+};
+
 
 
 struct FChessPieceInfo
@@ -133,20 +210,269 @@ void UpdatePieceAnims(const TArray<uint32>& animIds, TArray<FTransform>& outTran
 void UpdatePieceInstances(const TArray<uint32>& rendererId, const TArray<EChessPieceType::Type>& pieceTypes, const TArray<FTransform>& transforms);
 TArray<int32> UpdatePieceInstancesQuery(const TArray<FChessPieceInfo>& pieceInfos, const TArray<Chess::PieceIdx>& movedPieces); // Returns the indices of PieceInfos that need their ISMs updated (checks if animated or marked)
 
+constexpr int32 MAX_BOARD_PIECES = Chess::BOARD_SIZE * 4;
+
+// Tile layout in board space plus the cached board to world transform. Tile (x, y) is centered on Origin + (x, y) * TileSize
+// in the local XY plane with the surface at local Z 0, so picking is a transform and a divide instead of a trace.
+struct FChessBoardFrame
+{
+	FTransform BoardToWorld;
+	FVector2D Origin = FVector2D(-0.5 * (Chess::BOARD_SIZE - 1));
+	FVector2D TileSize = FVector2D(1.0);
+	FVector2D InvTileSize = FVector2D(1.0);
+
+	void SetTileSize(const FVector2D& tileSize);
+	FVector2D GetLocalTileCenter(int32 tileX, int32 tileY) const { return Origin + FVector2D(tileX, tileY) * TileSize; }
+	FVector GetTilePosition(int32 tileX, int32 tileY) const { return BoardToWorld.TransformPosition(FVector(GetLocalTileCenter(tileX, tileY), 0.0)); }
+
+	// All return false outside of the board
+	bool LocalToTile(const FVector2D& local, int32& outX, int32& outY) const;
+	bool WorldToTile(const FVector& world, int32& outX, int32& outY) const;
+	// Picks the tile the ray crosses the surface plane on, rays parallel to the board or pointing away from it miss
+	bool RayToTile(const FVector& rayOrigin, const FVector& rayDirection, int32& outX, int32& outY) const;
+};
+
+// Dense per board piece store indexed by PieceIdx. Pieces live on the board plane, so only a planar position and height are kept per piece, in board space.
+// Instance transforms are grouped in contiguous per type ranges that match the ISM instance order.
+struct FChessPieceStore
+{
+	FVector2D Positions[MAX_BOARD_PIECES];
+	float Heights[MAX_BOARD_PIECES];
+	EChessPieceType::Type PieceTypes[MAX_BOARD_PIECES];
+	int32 InstanceIndices[MAX_BOARD_PIECES]; // Index into InstanceTransforms, INDEX_NONE if the piece has no instance
+	uint64 KnownPieces = 0;
+
+	int32 TypeOffsets[EChessPieceType::COUNT + 1];
+	Chess::PieceIdx InstancePieces[MAX_BOARD_PIECES];
+	FTransform InstanceTransforms[MAX_BOARD_PIECES];
+
+	FChessPieceStore() { Reset(); }
+	void Reset();
+	void ResetInstances();
+	int32 NumInstances(EChessPieceType::Type pieceType) const { return TypeOffsets[pieceType + 1] - TypeOffsets[pieceType]; }
+	bool IsKnown(int32 slot) const { return (KnownPieces & (1ull << slot)) != 0; }
+};
+static_assert(MAX_BOARD_PIECES <= 64, "FChessPieceStore::KnownPieces is a 64 bit mask");
+
+// PieceIdx is used directly as the dense store index
+FORCEINLINE int32 GetPieceSlot(Chess::PieceIdx idx)
+{
+	const int32 slot = static_cast<int32>(idx);
+	check(slot >= 0 && slot < MAX_BOARD_PIECES);
+	return slot;
+}
+
+// Pieces of one board whose instances need writing. Marking sets a bit, collecting only walks the set bits.
+struct FChessDirtyPieces
+{
+	uint64 Bits = 0;
+
+	void Mark(Chess::PieceIdx idx) { Bits |= 1ull << GetPieceSlot(idx); }
+	void Mark(TArrayView<const Chess::PieceIdx> pieces);
+	bool IsDirty(Chess::PieceIdx idx) const { return (Bits & (1ull << GetPieceSlot(idx))) != 0; }
+	bool IsEmpty() const { return Bits == 0; }
+	void Reset() { Bits = 0; }
+
+	// Clears and returns the lowest dirty slot, the set must not be empty
+	int32 PopSlot()
+	{
+		const int32 slot = static_cast<int32>(FMath::CountTrailingZeros64(Bits));
+		Bits &= Bits - 1;
+		return slot;
+	}
+};
+
+// Persistent reverse index from PieceIdx to the instanced mesh of the piece, rebuilt whenever the instances are set up
+struct FChessInstancedMeshLookup
+{
+	int32 MeshIndices[MAX_BOARD_PIECES];
+
+	FChessInstancedMeshLookup() { Reset(); }
+	void Reset();
+	void Build(TArrayView<const FChessInstancedMesh> instancedMeshes);
+};
+
+// Writes the instanced mesh indices of the dirty pieces to outIndices in PieceIdx order and clears the set.
+// O(dirty pieces), outIndices keeps its allocation from call to call.
+void CollectUpdatingInstancedMeshes(const FChessInstancedMeshLookup& lookup, FChessDirtyPieces& dirty, TArray<int32>& outIndices);
+
+using FChessTileList = TArray<FIntPoint, TInlineAllocator<4>>;
+
+// Squares and pieces touched by evaluating or undoing a single instruction
+struct FChessBoardDelta
+{
+	FChessTileList Tiles;
+	TArray<Chess::PieceIdx, TInlineAllocator<4>> Pieces;
+};
+
+UENUM(BlueprintType)
+namespace EChessInstructionResult
+{
+	enum Type : uint8
+	{
+		Pending,
+		Applied,
+		Rejected, // Refused by the rules engine
+		Illegal, // Not a legal move in the position it would have been played in
+		Unknown, // Ticket never issued or older than the last flush
+	};
+}
+
+namespace EChessRecordKind
+{
+	enum Type : uint8
+	{
+		Move,
+		Kill,
+		Opaque, // Instruction that can't be encoded, undone with a full resync and never redone
+	};
+}
+
+// Undo data of an evaluated instruction, kept parallel to the game history.
+// 4 bytes: the encoded instruction and the position state it replaced. Position keys aren't stored, they are recomputed by walking the records back.
+struct FChessInstructionRecord
+{
+	uint16 Instruction = 0; // From square (6) | to square (6) | kind (2) | side to move before (1)
+	uint8 CastlingEnPassant = 0; // Castling rights (4) | en passant file + 1 (4), 0 without en passant
+	uint8 HalfmoveClock = 0;
+
+	EChessRecordKind::Type GetKind() const { return static_cast<EChessRecordKind::Type>((Instruction >> 12) & 0x3); }
+	int32 GetFrom() const { return Instruction & 0x3F; }
+	int32 GetTo() const { return (Instruction >> 6) & 0x3F; }
+};
+static_assert(sizeof(FChessInstructionRecord) == 4, "Instruction records are meant to stay compact");
+
+// 16 bit instruction encoding used by the history and the redo stack, Opaque kind for anything else than a plain move or kill
+uint16 EncodeInstruction(const Chess::FBoardInstruction& instruction);
+TOptional<Chess::FBoardInstruction> DecodeInstruction(uint16 encoded);
+
+FChessInstructionRecord MakeInstructionRecord(const Chess::FBoardInstruction& instruction, const FChessBitboardPosition& position);
+// State before the recorded instruction, the full move number is derived from the state after it
+FChessPositionState GetRecordState(const FChessInstructionRecord& record, const FChessPositionState& stateAfter);
+
+// Search state shared with the worker task, kept alive by the task if the game goes away
+struct FChessAIState
+{
+	FChessAIState(int32 hashSizeMB, int32 numThreads)
+		: TT(hashSizeMB)
+		, Search(TT, numThreads)
+		, HashSizeMB(hashSizeMB)
+		, NumThreads(numThreads)
+	{
+	}
+
+	FChessTranspositionTable TT;
+	FChessParallelSearch Search;
+	int32 HashSizeMB;
+	int32 NumThreads; // As requested, 0 for every hardware thread
+};
+
+Chess::FBoardInstruction MakeMoveInstruction(int32 fromX, int32 fromY, int32 toX, int32 toY);
+// The rules engine has no promotion choice and always queens, an underpromotion comes out as a queen promotion
+Chess::FBoardInstruction MakeMoveInstruction(const FChessMove& move);
+Chess::FBoardInstruction MakeKillInstruction(int32 x, int32 y);
+
+// Candidate squares an instruction may modify (including castling rook and en passant squares). Returns false for instructions with an unknown footprint.
+bool GetInstructionTiles(const Chess::FBoardInstruction& instruction, FChessTileList& outTiles);
+
+struct FChessInstanceWrite
+{
+	FPrimitiveInstanceId InstanceId;
+	FTransform Transform;
+	bool WorldSpace;
+};
+
+// Instances a board reserves per piece type in a shared renderer, enough for every possible promotion
+constexpr int32 GetBoardInstanceCapacity(EChessPieceType::Type pieceType)
+{
+	switch (pieceType)
+	{
+	case EChessPieceType::King: return 2;
+	case EChessPieceType::Pawn: return Chess::BOARD_SIZE * 2;
+	case EChessPieceType::Queen: return 2 + Chess::BOARD_SIZE * 2;
+	default: return 4 + Chess::BOARD_SIZE * 2;
+	}
+}
+
+// Instance ranges of one board in a shared renderer. Unused instances are kept with a zero scale.
+struct FChessRenderBoard
+{
+	TArray<FPrimitiveInstanceId> InstanceIds[EChessPieceType::COUNT];
+	TArray<FTransform> Transforms[EChessPieceType::COUNT]; // Last transform set per instance, restored when the board is shown again
+	bool WorldSpace = true;
+	bool Visible = true;
+	bool Registered = false;
+};
+
 UCLASS()
 class AChessPieceRenderer : public AActor
 {
 	GENERATED_BODY()
 public:
-	using InstanceIds = TStaticArray<TArray<FPrimitiveInstanceId>, EChessPieceType::COUNT>;
 	AChessPieceRenderer();
 
 	void SetupMeshes(TArrayView<UStaticMesh*> meshes);
-	TArray<FChessInstancedMesh> SetupInstances(TArrayView<FChessPieceInfo> pieces, TArrayView<FTransform> transforms, bool worldSpace);
 	void UpdateInstances(const TArray<int32>& indices, TArrayView<FChessInstancedMesh> instancedMeshes, bool worldSpace);
+	void UpdateInstances(EChessPieceType::Type pieceId, TArrayView<const FPrimitiveInstanceId> instanceIds, TArrayView<const FTransform> instances, bool worldSpace);
+
+	// Instance writes are buffered and flushed once at the end of the frame, the last write to an instance wins
+	void QueueInstanceUpdate(EChessPieceType::Type pieceId, FPrimitiveInstanceId instanceId, const FTransform& transform, bool worldSpace);
+	void FlushInstanceUpdates();
+	// Instances flushed during the current frame
+	int32 GetFlushedInstanceCount() const { return m_FlushFrame == GFrameCounter ? m_FlushedInstanceCount : 0; }
+
+	// Any number of boards can share one renderer, each owns a fixed instance range per piece type (see GetBoardInstanceCapacity).
+	// Ranges of unregistered boards are hidden and handed to the next board that registers, so no other board is ever rebuilt.
+	int32 RegisterBoard(bool worldSpace);
+	void UnregisterBoard(int32 board);
+	int32 GetNumBoards() const { return m_Boards.Num() - m_FreeBoards.Num(); }
+
+	// typeSlot indexes the board's range of the piece type
+	void SetBoardInstance(int32 board, EChessPieceType::Type pieceType, int32 typeSlot, const FTransform& transform);
+	// Hides the instances of the range from firstTypeSlot on
+	void HideBoardInstances(int32 board, EChessPieceType::Type pieceType, int32 firstTypeSlot);
+
+	void SetBoardVisible(int32 board, bool visible);
+	bool IsBoardVisible(int32 board) const { return m_Boards.IsValidIndex(board) && m_Boards[board].Visible; }
+
+	// Knockoff bodies are shared by every board of the renderer, all KnockoffPoolSize of them are created with the renderer.
+	// INDEX_NONE while all of them are in flight, the capture then goes straight to the graveyard.
+	int32 AcquireKnockoffBody();
+	// Puts the body back to rest, hidden and without collision
+	void ReleaseKnockoffBody(int32 poolIdx);
+	UBoxComponent* GetKnockoffBody(int32 poolIdx) const { return m_KnockoffBodies[poolIdx]; }
+	UStaticMeshComponent* GetKnockoffMesh(int32 poolIdx) const { return m_KnockoffMeshes[poolIdx]; }
+
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	int32 KnockoffPoolSize = 8;
+
+	// AActor
+	virtual void PostInitializeComponents() override;
+	virtual void Tick(float DeltaSeconds) override;
+	virtual bool ShouldTickIfViewportsOnly() const override { return true; }
 
 	UPROPERTY(EditDefaultsOnly, meta=(ArraySizeEnum))
 	UInstancedStaticMeshComponent* InstancedMeshes[EChessPieceType::COUNT];
+
+private:
+	TArray<FChessInstanceWrite> m_PendingWrites[EChessPieceType::COUNT];
+	int32 m_FlushedInstanceCount = 0; // Instances flushed during m_FlushFrame
+	uint64 m_FlushFrame = 0;
+
+	TArray<FChessRenderBoard> m_Boards;
+	TArray<int32> m_FreeBoards;
+
+	UPROPERTY(VisibleAnywhere)
+	TArray<UBoxComponent*> m_KnockoffBodies;
+
+	UPROPERTY(VisibleAnywhere)
+	TArray<UStaticMeshComponent*> m_KnockoffMeshes;
+
+	TArray<int32> m_FreeKnockoffBodies;
+
+	// Keeps the instanced meshes together when the renderer is attached to a board
+	UPROPERTY(VisibleAnywhere)
+	USceneComponent* m_Root;
 };
 
 UCLASS()
@@ -157,6 +483,8 @@ public:
 	AChessGame();
 	// AActor
 	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void Tick(float DeltaSeconds) override;
 
 	static void SetupGame(APlayerController* player, AController* ai, ChessGame& game);
 
@@ -170,19 +498,229 @@ public:
 	void DebugDrawTiles();
 	void GetTileBaseSize(float& outX, float& outY) const;
 	UFUNCTION(BlueprintPure, Category = "Chess3D")
-	FVector GetTilePosition(int32 tileX, int32 tileY) const;
+	FVector GetTilePosition(int32 tileX, int32 tileY) const { return m_BoardFrame.GetTilePosition(tileX, tileY); }
+
+	// Analytic picking against the board plane, handles actor rotation and scale. No collision or traces involved.
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	bool WorldToTile(const FVector& worldPosition, int32& tileX, int32& tileY) const { return m_BoardFrame.WorldToTile(worldPosition, tileX, tileY); }
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	bool RayToTile(const FVector& rayOrigin, const FVector& rayDirection, int32& tileX, int32& tileY) const { return m_BoardFrame.RayToTile(rayOrigin, rayDirection, tileX, tileY); }
+	// Tile under the player's mouse cursor
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	bool GetCursorTile(APlayerController* player, int32& tileX, int32& tileY) const;
+
+	const FChessBoardFrame& GetBoardFrame() const { return m_BoardFrame; }
 
 	UFUNCTION(BlueprintCallable, Category = "Chess3D")
 	void SetVisual(FDataTableRowHandle row);
 	const FChessBoardVisual& GetVisual() const { return m_Visual; }
 	void OnVisualsUpdated(const FChessBoardVisual& newVisuals);
 
+	// Streams in the assets of every row so later theme switches resolve instantly
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	void PrefetchVisuals(UDataTable* visuals);
+
+	// Streams the visual in the background, the current visual stays until the new one is resident
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	bool bAsyncVisualSwap = true;
+
+	// Number of recently used visuals kept resident
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 1))
+	int32 VisualCacheSize = 4;
+
+	// The renderer can be shared by many boards, every board registers its own instance ranges with it
 	UFUNCTION(BlueprintCallable, Category = "Chess3D")
 	void SetRenderer(AChessPieceRenderer* renderer);
+
+	// While the renderer serves no other board it is attached to this one and fed board space transforms, so moving, rotating or
+	// scaling the board touches no instance. Once a second board registers, the renderer goes back to world space for every board.
+	// Boards sharing a renderer should stay put, each move rewrites the board's whole instance range.
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	bool bOwnsRenderer = true;
 	void SetupPiecesPositions(AChessPieceRenderer* renderer);
+	// Rewrites this board's instance ranges only, renderer has to be m_Renderer
 	void SetupPieceRenderer(AChessPieceRenderer* renderer);
 	void UpdatePiecesPositions(AChessPieceRenderer* renderer);
+	void UpdatePiecesPositions(AChessPieceRenderer* renderer, TArrayView<const FIntPoint> tiles);
 	void UpdatePiecesRenderer(AChessPieceRenderer& renderer);
+	void UpdatePiecesRenderer(AChessPieceRenderer& renderer, TArrayView<const Chess::PieceIdx> pieces);
+	// Moves the instance of the piece and marks it dirty, WriteDirtyPieces hands the dirty instances to the renderer
+	void SetPieceInstancePosition(int32 slot, const FVector2D& position);
+	void WriteDirtyPieces(AChessPieceRenderer& renderer);
+	// Piece transforms are kept in board space, only shared renderers need them in world space
+	FTransform GetRendererTransform(const FTransform& boardTransform) const { return m_RendererLocal ? boardTransform : boardTransform * m_BoardFrame.BoardToWorld; }
+
+	// Hides or shows the pieces in the renderer, other boards sharing it are unaffected
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	void SetPiecesVisible(bool visible);
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	bool ArePiecesVisible() const;
+	// Returns true if the piece needs a new renderer instance (first seen or its type changed)
+	bool SetPiecePosition(Chess::PieceIdx idx, int32 tileX, int32 tileY);
+
+	// Evaluates the instruction and syncs only the squares it touched
+	void EvaluateInstruction(const Chess::FBoardInstruction& instruction);
+	void UndoLastInstruction() { UndoInstructions(1); }
+	const FChessBoardDelta& GetLastDelta() const { return m_LastDelta; }
+
+	// Steps back or forward through the history, the renderer is refreshed once for the net change. Returns the number of steps taken.
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	int32 UndoInstructions(int32 count);
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	int32 RedoInstructions(int32 count);
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	int32 GetRedoCount() const { return m_RedoInstructions.Num(); }
+
+	// Queued instructions are validated and applied together before physics on the next tick, with a single renderer refresh.
+	// Returns a ticket to query the result with.
+	int32 EnqueueInstruction(const Chess::FBoardInstruction& instruction);
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	int32 EnqueueMove(int32 fromX, int32 fromY, int32 toX, int32 toY);
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	int32 EnqueueKill(int32 x, int32 y);
+
+	// Applies the queue right away instead of waiting for the tick, returns the number of instructions applied
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	int32 FlushInstructions();
+
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	TEnumAsByte<EChessInstructionResult::Type> GetInstructionResult(int32 ticket) const;
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	int32 GetQueuedInstructionCount() const { return m_QueuedInstructions.Num(); }
+
+	// Queued moves that aren't legal in the bitboard position are dropped before they reach the rules engine
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	bool bValidateQueuedMoves = true;
+
+	// Bitboard mirror of m_Game, synced with every instruction
+	const FChessBitboardPosition& GetPosition() const { return m_Position; }
+	void GetLegalMoves(FChessMoveList& outMoves) const;
+
+	// Tiles the piece on the tile can legally move to, empty if it isn't the side to move
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	TArray<FIntPoint> GetLegalMoveTargets(int32 tileX, int32 tileY) const;
+
+	// Zobrist key of the current position (pieces, side to move, castling rights, en passant file), updated incrementally by every instruction and undo
+	uint64 GetPositionKey() const { return m_Position.Key; }
+	UFUNCTION(BlueprintPure, Category = "Chess3D", meta = (DisplayName = "Get Position Key"))
+	int64 GetPositionKeyBP() const { return static_cast<int64>(m_Position.Key); }
+
+	// Number of earlier occurrences of the current position since the last capture or pawn move
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	int32 GetRepetitionCount() const;
+
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	FString GetFEN() const { return WriteFEN(m_Position); }
+
+	// Restarts the game and replays the moves of the game at gameIndex with a single renderer refresh.
+	// The rules engine always starts from the standard setup, so games with a FEN tag are refused.
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	bool LoadPGN(const FString& pgn, int32 gameIndex = 0);
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	bool LoadPGNFile(const FString& path, int32 gameIndex = 0);
+
+	// Empty if the history holds instructions other than moves or was trimmed past the setup
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	FString GetPGN() const;
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	bool SavePGNFile(const FString& path) const;
+
+	// Fails if the history was trimmed past the setup or holds instructions that can't be encoded
+	bool SaveSnapshot(FChessSnapshot& outSnapshot) const;
+	// Restarts the game and replays the snapshot history with a single renderer refresh, then checks the position against the snapshot
+	bool LoadSnapshot(const FChessSnapshot& snapshot);
+	// Undoes and plays the diff instructions with a single renderer refresh. Fails without touching the game unless it stands on the diff's
+	// from position, a step the rules engine refuses rolls the whole diff back.
+	bool ApplySnapshotDiff(const FChessSnapshotDiff& diff);
+
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	bool SaveSnapshotFile(const FString& path) const;
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	bool LoadSnapshotFile(const FString& path);
+
+	// Starts searching a move for the side to move on a worker task, the move is played on the game thread when found
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	void RequestAIMove();
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	void CancelAIMove();
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	bool IsAIThinking() const { return m_AIThinking; }
+
+	// Search budget per AI move
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0.05))
+	float AIThinkSeconds = 1.0f;
+
+	// 0 for no node limit
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	int32 AIMaxNodes = 0;
+
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 1, ClampMax = 1024))
+	int32 AIHashSizeMB = 32;
+
+	// Lazy SMP search threads sharing the hash table, 0 for every hardware thread
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0, ClampMax = 256))
+	int32 AIThreads = 0;
+
+	// Requests an AI move whenever it is the AI controller's turn
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	bool bAIAutoMove = true;
+
+	// Polyglot opening book (.bin) the AI plays from without searching while the position is in it, empty to always search.
+	// Mapped on the first AI move, never read into memory.
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	FString AIBookPath;
+
+	// Plays the book move with the highest weight instead of a weighted random pick
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	bool bAIBookBestMove = false;
+
+	// Syzygy tablebase directory (.rtbw, .rtbz). The AI plays the tablebase move without searching once few enough pieces are left, empty to always search.
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	FString AITablebaseDirectory;
+
+	// Decompressed tablebase blocks kept in memory, up to 128KB each
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 1))
+	int32 AITablebaseCacheBlocks = 64;
+
+	// Tablebase result for the side to move: wdl from -2 (loss) to 2 (win), with 1 and -1 for results the 50 move rule turns into draws.
+	// dtz is the plies to the next capture or pawn move, negative when losing. The position is probed on a task once per board change,
+	// false until that probe is back or if no table covers the position.
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	bool GetTablebaseEvaluation(int32& wdl, int32& dtz);
+
+	// Seconds a moved piece takes to glide to its new tile, 0 to snap
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	float MoveAnimSeconds = 0.3f;
+
+	// Pushes the body with physics, it is put back to rest once it sleeps or after KnockoffSeconds
+	UFUNCTION(BlueprintCallable, Category = "Chess3D")
+	void StartKnockoff(UShapeComponent* body, FVector2D direction);
+
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	float KnockoffSeconds = 3.0f;
+
+	// Velocity change applied to knocked off bodies, in cm/s
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	float KnockoffImpulse = 300.0f;
+
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0, ClampMax = 1))
+	float KnockoffDither = 0.3f;
+
+	// Captured pieces are handed to a pooled physics body and knocked towards their graveyard beside the board
+	UPROPERTY(EditAnywhere, Category = "Chess3D")
+	bool bKnockoffCaptures = true;
+
+	// The board only ticks while instructions, anims or knockoffs are pending, idle boards cost nothing per frame
+	UFUNCTION(BlueprintPure, Category = "Chess3D")
+	bool HasPendingWork() const;
+
+	// Busy boards that are off-screen or further than ThrottleDistance from the camera tick at this interval instead of every frame (see Chess.Tick.Throttle)
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	float ThrottledTickInterval = 0.1f;
+
+	// 0 to only throttle off-screen boards
+	UPROPERTY(EditAnywhere, Category = "Chess3D", meta = (ClampMin = 0))
+	float ThrottleDistance = 0.0f;
 
 	UPROPERTY(EditDefaultsOnly, meta=(ArraySizeEnum))
 	UStaticMesh* PieceMeshes[EChessPieceType::COUNT];
@@ -202,8 +740,8 @@ public:
 
 private:
 	ChessGame m_Game;
-	APlayerController* m_PlayerController;
-	AController* m_AIController;
+	APlayerController* m_PlayerController = nullptr;
+	AController* m_AIController = nullptr;
 
 
 	UPROPERTY()
@@ -211,6 +749,13 @@ private:
 
 	UPROPERTY()
 	FChessBoardVisual m_Visual;
+
+	TSharedPtr<FStreamableHandle> RequestVisual(const FDataTableRowHandle& row, const FChessBoardVisual& visual);
+	void OnVisualLoaded(FDataTableRowHandle row);
+
+	FDataTableRowHandle m_PendingVisualRow;
+	TArray<FChessVisualCacheEntry> m_VisualCache; // Least recently used first
+	TSharedPtr<FStreamableHandle> m_PrefetchHandle;
 	
 	UPROPERTY(VisibleAnywhere)
 	USceneComponent* m_Root;
@@ -221,10 +766,120 @@ private:
 	UPROPERTY(VisibleAnywhere)
 	UStaticMeshComponent* m_BoardBodyMesh;
 
-	TMap<Chess::PieceIdx, FTransform> m_PieceTransforms;
-	AChessPieceRenderer::InstanceIds m_RendererInstanceIds;
-
-	FVector2D m_TilePositions[Chess::BOARD_SIZE][Chess::BOARD_SIZE];
+	FChessPieceStore m_Pieces;
+	FChessDirtyPieces m_DirtyPieces; // Marked by instructions, anims and knockoffs
+	int32 m_RendererBoard = INDEX_NONE; // Board handle in m_Renderer
+	bool m_RendererLocal = false; // m_Renderer is attached to the board and registered in board space
+	bool m_WarnedSharedMove = false;
+
+	// Board state as of the last sync, diffed against the instruction footprint
+	Chess::PieceIdx m_TilePieces[Chess::BOARD_SIZE][Chess::BOARD_SIZE];
+	FChessBoardDelta m_LastDelta;
+
+	// Update m_Game and the bitboard only, the touched tiles (one bit per square) are refreshed later in one go
+	bool ApplyInstruction(const Chess::FBoardInstruction& instruction, uint64& inOutTouchedTiles);
+	bool RevertInstruction(uint64& inOutTouchedTiles);
+	void RefreshTiles(uint64 touchedTiles);
+	// Refreshes the renderer and hands the turn over after new instructions were applied
+	void OnInstructionsApplied(uint64 touchedTiles);
+	// Keys of the positions since the last irreversible instruction, oldest first, without the current position
+	void GetReversibleKeys(TArray<uint64>& outKeys) const;
+	void UpdateUndoDepthStat(int32 depth);
+
+	bool LoadPGNGame(FChessPGNReader& reader, int32 gameIndex);
+	// Setup without the renderer refresh, for loads that refresh once after replaying their moves
+	void ResetGame(APlayerController* player, AController* ai);
+
+	bool IsLegalInstruction(const Chess::FBoardInstruction& instruction) const;
+
+	TArray<Chess::FBoardInstruction> m_QueuedInstructions;
+	int32 m_NextTicket = 0;
+	TArray<EChessInstructionResult::Type> m_FlushResults; // Results of the last flush, starting at m_FlushFirstTicket
+	int32 m_FlushFirstTicket = 0;
+
+	// Oldest first, one per game history entry. ChessGame has no way to drop or rebase its own history, so neither is bounded.
+	TArray<FChessInstructionRecord> m_InstructionRecords;
+	TArray<uint16> m_RedoInstructions; // Encoded, most recently undone last
+	int32 m_TrimmedHistory = 0; // Game history entries older than the first record, only if the records fell out of step with it
+	int32 m_StatUndoDepth = 0; // Depth last added to STAT_ChessUndoDepth
+
+	void SetupPosition();
+	// The bitboard mirror of a game, static so snapshots can be replayed on a scratch game before the board is reset
+	static void SetupGamePosition(const ChessGame& game, EChessSide::Type* outPieceSides, FChessBitboardPosition& outPosition);
+	static void RebuildPosition(const ChessGame& game, const EChessSide::Type* pieceSides, FChessBitboardPosition& inOutPosition);
+	static void SyncPosition(const ChessGame& game, const EChessSide::Type* pieceSides, TArrayView<const FIntPoint> tiles, FChessBitboardPosition& inOutPosition);
+	// Evaluates an instruction on the game and mirrors it into the position, false if the rules engine refused it
+	static bool PlayInstruction(ChessGame& game, const EChessSide::Type* pieceSides, const Chess::FBoardInstruction& instruction, FChessBitboardPosition& inOutPosition, uint64& inOutTouchedTiles);
+	// Cross-checks the incremental position against m_Game, see Chess.Position.Verify
+	void VerifyPosition() const;
+
+	FChessBitboardPosition m_Position;
+	FChessBitboardPosition m_StartPosition; // As of the last setup, the records replay from it
+	EChessSide::Type m_PieceSides[MAX_BOARD_PIECES];
+
+	void OnAIMoveFound(uint32 requestId, const FChessSearchResult& result);
+	bool ProbeAIBook(FChessMove& outMove);
+	// Created on first use and whenever the directory or cache size changes, null without a directory. Probed on tasks only.
+	TSharedPtr<FChessTablebase> GetTablebase();
+	// Book moves go through OnAIMoveFound like search results
+	void PostAIMove(const FChessMove& move);
+
+	TSharedPtr<FChessAIState> m_AIState;
+	UE::Tasks::FTask m_AITask;
+	uint32 m_AIRequestId = 0; // Bumped on every request and cancel, stale results are dropped
+	uint64 m_AISearchKey = 0; // Position the pending search started from
+	bool m_AIThinking = false;
+
+	TSharedPtr<FChessOpeningBook> m_AIBook; // Opened from m_AIBookPath, reopened when the path changes
+	FString m_AIBookPath;
+	uint32 m_AIBookRandom = 0;
+
+	TSharedPtr<FChessTablebase> m_Tablebase;
+	FString m_TablebaseDirectory;
+	int32 m_TablebaseCacheBlocks = 0;
+
+	struct FTablebaseEvaluation
+	{
+		uint64 Key = 0; // Position the probe was requested for
+		bool Requested = false;
+		bool Found = false;
+		int32 WDL = 0;
+		int32 DTZ = 0;
+	};
+	FTablebaseEvaluation m_TablebaseEvaluation;
+
+	void OnBoardTransformUpdated(USceneComponent* component, EUpdateTransformFlags flags, ETeleportType teleport);
+
+	FChessBoardFrame m_BoardFrame; // Transform kept in sync with the root component
+
+	// Enables the tick while work is pending and picks its rate, disables it once idle
+	void UpdateTickState();
+	bool ShouldThrottleTick() const;
+
+	void StartPieceAnim(int32 slot, const FVector2D& from);
+	void StopPieceAnims();
+	void TickPieceAnims(float deltaSeconds);
+	void TickKnockoffs(float deltaSeconds);
+
+	FChessAnimContext m_Anims;
+	uint32 m_PieceAnims[MAX_BOARD_PIECES]; // Anim handle per piece slot, ANIM_HANDLE_NONE while at rest
+	TArray<FChessKnockoff> m_Knockoffs;
+
+	// Captured pieces fly off on a body from the renderer's pool, then rest in a graveyard slot.
+	// Without knockoff the piece is only moved to the graveyard, the caller refreshes the renderer
+	void CapturePiece(int32 slot, bool knockoff);
+	void RevivePiece(int32 slot);
+	void ReturnKnockoffBody(int32 poolIdx);
+	// Before the board leaves its renderer
+	void ReturnKnockoffBodies();
+	int32 FindKnockoffBody(int32 slot) const;
+	FVector2D GetGraveyardPosition(EChessSide::Type side, int32 graveSlot) const;
+	bool IsCaptured(int32 slot) const { return (m_CapturedPieces & (1ull << slot)) != 0; }
+
+	TArray<FPieceRigidBodyMarker, TInlineAllocator<4>> m_KnockoffMarkers; // One per piece carried by a body of m_Renderer
+	uint64 m_CapturedPieces = 0; // In the graveyard or carried by a knockoff body
+	int32 m_GraveyardSlots[MAX_BOARD_PIECES];
+	uint32 m_GraveyardUsed[EChessSide::COUNT] = {}; // One bit per graveyard slot
 };
 
 UCLASS()
@@ -239,11 +894,4 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
-
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
-	
-	
 };
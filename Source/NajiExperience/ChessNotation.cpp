@@ -0,0 +1,541 @@
+
+
+
+#include "ChessNotation.h"
+
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/PlatformFileManager.h"
+
+static const TCHAR PieceLetters[EBitboardPiece::COUNT] = { 'P', 'N', 'B', 'R', 'Q', 'K' };
+
+static EBitboardPiece::Type GetPieceFromLetter(int32 letter)
+{
+	switch (letter)
+	{
+	case 'N': return EBitboardPiece::Knight;
+	case 'B': return EBitboardPiece::Bishop;
+	case 'R': return EBitboardPiece::Rook;
+	case 'Q': return EBitboardPiece::Queen;
+	case 'K': return EBitboardPiece::King;
+	default: return EBitboardPiece::None;
+	}
+}
+
+FString WriteSAN(const FChessBitboardPosition& position, const FChessMove& move)
+{
+	FString san;
+	const EBitboardPiece::Type piece = position.GetPiece(move.From);
+
+	if (move.Flags & EChessMoveFlags::Castle)
+	{
+		san = GetSquareX(move.To) > GetSquareX(move.From) ? TEXT("O-O") : TEXT("O-O-O");
+	}
+	else
+	{
+		if (piece != EBitboardPiece::Pawn)
+		{
+			san.AppendChar(PieceLetters[piece]);
+
+			// Disambiguate by file first, then by rank, then by both
+			FChessMoveList moves;
+			GenerateLegalMoves(position, moves);
+
+			bool isAmbiguous = false;
+			bool sharesFile = false;
+			bool sharesRank = false;
+			for (const FChessMove& other : moves)
+			{
+				if (other.To != move.To || other.From == move.From || position.GetPiece(other.From) != piece)
+					continue;
+
+				isAmbiguous = true;
+				sharesFile |= GetSquareX(other.From) == GetSquareX(move.From);
+				sharesRank |= GetSquareY(other.From) == GetSquareY(move.From);
+			}
+
+			if (isAmbiguous && (!sharesFile || sharesRank))
+				san.AppendChar(static_cast<TCHAR>('a' + GetSquareX(move.From)));
+			if (isAmbiguous && sharesFile)
+				san.AppendChar(static_cast<TCHAR>('1' + GetSquareY(move.From)));
+		}
+		else if (move.IsCapture())
+		{
+			san.AppendChar(static_cast<TCHAR>('a' + GetSquareX(move.From)));
+		}
+
+		if (move.IsCapture())
+			san.AppendChar('x');
+
+		san.AppendChar(static_cast<TCHAR>('a' + GetSquareX(move.To)));
+		san.AppendChar(static_cast<TCHAR>('1' + GetSquareY(move.To)));
+
+		if (move.Promotion != EBitboardPiece::None)
+		{
+			san.AppendChar('=');
+			san.AppendChar(PieceLetters[move.Promotion]);
+		}
+	}
+
+	FChessBitboardPosition next = position;
+	MakeMove(next, move);
+	if (IsInCheck(next))
+	{
+		FChessMoveList replies;
+		GenerateLegalMoves(next, replies);
+		san.AppendChar(replies.Num() == 0 ? '#' : '+');
+	}
+
+	return san;
+}
+
+bool ParseSAN(const FChessBitboardPosition& position, FAnsiStringView san, FChessMove& outMove)
+{
+	// Check marks and annotation glyphs carry no move information
+	while (san.Len() > 0 && (san[san.Len() - 1] == '+' || san[san.Len() - 1] == '#' || san[san.Len() - 1] == '!' || san[san.Len() - 1] == '?'))
+	{
+		san.LeftChopInline(1);
+	}
+
+	if (san.Len() < 2)
+		return false;
+
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+
+	if (san[0] == 'O' || san[0] == '0')
+	{
+		const bool isKingSide = san.Len() == 3 && (san[1] == '-' && (san[2] == 'O' || san[2] == '0'));
+		const bool isQueenSide = san.Len() == 5 && (san[1] == '-' && (san[2] == 'O' || san[2] == '0') && san[3] == '-' && (san[4] == 'O' || san[4] == '0'));
+		if (!isKingSide && !isQueenSide)
+			return false;
+
+		for (const FChessMove& move : moves)
+		{
+			if ((move.Flags & EChessMoveFlags::Castle) && (GetSquareX(move.To) > GetSquareX(move.From)) == isKingSide)
+			{
+				outMove = move;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int32 begin = 0;
+	EBitboardPiece::Type piece = GetPieceFromLetter(san[0]);
+	if (piece != EBitboardPiece::None)
+		begin = 1;
+	else
+		piece = EBitboardPiece::Pawn;
+
+	int32 end = san.Len();
+	EBitboardPiece::Type promotion = EBitboardPiece::None;
+	if (piece == EBitboardPiece::Pawn && end >= 4 && san[end - 2] == '=')
+	{
+		promotion = GetPieceFromLetter(FCharAnsi::ToUpper(san[end - 1]));
+		end -= 2;
+	}
+	else if (piece == EBitboardPiece::Pawn && end >= 3 && GetPieceFromLetter(san[end - 1]) != EBitboardPiece::None)
+	{
+		promotion = GetPieceFromLetter(san[end - 1]);
+		end -= 1;
+	}
+
+	if (promotion == EBitboardPiece::King || end - begin < 2)
+		return false;
+
+	const int32 toX = san[end - 2] - 'a';
+	const int32 toY = san[end - 1] - '1';
+	if (toX < 0 || toX >= 8 || toY < 0 || toY >= 8)
+		return false;
+
+	// Whatever is left between the piece and the target square is disambiguation or a capture mark
+	int32 fromX = INDEX_NONE;
+	int32 fromY = INDEX_NONE;
+	for (int32 i = begin; i < end - 2; ++i)
+	{
+		const ANSICHAR c = san[i];
+		if (c >= 'a' && c <= 'h')
+			fromX = c - 'a';
+		else if (c >= '1' && c <= '8')
+			fromY = c - '1';
+		else if (c != 'x' && c != ':' && c != '-')
+			return false;
+	}
+
+	const int32 to = MakeSquare(toX, toY);
+	int32 numMatches = 0;
+	for (const FChessMove& move : moves)
+	{
+		if (move.To != to || position.GetPiece(move.From) != piece)
+			continue;
+		if ((fromX != INDEX_NONE && GetSquareX(move.From) != fromX) || (fromY != INDEX_NONE && GetSquareY(move.From) != fromY))
+			continue;
+
+		// A promotion without a piece is taken as a queen
+		const uint8 expectedPromotion = (promotion == EBitboardPiece::None && move.Promotion != EBitboardPiece::None) ? EBitboardPiece::Queen : promotion;
+		if (move.Promotion != expectedPromotion)
+			continue;
+
+		outMove = move;
+		++numMatches;
+	}
+
+	return numMatches == 1;
+}
+
+void FChessPGNGame::Reset()
+{
+	Tags.Reset();
+	HasCustomStart = false;
+	Moves.Reset();
+	Result.Reset();
+	Error.Reset();
+}
+
+const FString* FChessPGNGame::FindTag(const TCHAR* name) const
+{
+	for (const TPair<FString, FString>& tag : Tags)
+	{
+		if (tag.Key.Equals(name, ESearchCase::CaseSensitive))
+			return &tag.Value;
+	}
+	return nullptr;
+}
+
+FString WritePGN(const FChessBitboardPosition& startPosition, TArrayView<const FChessMove> moves, TArrayView<const TPair<FString, FString>> tags, const FString& result)
+{
+	FString pgn;
+
+	bool hasFENTag = false;
+	for (const TPair<FString, FString>& tag : tags)
+	{
+		const FString value = tag.Value.Replace(TEXT("\\"), TEXT("\\\\")).Replace(TEXT("\""), TEXT("\\\""));
+		pgn.Appendf(TEXT("[%s \"%s\"]\n"), *tag.Key, *value);
+		hasFENTag |= tag.Key.Equals(TEXT("FEN"), ESearchCase::CaseSensitive);
+	}
+
+	const FString startFEN = WriteFEN(startPosition);
+	if (!hasFENTag && !startFEN.Equals(START_POSITION_FEN, ESearchCase::CaseSensitive))
+		pgn.Appendf(TEXT("[SetUp \"1\"]\n[FEN \"%s\"]\n"), *startFEN);
+
+	if (pgn.Len() > 0)
+		pgn.AppendChar('\n');
+
+	// Export format keeps movetext lines under 80 characters
+	int32 lineLength = 0;
+	auto appendToken = [&pgn, &lineLength](const FString& token)
+	{
+		if (lineLength > 0 && lineLength + 1 + token.Len() >= 80)
+		{
+			pgn.AppendChar('\n');
+			lineLength = 0;
+		}
+		else if (lineLength > 0)
+		{
+			pgn.AppendChar(' ');
+			++lineLength;
+		}
+
+		pgn += token;
+		lineLength += token.Len();
+	};
+
+	FChessBitboardPosition position = startPosition;
+	for (int32 moveIdx = 0; moveIdx < moves.Num(); ++moveIdx)
+	{
+		if (position.State.SideToMove == EChessSide::White)
+			appendToken(FString::Printf(TEXT("%d."), position.State.FullmoveNumber));
+		else if (moveIdx == 0)
+			appendToken(FString::Printf(TEXT("%d..."), position.State.FullmoveNumber));
+
+		appendToken(WriteSAN(position, moves[moveIdx]));
+		MakeMove(position, moves[moveIdx]);
+	}
+
+	appendToken(result.IsEmpty() ? FString(TEXT("*")) : result);
+	pgn.AppendChar('\n');
+	return pgn;
+}
+
+FChessPGNReader::FChessPGNReader()
+{
+	verify(ParseFEN(START_POSITION_FEN, m_StartPosition));
+}
+
+FChessPGNReader::~FChessPGNReader() = default;
+
+bool FChessPGNReader::OpenFile(const TCHAR* path, int32 chunkSize)
+{
+	Close();
+
+	IFileHandle* file = FPlatformFileManager::Get().GetPlatformFile().OpenRead(path);
+	if (!file)
+		return false;
+
+	m_File.Reset(file);
+	m_TotalBytes = m_File->Size();
+	m_Buffer.SetNumUninitialized(FMath::Max(chunkSize, 4096));
+	return true;
+}
+
+void FChessPGNReader::OpenText(const FString& text)
+{
+	Close();
+
+	const auto ansiText = StringCast<ANSICHAR>(*text, text.Len());
+	m_Buffer.Append(ansiText.Get(), ansiText.Length());
+	m_BufferNum = m_Buffer.Num();
+	m_BytesRead = m_BufferNum;
+	m_TotalBytes = m_BufferNum;
+}
+
+void FChessPGNReader::Close()
+{
+	m_File.Reset();
+	m_Buffer.Reset();
+	m_BufferPos = 0;
+	m_BufferNum = 0;
+	m_BytesRead = 0;
+	m_TotalBytes = 0;
+}
+
+bool FChessPGNReader::Refill()
+{
+	if (!m_File || m_BytesRead >= m_TotalBytes)
+		return false;
+
+	const int64 numBytes = FMath::Min<int64>(m_Buffer.Num(), m_TotalBytes - m_BytesRead);
+	if (!m_File->Read(reinterpret_cast<uint8*>(m_Buffer.GetData()), numBytes))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("PGN read failed at byte %lld of %lld"), m_BytesRead, m_TotalBytes);
+		m_TotalBytes = m_BytesRead;
+		return false;
+	}
+
+	m_BufferPos = 0;
+	m_BufferNum = static_cast<int32>(numBytes);
+	m_BytesRead += numBytes;
+	return true;
+}
+
+bool FChessPGNReader::ReadGame(FChessPGNGame& outGame)
+{
+	return ReadGame(&outGame);
+}
+
+bool FChessPGNReader::SkipGame()
+{
+	return ReadGame(nullptr);
+}
+
+static bool IsTokenDelimiter(int32 c)
+{
+	switch (c)
+	{
+	case ' ': case '\t': case '\r': case '\n':
+	case '[': case ']': case '{': case '}': case '(': case ')': case ';': case '$':
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool FChessPGNReader::ReadGame(FChessPGNGame* outGame)
+{
+	FChessBitboardPosition position = m_StartPosition;
+	if (outGame)
+	{
+		outGame->Reset();
+		outGame->StartPosition = m_StartPosition;
+	}
+
+	bool hasGame = false;
+	bool hasMoves = false;
+	ANSICHAR token[32];
+
+	for (;;)
+	{
+		int32 c = NextChar();
+		if (c < 0)
+			return hasGame;
+
+		switch (c)
+		{
+		case ' ': case '\t': case '\r': case '\n': case ')':
+			continue;
+		case '[':
+			// Tags after movetext belong to the next game, this one ended without a termination marker
+			if (hasMoves)
+			{
+				UngetChar();
+				return true;
+			}
+			hasGame = true;
+			ReadTag(outGame, position);
+			continue;
+		case '{':
+			SkipUntil('}');
+			continue;
+		case ';':
+		case '%':
+			SkipUntil('\n');
+			continue;
+		case '(':
+			SkipVariation();
+			continue;
+		case '$':
+			do
+			{
+				c = NextChar();
+			} while (c >= '0' && c <= '9');
+			if (c >= 0)
+				UngetChar();
+			continue;
+		default:
+			break;
+		}
+
+		int32 tokenLength = 0;
+		for (; c >= 0 && !IsTokenDelimiter(c); c = NextChar())
+		{
+			if (tokenLength < UE_ARRAY_COUNT(token))
+				token[tokenLength] = static_cast<ANSICHAR>(c);
+			++tokenLength;
+		}
+		if (c >= 0)
+			UngetChar();
+
+		hasGame = true;
+		FAnsiStringView symbol(token, FMath::Min<int32>(tokenLength, UE_ARRAY_COUNT(token)));
+
+		if (symbol == ANSITEXTVIEW("1-0") || symbol == ANSITEXTVIEW("0-1") || symbol == ANSITEXTVIEW("1/2-1/2") || symbol == ANSITEXTVIEW("*"))
+		{
+			if (outGame)
+				outGame->Result = FString(symbol.Len(), symbol.GetData());
+			return true;
+		}
+
+		// Move numbers may be glued to the move, digits followed by anything else than dots are 0-0 castling
+		int32 numDigits = 0;
+		while (numDigits < symbol.Len() && symbol[numDigits] >= '0' && symbol[numDigits] <= '9')
+		{
+			++numDigits;
+		}
+		if (numDigits == symbol.Len())
+			continue;
+		if (symbol[numDigits] == '.')
+		{
+			symbol.RightChopInline(numDigits);
+			while (symbol.Len() > 0 && symbol[0] == '.')
+			{
+				symbol.RightChopInline(1);
+			}
+			if (symbol.Len() == 0)
+				continue;
+		}
+
+		hasMoves = true;
+		if (!outGame || !outGame->Error.IsEmpty())
+			continue;
+
+		FChessMove move;
+		if (tokenLength > UE_ARRAY_COUNT(token) || !ParseSAN(position, symbol, move))
+		{
+			outGame->Error = FString::Printf(TEXT("Move %d%s %s is illegal, ambiguous or malformed"), position.State.FullmoveNumber,
+				position.State.SideToMove == EChessSide::White ? TEXT(".") : TEXT("..."), *FString(symbol.Len(), symbol.GetData()));
+			continue;
+		}
+
+		MakeMove(position, move);
+		outGame->Moves.Add(move);
+	}
+}
+
+void FChessPGNReader::ReadTag(FChessPGNGame* outGame, FChessBitboardPosition& position)
+{
+	// [Name "Value"], with \" and \\ escapes in the value
+	TArray<ANSICHAR, TInlineAllocator<32>> name;
+	TArray<ANSICHAR, TInlineAllocator<128>> value;
+
+	int32 c = NextChar();
+	while (c == ' ' || c == '\t')
+	{
+		c = NextChar();
+	}
+	for (; c >= 0 && c != ' ' && c != '\t' && c != '"' && c != ']' && c != '\n'; c = NextChar())
+	{
+		name.Add(static_cast<ANSICHAR>(c));
+	}
+	while (c == ' ' || c == '\t')
+	{
+		c = NextChar();
+	}
+
+	if (c == '"')
+	{
+		for (c = NextChar(); c >= 0 && c != '"'; c = NextChar())
+		{
+			if (c == '\\')
+			{
+				c = NextChar();
+				if (c < 0)
+					break;
+			}
+			value.Add(static_cast<ANSICHAR>(c));
+		}
+		if (c >= 0)
+			c = NextChar();
+	}
+
+	while (c >= 0 && c != ']' && c != '\n')
+	{
+		c = NextChar();
+	}
+
+	if (!outGame)
+		return;
+
+	const FAnsiStringView nameView(name.GetData(), name.Num());
+	if (nameView == ANSITEXTVIEW("FEN"))
+	{
+		const FString fen(value.Num(), value.GetData());
+		if (ParseFEN(*fen, position))
+		{
+			outGame->StartPosition = position;
+			outGame->HasCustomStart = true;
+		}
+		else
+		{
+			outGame->Error = FString::Printf(TEXT("Invalid FEN tag \"%s\""), *fen);
+		}
+	}
+
+	if (m_KeepTags)
+		outGame->Tags.Emplace(FString(name.Num(), name.GetData()), FString(value.Num(), value.GetData()));
+}
+
+void FChessPGNReader::SkipUntil(int32 endChar)
+{
+	int32 c;
+	do
+	{
+		c = NextChar();
+	} while (c >= 0 && c != endChar);
+}
+
+void FChessPGNReader::SkipVariation()
+{
+	// Variations nest and may hold comments with parentheses in them
+	int32 depth = 1;
+	for (int32 c = NextChar(); c >= 0; c = NextChar())
+	{
+		if (c == '{')
+			SkipUntil('}');
+		else if (c == ';')
+			SkipUntil('\n');
+		else if (c == '(')
+			++depth;
+		else if (c == ')' && --depth == 0)
+			return;
+	}
+}
@@ -0,0 +1,82 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/StringView.h"
+#include "ChessBitboard.h"
+
+class IFileHandle;
+
+// Standard algebraic notation of a legal move, with check and mate suffixes
+FString WriteSAN(const FChessBitboardPosition& position, const FChessMove& move);
+// Accepts the usual variations: 0-0 castling, missing or redundant disambiguation, e8Q or e8=Q promotions and trailing annotations.
+// Returns false unless exactly one legal move matches.
+bool ParseSAN(const FChessBitboardPosition& position, FAnsiStringView san, FChessMove& outMove);
+
+struct FChessPGNGame
+{
+	TArray<TPair<FString, FString>> Tags; // In file order, only filled if the reader keeps tags
+	FChessBitboardPosition StartPosition;
+	bool HasCustomStart = false; // Started from a FEN tag
+	TArray<FChessMove> Moves;
+	FString Result; // Empty if the game text had no termination marker
+	FString Error; // Set on the first move that couldn't be resolved, Moves holds the ones before it
+
+	void Reset();
+	const FString* FindTag(const TCHAR* name) const;
+};
+
+// Moves are resolved against the position as they're read, so every returned move is legal
+FString WritePGN(const FChessBitboardPosition& startPosition, TArrayView<const FChessMove> moves, TArrayView<const TPair<FString, FString>> tags, const FString& result);
+
+// Sequential PGN reader. Files are streamed through a fixed size buffer so databases of any size can be read with constant memory.
+class FChessPGNReader
+{
+public:
+	static constexpr int32 DEFAULT_CHUNK_SIZE = 1 << 20;
+
+	FChessPGNReader();
+	~FChessPGNReader();
+
+	bool OpenFile(const TCHAR* path, int32 chunkSize = DEFAULT_CHUNK_SIZE);
+	void OpenText(const FString& text);
+	void Close();
+
+	// Reads the next game, false once the input is exhausted. Variations, comments and annotations are skipped.
+	bool ReadGame(FChessPGNGame& outGame);
+	// Skips a game without resolving its moves, for seeking to a game index
+	bool SkipGame();
+
+	// Tags other than FEN are dropped when not kept, which saves their allocations on bulk reads
+	void SetKeepTags(bool keepTags) { m_KeepTags = keepTags; }
+
+	int64 GetBytesRead() const { return m_BytesRead - (m_BufferNum - m_BufferPos); }
+	int64 GetTotalBytes() const { return m_TotalBytes; }
+
+private:
+	bool ReadGame(FChessPGNGame* outGame);
+	void ReadTag(FChessPGNGame* outGame, FChessBitboardPosition& position);
+	void SkipUntil(int32 endChar);
+	void SkipVariation();
+
+	FORCEINLINE int32 NextChar()
+	{
+		if (m_BufferPos == m_BufferNum && !Refill())
+			return -1;
+		return static_cast<uint8>(m_Buffer[m_BufferPos++]);
+	}
+	// Only the character just read may be pushed back
+	FORCEINLINE void UngetChar() { --m_BufferPos; }
+	bool Refill();
+
+	TUniquePtr<IFileHandle> m_File;
+	TArray<ANSICHAR> m_Buffer;
+	int32 m_BufferPos = 0;
+	int32 m_BufferNum = 0;
+	int64 m_BytesRead = 0;
+	int64 m_TotalBytes = 0;
+	bool m_KeepTags = true;
+
+	FChessBitboardPosition m_StartPosition;
+};
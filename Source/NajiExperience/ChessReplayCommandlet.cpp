@@ -0,0 +1,133 @@
+
+
+
+#include "ChessReplayCommandlet.h"
+
+#include "ChessExperience.h"
+#include "ChessBitboard.h"
+#include "ChessNotation.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Parse.h"
+
+UChessReplayCommandlet::UChessReplayCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UChessReplayCommandlet::Main(const FString& Params)
+{
+	FString path;
+	if (!FParse::Value(*Params, TEXT("pgn="), path))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Usage: -run=ChessReplay -pgn=<path> [-maxgames=<n>] [-verify] [-chunkkb=<n>]"));
+		return 1;
+	}
+
+	int64 maxGames = 0;
+	int32 chunkKB = FChessPGNReader::DEFAULT_CHUNK_SIZE / 1024;
+	FParse::Value(*Params, TEXT("maxgames="), maxGames);
+	FParse::Value(*Params, TEXT("chunkkb="), chunkKB);
+	const bool verify = FParse::Param(*Params, TEXT("verify"));
+
+	FChessPGNReader reader;
+	reader.SetKeepTags(false);
+	if (!reader.OpenFile(*path, FMath::Max(chunkKB, 1) * 1024))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Could not open PGN file %s"), *path);
+		return 1;
+	}
+
+	m_Stats = FChessReplayStats();
+	m_NumLogged = 0;
+
+	FChessPGNGame game;
+	const double startSeconds = FPlatformTime::Seconds();
+	double reportSeconds = startSeconds;
+	while ((maxGames <= 0 || m_Stats.Games < maxGames) && reader.ReadGame(game))
+	{
+		++m_Stats.Games;
+
+		if (!game.Error.IsEmpty())
+		{
+			++m_Stats.NotationErrors;
+			if (ShouldLog())
+				UE_LOG(LogTemp, Warning, TEXT("Game %lld: %s"), m_Stats.Games, *game.Error);
+		}
+
+		if (game.HasCustomStart)
+		{
+			++m_Stats.SkippedGames;
+			continue;
+		}
+
+		ReplayGame(game, verify);
+
+		const double nowSeconds = FPlatformTime::Seconds();
+		if (nowSeconds - reportSeconds > 5.0)
+		{
+			reportSeconds = nowSeconds;
+			UE_LOG(LogTemp, Display, TEXT("%lld games, %.1f%% of %s"), m_Stats.Games, 100.0 * reader.GetBytesRead() / FMath::Max<int64>(reader.GetTotalBytes(), 1), *path);
+		}
+	}
+
+	const double seconds = FMath::Max(FPlatformTime::Seconds() - startSeconds, UE_SMALL_NUMBER);
+	const double replaySeconds = FMath::Max(m_Stats.ReplaySeconds, UE_SMALL_NUMBER);
+
+	UE_LOG(LogTemp, Display, TEXT("Replayed %lld games (%lld skipped, %lld with notation errors), %lld moves in %.2fs: %.0f games/s, %.0f moves/s, %.1f MB/s"),
+		m_Stats.Games, m_Stats.SkippedGames, m_Stats.NotationErrors, m_Stats.Moves, seconds,
+		m_Stats.Games / seconds, m_Stats.Moves / seconds, reader.GetBytesRead() / (1024.0 * 1024.0) / seconds);
+	UE_LOG(LogTemp, Display, TEXT("Rules engine alone: %.2fs, %.0f games/s, %.0f moves/s"),
+		m_Stats.ReplaySeconds, (m_Stats.Games - m_Stats.SkippedGames) / replaySeconds, m_Stats.Moves / replaySeconds);
+
+	if (m_Stats.RejectedMoves > 0 || m_Stats.BoardMismatches > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("%lld moves rejected, %lld board mismatches"), m_Stats.RejectedMoves, m_Stats.BoardMismatches);
+		return 1;
+	}
+
+	return 0;
+}
+
+void UChessReplayCommandlet::ReplayGame(const FChessPGNGame& game, bool verify)
+{
+	ChessGame chessGame;
+	AChessGame::SetupGame(nullptr, nullptr, chessGame);
+
+	// Only the instruction evaluation is timed, the bitboard replay, verification and notation aren't the rules engine
+	double replaySeconds = 0.0;
+	FChessBitboardPosition position = game.StartPosition;
+	for (const FChessMove& move : game.Moves)
+	{
+		const int32 historyNum = chessGame.GetHistory().Num();
+		Chess::FBoardInstruction instruction = MakeMoveInstruction(move);
+
+		const double startSeconds = FPlatformTime::Seconds();
+		chessGame.EvaluateInstruction(MoveTemp(instruction));
+		replaySeconds += FPlatformTime::Seconds() - startSeconds;
+
+		if (chessGame.GetHistory().Num() <= historyNum)
+		{
+			++m_Stats.RejectedMoves;
+			if (ShouldLog())
+				UE_LOG(LogTemp, Warning, TEXT("Game %lld: the rules engine refused %s in %s"), m_Stats.Games, *WriteSAN(position, move), *WriteFEN(position));
+			break;
+		}
+
+		++m_Stats.Moves;
+		MakeMove(position, move);
+
+		if (verify && !MatchesGameBoard(chessGame, position))
+		{
+			++m_Stats.BoardMismatches;
+			if (ShouldLog())
+				UE_LOG(LogTemp, Warning, TEXT("Game %lld: the rules engine board differs from %s"), m_Stats.Games, *WriteFEN(position));
+			break;
+		}
+	}
+
+	m_Stats.ReplaySeconds += replaySeconds;
+}
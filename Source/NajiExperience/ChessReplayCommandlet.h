@@ -0,0 +1,40 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ChessReplayCommandlet.generated.h"
+
+struct FChessPGNGame;
+
+struct FChessReplayStats
+{
+	int64 Games = 0;
+	int64 SkippedGames = 0; // Start from a FEN position the rules engine can't be set up with
+	int64 NotationErrors = 0; // Games with a move that doesn't resolve to a single legal move, replayed up to it
+	int64 Moves = 0;
+	int64 RejectedMoves = 0; // Legal moves the rules engine refused
+	int64 BoardMismatches = 0;
+	double ReplaySeconds = 0.0; // Time spent in EvaluateInstruction, excluding reading, the bitboard replay, verification and notation
+};
+
+// Headless replay of a PGN database through ChessGame::EvaluateInstruction, no actors and no rendering.
+// UnrealEditor-Cmd NajiExperience.uproject -run=ChessReplay -nullrhi -pgn=<path> [-maxgames=<n>] [-verify] [-chunkkb=<n>]
+// -verify compares the rules engine board with the bitboard after every move. Returns non zero on any rejected move or mismatch.
+UCLASS()
+class UChessReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UChessReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	void ReplayGame(const FChessPGNGame& game, bool verify);
+	bool ShouldLog() { return m_NumLogged++ < 20; }
+
+	FChessReplayStats m_Stats;
+	int32 m_NumLogged = 0;
+};
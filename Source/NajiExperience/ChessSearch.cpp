@@ -0,0 +1,786 @@
+
+
+
+#include "ChessSearch.h"
+
+#include "HAL/PlatformTime.h"
+#include "HAL/IConsoleManager.h"
+#include "Tasks/Task.h"
+
+namespace
+{
+	constexpr int32 PieceValues[EBitboardPiece::COUNT] = { 100, 320, 330, 500, 900, 0 };
+	constexpr int32 PiecePhase[EBitboardPiece::COUNT] = { 0, 1, 1, 2, 4, 0 };
+	constexpr int32 MAX_PHASE = 24;
+
+	// Piece square tables from white's point of view, rank 8 first
+	constexpr int32 PawnTable[BITBOARD_SQUARES] =
+	{
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		50, 50, 50, 50, 50, 50, 50, 50,
+		10, 10, 20, 30, 30, 20, 10, 10,
+		 5,  5, 10, 25, 25, 10,  5,  5,
+		 0,  0,  0, 20, 20,  0,  0,  0,
+		 5, -5,-10,  0,  0,-10, -5,  5,
+		 5, 10, 10,-20,-20, 10, 10,  5,
+		 0,  0,  0,  0,  0,  0,  0,  0,
+	};
+
+	constexpr int32 KnightTable[BITBOARD_SQUARES] =
+	{
+		-50,-40,-30,-30,-30,-30,-40,-50,
+		-40,-20,  0,  0,  0,  0,-20,-40,
+		-30,  0, 10, 15, 15, 10,  0,-30,
+		-30,  5, 15, 20, 20, 15,  5,-30,
+		-30,  0, 15, 20, 20, 15,  0,-30,
+		-30,  5, 10, 15, 15, 10,  5,-30,
+		-40,-20,  0,  5,  5,  0,-20,-40,
+		-50,-40,-30,-30,-30,-30,-40,-50,
+	};
+
+	constexpr int32 BishopTable[BITBOARD_SQUARES] =
+	{
+		-20,-10,-10,-10,-10,-10,-10,-20,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-10,  0,  5, 10, 10,  5,  0,-10,
+		-10,  5,  5, 10, 10,  5,  5,-10,
+		-10,  0, 10, 10, 10, 10,  0,-10,
+		-10, 10, 10, 10, 10, 10, 10,-10,
+		-10,  5,  0,  0,  0,  0,  5,-10,
+		-20,-10,-10,-10,-10,-10,-10,-20,
+	};
+
+	constexpr int32 RookTable[BITBOARD_SQUARES] =
+	{
+		 0,  0,  0,  0,  0,  0,  0,  0,
+		 5, 10, 10, 10, 10, 10, 10,  5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		-5,  0,  0,  0,  0,  0,  0, -5,
+		 0,  0,  0,  5,  5,  0,  0,  0,
+	};
+
+	constexpr int32 QueenTable[BITBOARD_SQUARES] =
+	{
+		-20,-10,-10, -5, -5,-10,-10,-20,
+		-10,  0,  0,  0,  0,  0,  0,-10,
+		-10,  0,  5,  5,  5,  5,  0,-10,
+		 -5,  0,  5,  5,  5,  5,  0, -5,
+		  0,  0,  5,  5,  5,  5,  0, -5,
+		-10,  5,  5,  5,  5,  5,  0,-10,
+		-10,  0,  5,  0,  0,  0,  0,-10,
+		-20,-10,-10, -5, -5,-10,-10,-20,
+	};
+
+	constexpr int32 KingMiddleTable[BITBOARD_SQUARES] =
+	{
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-30,-40,-40,-50,-50,-40,-40,-30,
+		-20,-30,-30,-40,-40,-30,-30,-20,
+		-10,-20,-20,-20,-20,-20,-20,-10,
+		 20, 20,  0,  0,  0,  0, 20, 20,
+		 20, 30, 10,  0,  0, 10, 30, 20,
+	};
+
+	constexpr int32 KingEndTable[BITBOARD_SQUARES] =
+	{
+		-50,-40,-30,-20,-20,-30,-40,-50,
+		-30,-20,-10,  0,  0,-10,-20,-30,
+		-30,-10, 20, 30, 30, 20,-10,-30,
+		-30,-10, 30, 40, 40, 30,-10,-30,
+		-30,-10, 30, 40, 40, 30,-10,-30,
+		-30,-10, 20, 30, 30, 20,-10,-30,
+		-30,-30,  0,  0,  0,  0,-30,-30,
+		-50,-30,-30,-30,-30,-30,-30,-50,
+	};
+
+	constexpr const int32* PieceTables[EBitboardPiece::COUNT] = { PawnTable, KnightTable, BishopTable, RookTable, QueenTable, KingMiddleTable };
+
+	FORCEINLINE int32 GetTableIndex(EChessSide::Type side, int32 square)
+	{
+		return side == EChessSide::White ? ((7 - GetSquareY(square)) * 8 + GetSquareX(square)) : square;
+	}
+
+	FORCEINLINE int32 ScoreToTT(int32 score, int32 ply)
+	{
+		return score >= SEARCH_MATE_BOUND ? score + ply : (score <= -SEARCH_MATE_BOUND ? score - ply : score);
+	}
+
+	FORCEINLINE int32 ScoreFromTT(int32 score, int32 ply)
+	{
+		return score >= SEARCH_MATE_BOUND ? score - ply : (score <= -SEARCH_MATE_BOUND ? score + ply : score);
+	}
+
+	FORCEINLINE EBitboardPiece::Type GetCapturedPiece(const FChessBitboardPosition& position, const FChessMove& move)
+	{
+		return (move.Flags & EChessMoveFlags::EnPassant) ? EBitboardPiece::Pawn : position.GetPiece(move.To);
+	}
+
+	// Slots are read and written concurrently by every search thread
+	FORCEINLINE uint64 LoadRelaxed(const uint64& value)
+	{
+		return std::atomic_ref<uint64>(const_cast<uint64&>(value)).load(std::memory_order_relaxed);
+	}
+
+	FORCEINLINE void StoreRelaxed(uint64& value, uint64 newValue)
+	{
+		std::atomic_ref<uint64>(value).store(newValue, std::memory_order_relaxed);
+	}
+
+	constexpr int32 TT_MOVE_SCORE = 1 << 30;
+	constexpr int32 CAPTURE_SCORE = 1 << 28;
+	constexpr int32 KILLER_SCORE = 1 << 26;
+
+	void PickMove(FChessMoveList& moves, TArray<int32, TInlineAllocator<256>>& scores, int32 start)
+	{
+		int32 bestIdx = start;
+		for (int32 i = start + 1; i < moves.Num(); ++i)
+		{
+			if (scores[i] > scores[bestIdx])
+				bestIdx = i;
+		}
+
+		if (bestIdx != start)
+		{
+			moves.Swap(start, bestIdx);
+			scores.Swap(start, bestIdx);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Transposition table
+FChessTranspositionTable::FChessTranspositionTable(int32 sizeMB)
+{
+	Resize(sizeMB);
+}
+
+void FChessTranspositionTable::Resize(int32 sizeMB)
+{
+	const uint64 bytes = static_cast<uint64>(FMath::Max(sizeMB, 1)) << 20;
+	const uint64 numSlots = 1ull << FMath::FloorLog2_64(bytes / sizeof(FSlot));
+
+	m_Slots.SetNumUninitialized(static_cast<int32>(numSlots));
+	m_Mask = numSlots - 1;
+	Clear();
+}
+
+void FChessTranspositionTable::Clear()
+{
+	FMemory::Memzero(m_Slots.GetData(), m_Slots.Num() * sizeof(FSlot));
+	m_Generation = 0;
+}
+
+// Data layout: move from/to/promotion (16) | score (16) | depth (8) | bound (2) | generation (6)
+bool FChessTranspositionTable::Probe(uint64 key, FChessTTEntry& outEntry) const
+{
+	const FSlot& slot = m_Slots[key & m_Mask];
+	const uint64 data = LoadRelaxed(slot.Data);
+	if (data == 0 || (LoadRelaxed(slot.Key) ^ data) != key)
+		return false;
+
+	outEntry.Move.From = data & 0x3F;
+	outEntry.Move.To = (data >> 6) & 0x3F;
+	outEntry.Move.Promotion = (data >> 12) & 0xF;
+	outEntry.Move.Flags = EChessMoveFlags::None;
+	outEntry.Score = static_cast<int16>((data >> 16) & 0xFFFF);
+	outEntry.Depth = (data >> 32) & 0xFF;
+	outEntry.Bound = static_cast<ETTBound::Type>((data >> 40) & 0x3);
+	return true;
+}
+
+void FChessTranspositionTable::Store(uint64 key, const FChessMove& move, int32 score, int32 depth, ETTBound::Type bound)
+{
+	FSlot& slot = m_Slots[key & m_Mask];
+	const uint64 slotData = LoadRelaxed(slot.Data);
+	const bool sameKey = slotData != 0 && (LoadRelaxed(slot.Key) ^ slotData) == key;
+
+	// Keep deeper results of the current search for other positions
+	const uint8 slotGeneration = (slotData >> 42) & 0x3F;
+	const int32 slotDepth = (slotData >> 32) & 0xFF;
+	if (!sameKey && slotData != 0 && slotGeneration == m_Generation && slotDepth > depth)
+		return;
+
+	// Keep the move of a previous store if this one has none
+	FChessMove storedMove = move;
+	if (storedMove.From == storedMove.To && sameKey)
+	{
+		storedMove.From = slotData & 0x3F;
+		storedMove.To = (slotData >> 6) & 0x3F;
+		storedMove.Promotion = (slotData >> 12) & 0xF;
+	}
+
+	const uint64 data = static_cast<uint64>(storedMove.From & 0x3F)
+		| (static_cast<uint64>(storedMove.To & 0x3F) << 6)
+		| (static_cast<uint64>(storedMove.Promotion & 0xF) << 12)
+		| (static_cast<uint64>(static_cast<uint16>(static_cast<int16>(score))) << 16)
+		| (static_cast<uint64>(FMath::Clamp(depth, 0, 255)) << 32)
+		| (static_cast<uint64>(bound & 0x3) << 40)
+		| (static_cast<uint64>(m_Generation & 0x3F) << 42);
+
+	// Two relaxed stores, another thread may interleave but then the XOR check rejects the slot
+	StoreRelaxed(slot.Key, key ^ data);
+	StoreRelaxed(slot.Data, data);
+}
+
+int32 FChessTranspositionTable::GetHashFull() const
+{
+	const int32 sample = FMath::Min(m_Slots.Num(), 1000);
+	int32 used = 0;
+	for (int32 i = 0; i < sample; ++i)
+	{
+		const uint64 data = LoadRelaxed(m_Slots[i].Data);
+		if (data != 0 && ((data >> 42) & 0x3F) == m_Generation)
+			++used;
+	}
+	return sample > 0 ? used * 1000 / sample : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Evaluation
+int32 EvaluatePosition(const FChessBitboardPosition& position)
+{
+	int32 middle[EChessSide::COUNT] = {};
+	int32 end[EChessSide::COUNT] = {};
+	int32 phase = 0;
+
+	for (uint8 side = 0; side < EChessSide::COUNT; ++side)
+	{
+		for (uint8 piece = 0; piece < EBitboardPiece::COUNT; ++piece)
+		{
+			uint64 pieces = position.Pieces[side][piece];
+			while (pieces)
+			{
+				const int32 tableIdx = GetTableIndex(static_cast<EChessSide::Type>(side), PopSquare(pieces));
+				phase += PiecePhase[piece];
+
+				if (piece == EBitboardPiece::King)
+				{
+					middle[side] += KingMiddleTable[tableIdx];
+					end[side] += KingEndTable[tableIdx];
+				}
+				else
+				{
+					const int32 value = PieceValues[piece] + PieceTables[piece][tableIdx];
+					middle[side] += value;
+					end[side] += value;
+				}
+			}
+		}
+	}
+
+	// Taper between middle game and end game by remaining material
+	phase = FMath::Min(phase, MAX_PHASE);
+	const int32 middleScore = middle[EChessSide::White] - middle[EChessSide::Black];
+	const int32 endScore = end[EChessSide::White] - end[EChessSide::Black];
+	const int32 score = (middleScore * phase + endScore * (MAX_PHASE - phase)) / MAX_PHASE;
+
+	return position.State.SideToMove == EChessSide::White ? score : -score;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Search
+FChessSearch::FChessSearch(FChessTranspositionTable& transpositionTable, std::atomic<bool>& stop, int32 threadIdx)
+	: m_TT(transpositionTable)
+	, m_Stop(stop)
+	, m_ThreadIdx(threadIdx)
+{
+	FMemory::Memzero(m_History);
+	FMemory::Memzero(m_PVLength);
+}
+
+FChessSearchResult FChessSearch::Search(const FChessBitboardPosition& root, const FChessSearchLimits& limits, TArrayView<const uint64> gameKeys)
+{
+	m_Limits = limits;
+	m_StartSeconds = FPlatformTime::Seconds();
+	m_Nodes = 0;
+
+	m_KeyStack.Reset();
+	m_KeyStack.Append(gameKeys.GetData(), gameKeys.Num());
+	m_RootKeyIdx = m_KeyStack.Num();
+	m_KeyStack.Add(root.Key);
+
+	for (auto& killers : m_Killers)
+	{
+		killers[0] = FChessMove();
+		killers[1] = FChessMove();
+	}
+
+	// History scores decay between searches rather than reset
+	for (auto& side : m_History)
+		for (auto& from : side)
+			for (int32& score : from)
+				score /= 8;
+
+	FChessSearchResult result;
+
+	FChessMoveList rootMoves;
+	GenerateLegalMoves(root, rootMoves);
+	if (rootMoves.Num() == 0)
+	{
+		result.Score = IsInCheck(root) ? -SEARCH_MATE : 0;
+		return result;
+	}
+
+	// Every underpromotion has its queen promotion, the list can't run empty
+	if (limits.NoRootUnderpromotions)
+		rootMoves.RemoveAll([](const FChessMove& move) { return move.IsUnderpromotion(); });
+
+	// Always have something to play, even if the first iteration gets cut short
+	result.BestMove = rootMoves[0];
+	result.HasMove = true;
+
+	// Odd helpers start one ply deeper so the threads don't all search the same tree in step
+	const int32 maxDepth = FMath::Clamp(limits.MaxDepth, 1, SEARCH_MAX_PLY - 1);
+	const int32 startDepth = FMath::Min(1 + (m_ThreadIdx & 1), maxDepth);
+	for (int32 depth = startDepth; depth <= maxDepth; ++depth)
+	{
+		const int32 score = SearchNode(root, depth, -SEARCH_INFINITE, SEARCH_INFINITE, 0, true, false);
+		if (IsStopped() && depth > startDepth)
+			break;
+
+		if (m_PVLength[0] > 0)
+		{
+			result.BestMove = m_PV[0][0];
+			result.PrincipalVariation.Reset();
+			result.PrincipalVariation.Append(&m_PV[0][0], m_PVLength[0]);
+		}
+
+		result.Score = score;
+		result.Depth = depth;
+
+		// A forced mate won't get any shorter
+		if (IsStopped() || FMath::Abs(score) >= SEARCH_MATE_BOUND)
+			break;
+	}
+
+	result.Nodes = m_Nodes;
+	result.Seconds = FPlatformTime::Seconds() - m_StartSeconds;
+	return result;
+}
+
+void FChessSearch::CheckLimits()
+{
+	if (m_Limits.MaxNodes > 0 && m_Nodes >= m_Limits.MaxNodes)
+		Stop();
+
+	if (m_Limits.MaxSeconds > 0.0 && FPlatformTime::Seconds() - m_StartSeconds >= m_Limits.MaxSeconds)
+		Stop();
+}
+
+bool FChessSearch::IsRepetition(const FChessBitboardPosition& position, int32 ply) const
+{
+	// Only positions since the last irreversible move can repeat
+	const int32 current = m_RootKeyIdx + ply;
+	const int32 oldest = FMath::Max(0, current - position.State.HalfmoveClock);
+	for (int32 i = current - 2; i >= oldest; i -= 2)
+	{
+		if (m_KeyStack[i] == position.Key)
+			return true;
+	}
+	return false;
+}
+
+void FChessSearch::ScoreMoves(const FChessBitboardPosition& position, const FChessMoveList& moves, const FChessMove& ttMove, int32 ply, TArray<int32, TInlineAllocator<256>>& outScores) const
+{
+	outScores.SetNumUninitialized(moves.Num());
+	for (int32 i = 0; i < moves.Num(); ++i)
+	{
+		const FChessMove& move = moves[i];
+		if (move == ttMove)
+		{
+			outScores[i] = TT_MOVE_SCORE;
+		}
+		else if (move.IsCapture() || move.Promotion != EBitboardPiece::None)
+		{
+			// MVV-LVA, promotions rank with queen captures
+			const int32 victim = move.IsCapture() ? PieceValues[GetCapturedPiece(position, move)] : 0;
+			const int32 promotion = move.Promotion != EBitboardPiece::None ? PieceValues[move.Promotion] : 0;
+			outScores[i] = CAPTURE_SCORE + (victim + promotion) * 16 - PieceValues[position.GetPiece(move.From)] / 16;
+		}
+		else if (move == m_Killers[ply][0])
+		{
+			outScores[i] = KILLER_SCORE + 1;
+		}
+		else if (move == m_Killers[ply][1])
+		{
+			outScores[i] = KILLER_SCORE;
+		}
+		else
+		{
+			outScores[i] = m_History[position.State.SideToMove][move.From][move.To];
+		}
+	}
+}
+
+int32 FChessSearch::SearchNode(const FChessBitboardPosition& position, int32 depth, int32 alpha, int32 beta, int32 ply, bool pvNode, bool allowNull)
+{
+	m_PVLength[ply] = 0;
+
+	if ((++m_Nodes & 2047) == 0)
+		CheckLimits();
+
+	if (IsStopped())
+		return 0;
+
+	if (ply > 0)
+	{
+		if (position.State.HalfmoveClock >= 100 || IsRepetition(position, ply))
+			return 0;
+
+		// Mate distance pruning
+		alpha = FMath::Max(alpha, -SEARCH_MATE + ply);
+		beta = FMath::Min(beta, SEARCH_MATE - ply - 1);
+		if (alpha >= beta)
+			return alpha;
+	}
+
+	if (ply >= SEARCH_MAX_PLY - 1)
+		return EvaluatePosition(position);
+
+	const bool inCheck = IsInCheck(position);
+	if (inCheck)
+		++depth;
+
+	if (depth <= 0)
+		return Quiescence(position, alpha, beta, ply);
+
+	FChessMove ttMove;
+	FChessTTEntry ttEntry;
+	if (m_TT.Probe(position.Key, ttEntry))
+	{
+		ttMove = ttEntry.Move;
+		const int32 ttScore = ScoreFromTT(ttEntry.Score, ply);
+		if (!pvNode && ttEntry.Depth >= depth)
+		{
+			if (ttEntry.Bound == ETTBound::Exact
+				|| (ttEntry.Bound == ETTBound::Lower && ttScore >= beta)
+				|| (ttEntry.Bound == ETTBound::Upper && ttScore <= alpha))
+			{
+				return ttScore;
+			}
+		}
+	}
+
+	// Null move pruning, skipped without pieces to avoid zugzwang blunders
+	const EChessSide::Type us = position.State.SideToMove;
+	const uint64 nonPawnMaterial = position.Occupancy[us] & ~(position.Pieces[us][EBitboardPiece::Pawn] | position.Pieces[us][EBitboardPiece::King]);
+	if (allowNull && !pvNode && !inCheck && depth >= 3 && nonPawnMaterial && EvaluatePosition(position) >= beta)
+	{
+		FChessBitboardPosition nullPosition = position;
+		MakeNullMove(nullPosition);
+		m_KeyStack.Add(nullPosition.Key);
+		const int32 reduction = depth >= 6 ? 3 : 2;
+		const int32 nullScore = -SearchNode(nullPosition, depth - 1 - reduction, -beta, -beta + 1, ply + 1, false, false);
+		m_KeyStack.Pop(EAllowShrinking::No);
+
+		if (IsStopped())
+			return 0;
+
+		if (nullScore >= beta)
+			return nullScore >= SEARCH_MATE_BOUND ? beta : nullScore;
+	}
+
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+	if (moves.Num() == 0)
+		return inCheck ? -SEARCH_MATE + ply : 0;
+
+	if (ply == 0 && m_Limits.NoRootUnderpromotions)
+		moves.RemoveAllSwap([](const FChessMove& move) { return move.IsUnderpromotion(); }, EAllowShrinking::No);
+
+	TArray<int32, TInlineAllocator<256>> scores;
+	ScoreMoves(position, moves, ttMove, ply, scores);
+
+	const int32 originalAlpha = alpha;
+	int32 bestScore = -SEARCH_INFINITE;
+	FChessMove bestMove;
+
+	for (int32 i = 0; i < moves.Num(); ++i)
+	{
+		PickMove(moves, scores, i);
+		const FChessMove move = moves[i];
+		const bool isQuiet = !move.IsCapture() && move.Promotion == EBitboardPiece::None;
+
+		FChessBitboardPosition child = position;
+		MakeMove(child, move);
+		m_KeyStack.Add(child.Key);
+
+		int32 score = 0;
+		if (i == 0)
+		{
+			score = -SearchNode(child, depth - 1, -beta, -alpha, ply + 1, pvNode, true);
+		}
+		else
+		{
+			// Late move reductions for quiet moves that ordering ranked low
+			const int32 reduction = (depth >= 3 && i >= 4 && isQuiet && !inCheck && scores[i] < KILLER_SCORE) ? (i >= 12 ? 2 : 1) : 0;
+			score = -SearchNode(child, depth - 1 - reduction, -alpha - 1, -alpha, ply + 1, false, true);
+
+			if (score > alpha && reduction > 0)
+				score = -SearchNode(child, depth - 1, -alpha - 1, -alpha, ply + 1, false, true);
+
+			if (score > alpha && score < beta)
+				score = -SearchNode(child, depth - 1, -beta, -alpha, ply + 1, true, true);
+		}
+
+		m_KeyStack.Pop(EAllowShrinking::No);
+
+		if (IsStopped())
+			return 0;
+
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestMove = move;
+
+			if (score > alpha)
+			{
+				alpha = score;
+
+				m_PV[ply][0] = move;
+				const int32 childLength = FMath::Min(m_PVLength[ply + 1], SEARCH_MAX_PLY - 1);
+				for (int32 j = 0; j < childLength; ++j)
+					m_PV[ply][j + 1] = m_PV[ply + 1][j];
+				m_PVLength[ply] = childLength + 1;
+
+				if (alpha >= beta)
+				{
+					if (isQuiet)
+					{
+						if (m_Killers[ply][0] != move)
+						{
+							m_Killers[ply][1] = m_Killers[ply][0];
+							m_Killers[ply][0] = move;
+						}
+
+						int32& history = m_History[us][move.From][move.To];
+						history = FMath::Min(history + depth * depth, KILLER_SCORE - 1);
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	const ETTBound::Type bound = bestScore >= beta ? ETTBound::Lower : (bestScore > originalAlpha ? ETTBound::Exact : ETTBound::Upper);
+	m_TT.Store(position.Key, bestMove, ScoreToTT(bestScore, ply), depth, bound);
+
+	return bestScore;
+}
+
+int32 FChessSearch::Quiescence(const FChessBitboardPosition& position, int32 alpha, int32 beta, int32 ply)
+{
+	m_PVLength[ply] = 0;
+
+	if ((++m_Nodes & 2047) == 0)
+		CheckLimits();
+
+	if (IsStopped())
+		return 0;
+
+	if (ply >= SEARCH_MAX_PLY - 1)
+		return EvaluatePosition(position);
+
+	// In check every evasion is searched, otherwise the side to move may stand pat
+	const bool inCheck = IsInCheck(position);
+	int32 bestScore = -SEARCH_INFINITE;
+	if (!inCheck)
+	{
+		bestScore = EvaluatePosition(position);
+		if (bestScore >= beta)
+			return bestScore;
+
+		alpha = FMath::Max(alpha, bestScore);
+	}
+
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+	if (moves.Num() == 0)
+		return inCheck ? -SEARCH_MATE + ply : 0;
+
+	if (!inCheck)
+	{
+		moves.RemoveAllSwap([](const FChessMove& move) { return !move.IsCapture() && move.Promotion != EBitboardPiece::Queen; }, EAllowShrinking::No);
+	}
+
+	TArray<int32, TInlineAllocator<256>> scores;
+	ScoreMoves(position, moves, FChessMove(), ply, scores);
+
+	for (int32 i = 0; i < moves.Num(); ++i)
+	{
+		PickMove(moves, scores, i);
+
+		FChessBitboardPosition child = position;
+		MakeMove(child, moves[i]);
+		const int32 score = -Quiescence(child, -beta, -alpha, ply + 1);
+
+		if (IsStopped())
+			return 0;
+
+		if (score > bestScore)
+		{
+			bestScore = score;
+			if (score > alpha)
+			{
+				alpha = score;
+				if (alpha >= beta)
+					break;
+			}
+		}
+	}
+
+	return bestScore;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parallel search
+FChessParallelSearch::FChessParallelSearch(FChessTranspositionTable& transpositionTable, int32 numThreads)
+	: m_TT(transpositionTable)
+	, m_Stop(false)
+{
+	SetNumThreads(numThreads);
+}
+
+void FChessParallelSearch::SetNumThreads(int32 numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+
+	numThreads = FMath::Clamp(numThreads, 1, 256);
+	while (m_Workers.Num() > numThreads)
+	{
+		m_Workers.Pop();
+	}
+
+	while (m_Workers.Num() < numThreads)
+	{
+		m_Workers.Add(MakeUnique<FChessSearch>(m_TT, m_Stop, m_Workers.Num()));
+	}
+}
+
+FChessSearchResult FChessParallelSearch::Search(const FChessBitboardPosition& root, const FChessSearchLimits& limits, TArrayView<const uint64> gameKeys)
+{
+	m_Stop.store(false, std::memory_order_relaxed);
+	m_TT.NewSearch();
+
+	// The node budget is split, every thread only counts its own nodes
+	FChessSearchLimits workerLimits = limits;
+	if (limits.MaxNodes > 0)
+		workerLimits.MaxNodes = FMath::Max<uint64>(limits.MaxNodes / m_Workers.Num(), 1);
+
+	TArray<UE::Tasks::FTask> helpers;
+	helpers.Reserve(m_Workers.Num() - 1);
+	for (int32 i = 1; i < m_Workers.Num(); ++i)
+	{
+		FChessSearch* worker = m_Workers[i].Get();
+		helpers.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [worker, &root, &workerLimits, gameKeys]()
+		{
+			worker->Search(root, workerLimits, gameKeys);
+		}));
+	}
+
+	FChessSearchResult result = m_Workers[0]->Search(root, workerLimits, gameKeys);
+
+	// Helpers that never got a worker run inline here and return immediately
+	Stop();
+	UE::Tasks::Wait(helpers);
+
+	result.Nodes = 0;
+	for (const TUniquePtr<FChessSearch>& worker : m_Workers)
+	{
+		result.Nodes += worker->GetNodes();
+	}
+
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+namespace
+{
+	const TCHAR* BenchmarkPositions[] =
+	{
+		TEXT("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"),
+		TEXT("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"),
+		TEXT("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"),
+		TEXT("r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N2N2/PP2BPPP/R2QKB1R w KQ - 0 8"),
+		TEXT("2r2rk1/pp1bqppp/2nbpn2/3p4/3P4/2PBPN2/PPQN1PPP/R4RK1 b - - 3 12"),
+		TEXT("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"),
+	};
+}
+
+void RunSearchBenchmark(double secondsPerPosition, int32 hashSizeMB, TArrayView<const int32> threadCounts, TArray<FChessSearchBenchmarkResult>& outResults)
+{
+	outResults.Reset();
+
+	TArray<FChessBitboardPosition> positions;
+	for (const TCHAR* fen : BenchmarkPositions)
+	{
+		FChessBitboardPosition position;
+		verify(ParseFEN(fen, position));
+		positions.Add(position);
+	}
+
+	FChessSearchLimits limits;
+	limits.MaxSeconds = secondsPerPosition;
+
+	for (int32 numThreads : threadCounts)
+	{
+		FChessTranspositionTable transpositionTable(hashSizeMB);
+		FChessParallelSearch search(transpositionTable, numThreads);
+
+		FChessSearchBenchmarkResult& row = outResults.AddDefaulted_GetRef();
+		row.NumThreads = search.GetNumThreads();
+
+		int32 totalDepth = 0;
+		for (const FChessBitboardPosition& position : positions)
+		{
+			transpositionTable.Clear();
+			const FChessSearchResult result = search.Search(position, limits, TArrayView<const uint64>());
+			row.Nodes += result.Nodes;
+			row.Seconds += result.Seconds;
+			totalDepth += result.Depth;
+		}
+
+		row.NodesPerSecond = row.Seconds > 0.0 ? row.Nodes / row.Seconds : 0.0;
+		row.AverageDepth = static_cast<double>(totalDepth) / positions.Num();
+	}
+}
+
+static FAutoConsoleCommand ChessSearchBenchmarkCommand(
+	TEXT("Chess.AI.Benchmark"),
+	TEXT("Measures search scaling per thread count. Args: [SecondsPerPosition=2] [MaxThreads=hardware threads] [HashMB=64]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& args)
+	{
+		const double seconds = args.Num() > 0 ? FCString::Atod(*args[0]) : 2.0;
+		const int32 maxThreads = args.Num() > 1 ? FCString::Atoi(*args[1]) : FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+		const int32 hashSizeMB = args.Num() > 2 ? FCString::Atoi(*args[2]) : 64;
+
+		TArray<int32> threadCounts;
+		for (int32 numThreads = 1; numThreads < maxThreads; numThreads *= 2)
+		{
+			threadCounts.Add(numThreads);
+		}
+		threadCounts.Add(FMath::Max(maxThreads, 1));
+
+		// Runs for a while, keep it off the game thread
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, [seconds, hashSizeMB, threadCounts = MoveTemp(threadCounts)]()
+		{
+			TArray<FChessSearchBenchmarkResult> results;
+			RunSearchBenchmark(seconds, hashSizeMB, threadCounts, results);
+
+			const double baseNodesPerSecond = results.Num() > 0 ? results[0].NodesPerSecond : 0.0;
+			UE_LOG(LogTemp, Display, TEXT("Chess search benchmark, %.1fs per position"), seconds);
+			for (const FChessSearchBenchmarkResult& row : results)
+			{
+				const double speedup = baseNodesPerSecond > 0.0 ? row.NodesPerSecond / baseNodesPerSecond : 0.0;
+				UE_LOG(LogTemp, Display, TEXT("  threads %3d  knps %10.0f  speedup %6.2fx  efficiency %5.1f%%  avg depth %5.2f"),
+					row.NumThreads, row.NodesPerSecond / 1000.0, speedup, speedup * 100.0 / row.NumThreads, row.AverageDepth);
+			}
+		});
+	}));
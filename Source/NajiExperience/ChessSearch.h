@@ -0,0 +1,161 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ChessBitboard.h"
+
+#include <atomic>
+
+constexpr int32 SEARCH_MAX_PLY = 96;
+constexpr int32 SEARCH_INFINITE = 32001;
+constexpr int32 SEARCH_MATE = 32000;
+constexpr int32 SEARCH_MATE_BOUND = SEARCH_MATE - SEARCH_MAX_PLY;
+
+namespace ETTBound
+{
+	enum Type : uint8
+	{
+		None,
+		Upper,
+		Lower,
+		Exact
+	};
+}
+
+struct FChessTTEntry
+{
+	FChessMove Move;
+	int32 Score = 0;
+	int32 Depth = 0;
+	ETTBound::Type Bound = ETTBound::None;
+};
+
+// Fixed size transposition table, one key and one packed data word per slot.
+// Shared lock free between search threads: the key is stored XORed with the data so a torn write fails verification on probe.
+class FChessTranspositionTable
+{
+public:
+	explicit FChessTranspositionTable(int32 sizeMB = 16);
+
+	void Resize(int32 sizeMB);
+	void Clear();
+	// Not thread safe, call before any search thread starts
+	void NewSearch() { m_Generation = (m_Generation + 1) & 0x3F; }
+
+	bool Probe(uint64 key, FChessTTEntry& outEntry) const;
+	void Store(uint64 key, const FChessMove& move, int32 score, int32 depth, ETTBound::Type bound);
+
+	// Permille of slots written during the current search
+	int32 GetHashFull() const;
+
+private:
+	struct FSlot
+	{
+		uint64 Key;
+		uint64 Data;
+	};
+
+	TArray<FSlot> m_Slots;
+	uint64 m_Mask = 0;
+	uint8 m_Generation = 0;
+};
+
+struct FChessSearchLimits
+{
+	double MaxSeconds = 1.0; // <= 0 for no time limit
+	uint64 MaxNodes = 0; // 0 for no node limit
+	int32 MaxDepth = SEARCH_MAX_PLY - 1;
+	bool NoRootUnderpromotions = false; // For players that can only promote to a queen, deeper plies still consider them
+};
+
+struct FChessSearchResult
+{
+	FChessMove BestMove;
+	bool HasMove = false;
+	int32 Score = 0;
+	int32 Depth = 0;
+	uint64 Nodes = 0;
+	double Seconds = 0.0;
+	TArray<FChessMove> PrincipalVariation;
+};
+
+// Static evaluation from the point of view of the side to move, in centipawns
+int32 EvaluatePosition(const FChessBitboardPosition& position);
+
+// Iterative deepening principal variation search with quiescence on one thread.
+// Run one instance per thread, instances share the transposition table and the stop flag.
+class FChessSearch
+{
+public:
+	FChessSearch(FChessTranspositionTable& transpositionTable, std::atomic<bool>& stop, int32 threadIdx = 0);
+
+	// gameKeys are the keys of the positions played so far, for repetition detection
+	FChessSearchResult Search(const FChessBitboardPosition& root, const FChessSearchLimits& limits, TArrayView<const uint64> gameKeys);
+
+	// Safe to call from any thread, the search returns its best completed iteration
+	void Stop() { m_Stop.store(true, std::memory_order_relaxed); }
+	bool IsStopped() const { return m_Stop.load(std::memory_order_relaxed); }
+
+	uint64 GetNodes() const { return m_Nodes; }
+
+private:
+	int32 SearchNode(const FChessBitboardPosition& position, int32 depth, int32 alpha, int32 beta, int32 ply, bool pvNode, bool allowNull);
+	int32 Quiescence(const FChessBitboardPosition& position, int32 alpha, int32 beta, int32 ply);
+
+	void ScoreMoves(const FChessBitboardPosition& position, const FChessMoveList& moves, const FChessMove& ttMove, int32 ply, TArray<int32, TInlineAllocator<256>>& outScores) const;
+	bool IsRepetition(const FChessBitboardPosition& position, int32 ply) const;
+	void CheckLimits();
+
+	FChessTranspositionTable& m_TT;
+	std::atomic<bool>& m_Stop;
+	int32 m_ThreadIdx;
+
+	FChessSearchLimits m_Limits;
+	double m_StartSeconds = 0.0;
+	uint64 m_Nodes = 0;
+
+	TArray<uint64> m_KeyStack; // Game keys followed by the keys of the current search path
+	int32 m_RootKeyIdx = 0;
+
+	FChessMove m_Killers[SEARCH_MAX_PLY][2];
+	int32 m_History[EChessSide::COUNT][BITBOARD_SQUARES][BITBOARD_SQUARES];
+
+	FChessMove m_PV[SEARCH_MAX_PLY][SEARCH_MAX_PLY];
+	int32 m_PVLength[SEARCH_MAX_PLY];
+};
+
+// Lazy SMP: every thread runs its own iterative deepening from the same root and they only cooperate through the transposition table.
+// Thread 0 owns the time control and the result, helpers stop with it.
+class FChessParallelSearch
+{
+public:
+	// 0 threads uses every hardware thread
+	explicit FChessParallelSearch(FChessTranspositionTable& transpositionTable, int32 numThreads = 0);
+
+	void SetNumThreads(int32 numThreads);
+	int32 GetNumThreads() const { return m_Workers.Num(); }
+
+	// Blocks the calling thread until thread 0 is done, helpers run as UE tasks
+	FChessSearchResult Search(const FChessBitboardPosition& root, const FChessSearchLimits& limits, TArrayView<const uint64> gameKeys);
+
+	void Stop() { m_Stop.store(true, std::memory_order_relaxed); }
+	bool IsStopped() const { return m_Stop.load(std::memory_order_relaxed); }
+
+private:
+	FChessTranspositionTable& m_TT;
+	std::atomic<bool> m_Stop;
+	TArray<TUniquePtr<FChessSearch>> m_Workers;
+};
+
+struct FChessSearchBenchmarkResult
+{
+	int32 NumThreads = 0;
+	uint64 Nodes = 0;
+	double Seconds = 0.0;
+	double NodesPerSecond = 0.0;
+	double AverageDepth = 0.0;
+};
+
+// Fixed time searches over a set of middle game positions, once per thread count, each with a fresh table
+void RunSearchBenchmark(double secondsPerPosition, int32 hashSizeMB, TArrayView<const int32> threadCounts, TArray<FChessSearchBenchmarkResult>& outResults);
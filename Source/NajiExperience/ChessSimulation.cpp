@@ -0,0 +1,311 @@
+
+
+
+#include "ChessSimulation.h"
+
+#include "ChessExperience.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+#include "Tasks/Task.h"
+
+namespace
+{
+	uint32 NextRandom(uint32& state)
+	{
+		// xorshift32, the state is never 0
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	bool IsThreefoldRepetition(const TArray<uint64>& keys, int32 halfmoveClock)
+	{
+		// Only positions with the same side to move since the last capture or pawn move can repeat
+		const uint64 key = keys.Last();
+		const int32 firstIdx = FMath::Max(keys.Num() - 1 - halfmoveClock, 0);
+		int32 count = 1;
+		for (int32 i = keys.Num() - 3; i >= firstIdx; i -= 2)
+		{
+			if (keys[i] == key && ++count >= 3)
+				return true;
+		}
+		return false;
+	}
+
+	bool IsInsufficientMaterial(const FChessBitboardPosition& position)
+	{
+		for (int32 side = 0; side < EChessSide::COUNT; ++side)
+		{
+			if (position.Pieces[side][EBitboardPiece::Pawn] | position.Pieces[side][EBitboardPiece::Rook] | position.Pieces[side][EBitboardPiece::Queen])
+				return false;
+		}
+
+		// At most a single minor piece each, adjudicated even where a helpmate would exist
+		return FMath::CountBits(position.Occupancy[EChessSide::White]) <= 2 && FMath::CountBits(position.Occupancy[EChessSide::Black]) <= 2;
+	}
+}
+
+void FChessSimulationStats::Accumulate(const FChessSimulationStats& other)
+{
+	Games += other.Games;
+	for (int32 result = 0; result < EChessSimulationResult::COUNT; ++result)
+	{
+		Results[result] += other.Results[result];
+	}
+	Plies += other.Plies;
+	Nodes += other.Nodes;
+	Seconds = FMath::Max(Seconds, other.Seconds);
+}
+
+FChessSimulationHost::FChessSimulationHost(const FChessSimulationConfig& config)
+	: m_Config(config)
+	, m_TT(config.HashSizeMB)
+	, m_Stop(false)
+	, m_NextGame(0)
+	, m_FinishedGames(0)
+{
+	verify(ParseFEN(START_POSITION_FEN, m_StartPosition));
+
+	m_Config.NumGames = FMath::Max(m_Config.NumGames, 0);
+	m_Config.NumSlots = FMath::Clamp(m_Config.NumSlots, 1, FMath::Max(m_Config.NumGames, 1));
+	m_Config.MaxPlies = FMath::Max(m_Config.MaxPlies, 1);
+
+	int32 numWorkers = m_Config.NumWorkers > 0 ? m_Config.NumWorkers : FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+	numWorkers = FMath::Clamp(numWorkers, 1, m_Config.NumSlots);
+
+	m_Slots.SetNum(m_Config.NumSlots);
+	for (FGameSlot& slot : m_Slots)
+	{
+		slot.Keys.Reserve(m_Config.MaxPlies + 1);
+	}
+
+	for (int32 workerIdx = 0; workerIdx < numWorkers; ++workerIdx)
+	{
+		FWorker& worker = *m_Workers.Add_GetRef(MakeUnique<FWorker>());
+		worker.Slots.Reserve(2 * m_Config.NumSlots / numWorkers + 1);
+		worker.Search = MakeUnique<FChessSearch>(m_TT, worker.SearchStop);
+	}
+}
+
+void FChessSimulationHost::Stop()
+{
+	m_Stop.store(true, std::memory_order_relaxed);
+	for (TUniquePtr<FWorker>& worker : m_Workers)
+	{
+		worker->SearchStop.store(true, std::memory_order_relaxed);
+	}
+}
+
+FChessSimulationStats FChessSimulationHost::Run()
+{
+	m_Stop.store(false, std::memory_order_relaxed);
+	m_NextGame.store(0, std::memory_order_relaxed);
+	m_FinishedGames.store(0, std::memory_order_relaxed);
+	m_TT.Clear();
+
+	for (TUniquePtr<FWorker>& worker : m_Workers)
+	{
+		worker->Slots.Reset();
+		worker->Head = 0;
+	}
+
+	// Contiguous slot ranges per worker, each worker stays on its own part of the arena until it runs dry
+	for (int32 slotIdx = 0; slotIdx < m_Slots.Num() && StartGame(m_Slots[slotIdx]); ++slotIdx)
+	{
+		m_Workers[slotIdx * m_Workers.Num() / m_Slots.Num()]->Slots.Add(slotIdx);
+	}
+
+	TArray<FChessSimulationStats> workerStats;
+	workerStats.SetNum(m_Workers.Num());
+
+	const double startSeconds = FPlatformTime::Seconds();
+
+	TArray<UE::Tasks::FTask> helpers;
+	helpers.Reserve(m_Workers.Num() - 1);
+	for (int32 workerIdx = 1; workerIdx < m_Workers.Num(); ++workerIdx)
+	{
+		helpers.Add(UE::Tasks::Launch(UE_SOURCE_LOCATION, [this, workerIdx, &workerStats]()
+		{
+			RunWorker(workerIdx, workerStats[workerIdx]);
+		}));
+	}
+
+	RunWorker(0, workerStats[0]);
+	UE::Tasks::Wait(helpers);
+
+	FChessSimulationStats stats;
+	for (const FChessSimulationStats& workerStat : workerStats)
+	{
+		stats.Accumulate(workerStat);
+	}
+	stats.Seconds = FPlatformTime::Seconds() - startSeconds;
+	return stats;
+}
+
+void FChessSimulationHost::RunWorker(int32 workerIdx, FChessSimulationStats& outStats)
+{
+	FWorker& worker = *m_Workers[workerIdx];
+	double reportSeconds = FPlatformTime::Seconds();
+
+	int32 slotIdx = INDEX_NONE;
+	while (!m_Stop.load(std::memory_order_relaxed) && PopSlot(workerIdx, slotIdx))
+	{
+		FGameSlot& slot = m_Slots[slotIdx];
+
+		EChessSimulationResult::Type result = EChessSimulationResult::Draw;
+		if (PlayMove(slot, worker, outStats, result))
+		{
+			PushSlot(workerIdx, slotIdx);
+			continue;
+		}
+
+		++outStats.Games;
+		++outStats.Results[result];
+		outStats.Plies += slot.Keys.Num() - 1;
+		const int64 finishedGames = m_FinishedGames.fetch_add(1, std::memory_order_relaxed) + 1;
+
+		// The slot takes the next game while any is left
+		if (StartGame(slot))
+			PushSlot(workerIdx, slotIdx);
+
+		const double nowSeconds = FPlatformTime::Seconds();
+		if (workerIdx == 0 && nowSeconds - reportSeconds > 5.0)
+		{
+			reportSeconds = nowSeconds;
+			UE_LOG(LogTemp, Display, TEXT("%lld of %d games played"), finishedGames, m_Config.NumGames);
+		}
+	}
+}
+
+bool FChessSimulationHost::PopSlot(int32 workerIdx, int32& outSlotIdx)
+{
+	{
+		FWorker& worker = *m_Workers[workerIdx];
+		FScopeLock lock(&worker.Lock);
+		if (worker.Head < worker.Slots.Num())
+		{
+			outSlotIdx = worker.Slots[worker.Head++];
+
+			// Slots cycle through the queue, drop the consumed front once it's half of the array
+			if (worker.Head * 2 >= worker.Slots.Num())
+			{
+				worker.Slots.RemoveAt(0, worker.Head, EAllowShrinking::No);
+				worker.Head = 0;
+			}
+			return true;
+		}
+	}
+
+	// Steal from the back, the slots the victim would get to last. A worker leaves once there is nothing left to steal,
+	// the slots still in flight go back to the queues of the workers playing them.
+	for (int32 offset = 1; offset < m_Workers.Num(); ++offset)
+	{
+		FWorker& victim = *m_Workers[(workerIdx + offset) % m_Workers.Num()];
+		FScopeLock lock(&victim.Lock);
+		if (victim.Head < victim.Slots.Num())
+		{
+			outSlotIdx = victim.Slots.Pop(EAllowShrinking::No);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FChessSimulationHost::PushSlot(int32 workerIdx, int32 slotIdx)
+{
+	FWorker& worker = *m_Workers[workerIdx];
+	FScopeLock lock(&worker.Lock);
+	worker.Slots.Add(slotIdx);
+}
+
+bool FChessSimulationHost::StartGame(FGameSlot& slot)
+{
+	const int32 gameIdx = m_NextGame.fetch_add(1, std::memory_order_relaxed);
+	if (gameIdx >= m_Config.NumGames)
+	{
+		slot.GameIdx = INDEX_NONE;
+		return false;
+	}
+
+	AChessGame::SetupGame(nullptr, nullptr, slot.Game);
+	slot.Position = m_StartPosition;
+	slot.Keys.Reset();
+	slot.Keys.Add(slot.Position.Key);
+	slot.GameIdx = gameIdx;
+
+	// Seeded per game, the openings don't depend on which worker picks a game up
+	slot.Random = (m_Config.Seed * 0x9E3779B9u) ^ (static_cast<uint32>(gameIdx) * 0x85EBCA6Bu);
+	slot.Random = slot.Random != 0 ? slot.Random : 1;
+	return true;
+}
+
+bool FChessSimulationHost::PlayMove(FGameSlot& slot, FWorker& worker, FChessSimulationStats& stats, EChessSimulationResult::Type& outResult)
+{
+	FChessBitboardPosition& position = slot.Position;
+
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+	if (moves.Num() == 0)
+	{
+		if (!IsInCheck(position))
+			outResult = EChessSimulationResult::Draw;
+		else
+			outResult = position.State.SideToMove == EChessSide::White ? EChessSimulationResult::BlackWin : EChessSimulationResult::WhiteWin;
+		return false;
+	}
+
+	// The rules engine always queens, an underpromotion would leave the slot board and the bitboard apart
+	moves.RemoveAll([](const FChessMove& legalMove) { return legalMove.Promotion != EBitboardPiece::None && legalMove.Promotion != EBitboardPiece::Queen; });
+
+	const int32 ply = slot.Keys.Num() - 1;
+	if (ply >= m_Config.MaxPlies || position.State.HalfmoveClock >= 100 || IsThreefoldRepetition(slot.Keys, position.State.HalfmoveClock) || IsInsufficientMaterial(position))
+	{
+		outResult = EChessSimulationResult::Draw;
+		return false;
+	}
+
+	FChessMove move = moves[0];
+	if (ply < m_Config.RandomOpeningPlies)
+	{
+		move = moves[NextRandom(slot.Random) % moves.Num()];
+	}
+	else
+	{
+		FChessSearchLimits limits;
+		limits.MaxSeconds = 0.0;
+		limits.MaxNodes = FMath::Max<uint64>(m_Config.NodesPerMove, 1);
+
+		// Rearmed for every move unless the host was stopped. The search adds the root key itself.
+		worker.SearchStop.store(m_Stop.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		const FChessSearchResult result = worker.Search->Search(position, limits, MakeArrayView(slot.Keys.GetData(), slot.Keys.Num() - 1));
+		stats.Nodes += worker.Search->GetNodes();
+		if (result.HasMove)
+		{
+			move = result.BestMove;
+			if (move.Promotion != EBitboardPiece::None)
+				move.Promotion = EBitboardPiece::Queen;
+		}
+	}
+
+	const int32 historyNum = slot.Game.GetHistory().Num();
+	slot.Game.EvaluateInstruction(MakeMoveInstruction(move));
+	if (slot.Game.GetHistory().Num() <= historyNum)
+	{
+		outResult = EChessSimulationResult::Aborted;
+		return false;
+	}
+
+	MakeMove(position, move);
+
+	// A promotion is where the two boards could still disagree on a piece type
+	if (move.Promotion != EBitboardPiece::None && !MatchesGameBoard(slot.Game, position))
+	{
+		outResult = EChessSimulationResult::Aborted;
+		return false;
+	}
+
+	slot.Keys.Add(position.Key);
+	return true;
+}
@@ -0,0 +1,105 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Chess3D/Public/ChessGame.h"
+#include "ChessBitboard.h"
+#include "ChessSearch.h"
+#include "HAL/CriticalSection.h"
+
+#include <atomic>
+
+struct FChessSimulationConfig
+{
+	int32 NumGames = 1000; // Games played in total
+	int32 NumSlots = 256; // Games in flight, each slot is reused for the next game once its game ends
+	int32 NumWorkers = 0; // 0 for every hardware thread
+	uint64 NodesPerMove = 5000; // Node budget instead of a clock, so the playing strength doesn't depend on the machine or its load
+	int32 MaxPlies = 400; // Longer games are adjudicated as draws
+	int32 RandomOpeningPlies = 6; // Random moves at the start of every game so self-play doesn't repeat one game
+	int32 HashSizeMB = 64; // Shared by every worker
+	uint32 Seed = 1;
+};
+
+namespace EChessSimulationResult
+{
+	enum Type : uint8
+	{
+		WhiteWin,
+		BlackWin,
+		Draw,
+		Aborted, // The rules engine refused a move the bitboard considered legal, or its board went apart from the bitboard
+
+		COUNT
+	};
+}
+
+struct FChessSimulationStats
+{
+	int64 Games = 0;
+	int64 Results[EChessSimulationResult::COUNT] = {};
+	int64 Plies = 0;
+	uint64 Nodes = 0;
+	double Seconds = 0.0;
+
+	double GetGamesPerSecond() const { return Seconds > 0.0 ? Games / Seconds : 0.0; }
+	double GetAverageLength() const { return Games > 0 ? static_cast<double>(Plies) / Games : 0.0; }
+	void Accumulate(const FChessSimulationStats& other);
+};
+
+// Headless AI self-play over a pooled arena of rules engine games, no actors or rendering.
+// Every worker owns a queue of slots and plays one move per slot in turn, idle workers steal slots from the back of other queues.
+class FChessSimulationHost
+{
+public:
+	explicit FChessSimulationHost(const FChessSimulationConfig& config);
+
+	// Blocks until every game is played, the calling thread works as worker 0
+	FChessSimulationStats Run();
+	// Safe to call from any thread, searches in progress return early
+	void Stop();
+
+	int64 GetFinishedGames() const { return m_FinishedGames.load(std::memory_order_relaxed); }
+	int32 GetNumWorkers() const { return m_Workers.Num(); }
+	const FChessSimulationConfig& GetConfig() const { return m_Config; }
+
+private:
+	struct FGameSlot
+	{
+		ChessGame Game;
+		FChessBitboardPosition Position;
+		TArray<uint64> Keys; // Every position of the game, for repetitions and the search
+		uint32 Random = 0;
+		int32 GameIdx = INDEX_NONE;
+	};
+
+	struct FWorker
+	{
+		FCriticalSection Lock;
+		TArray<int32> Slots;
+		int32 Head = 0; // Owner pops from the head, thieves from the tail
+
+		// Node limits stop a search through its flag, so every worker needs its own
+		std::atomic<bool> SearchStop { false };
+		TUniquePtr<FChessSearch> Search;
+	};
+
+	void RunWorker(int32 workerIdx, FChessSimulationStats& outStats);
+	bool PopSlot(int32 workerIdx, int32& outSlotIdx);
+	void PushSlot(int32 workerIdx, int32 slotIdx);
+
+	// Returns false once the game ended, with the result in outResult
+	bool PlayMove(FGameSlot& slot, FWorker& worker, FChessSimulationStats& stats, EChessSimulationResult::Type& outResult);
+	bool StartGame(FGameSlot& slot);
+
+	FChessSimulationConfig m_Config;
+	FChessTranspositionTable m_TT;
+	std::atomic<bool> m_Stop;
+	std::atomic<int32> m_NextGame;
+	std::atomic<int64> m_FinishedGames;
+
+	FChessBitboardPosition m_StartPosition;
+	TArray<FGameSlot> m_Slots; // Allocated once, the arena never grows while running
+	TArray<TUniquePtr<FWorker>> m_Workers;
+};
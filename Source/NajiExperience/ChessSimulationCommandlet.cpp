@@ -0,0 +1,49 @@
+
+
+
+#include "ChessSimulationCommandlet.h"
+
+#include "ChessSimulation.h"
+#include "Misc/Parse.h"
+
+UChessSimulationCommandlet::UChessSimulationCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UChessSimulationCommandlet::Main(const FString& Params)
+{
+	FChessSimulationConfig config;
+	FParse::Value(*Params, TEXT("games="), config.NumGames);
+	FParse::Value(*Params, TEXT("slots="), config.NumSlots);
+	FParse::Value(*Params, TEXT("threads="), config.NumWorkers);
+	FParse::Value(*Params, TEXT("nodes="), config.NodesPerMove);
+	FParse::Value(*Params, TEXT("maxplies="), config.MaxPlies);
+	FParse::Value(*Params, TEXT("openingplies="), config.RandomOpeningPlies);
+	FParse::Value(*Params, TEXT("hashmb="), config.HashSizeMB);
+	FParse::Value(*Params, TEXT("seed="), config.Seed);
+
+	FChessSimulationHost host(config);
+	UE_LOG(LogTemp, Display, TEXT("Simulating %d games, %d in flight on %d workers, %llu nodes per move"),
+		host.GetConfig().NumGames, host.GetConfig().NumSlots, host.GetNumWorkers(), host.GetConfig().NodesPerMove);
+
+	const FChessSimulationStats stats = host.Run();
+
+	UE_LOG(LogTemp, Display, TEXT("Played %lld games in %.2fs: %.2f games/s, average length %.1f plies, %.0f knps"),
+		stats.Games, stats.Seconds, stats.GetGamesPerSecond(), stats.GetAverageLength(), stats.Seconds > 0.0 ? stats.Nodes / stats.Seconds / 1000.0 : 0.0);
+	UE_LOG(LogTemp, Display, TEXT("White wins %lld, black wins %lld, draws %lld, aborted %lld"),
+		stats.Results[EChessSimulationResult::WhiteWin], stats.Results[EChessSimulationResult::BlackWin],
+		stats.Results[EChessSimulationResult::Draw], stats.Results[EChessSimulationResult::Aborted]);
+
+	if (stats.Results[EChessSimulationResult::Aborted] > 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("The rules engine refused moves or disagreed with the bitboard in %lld games"), stats.Results[EChessSimulationResult::Aborted]);
+		return 1;
+	}
+
+	return 0;
+}
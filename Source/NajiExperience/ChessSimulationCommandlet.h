@@ -0,0 +1,20 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ChessSimulationCommandlet.generated.h"
+
+// Headless AI self-play through FChessSimulationHost, reports throughput and game statistics.
+// UnrealEditor-Cmd NajiExperience.uproject -run=ChessSimulation -nullrhi [-games=<n>] [-slots=<n>] [-threads=<n>] [-nodes=<n>] [-maxplies=<n>] [-openingplies=<n>] [-hashmb=<n>] [-seed=<n>]
+// Returns non zero if the rules engine refused a move the bitboard considered legal.
+UCLASS()
+class UChessSimulationCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	UChessSimulationCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,136 @@
+
+
+
+#include "ChessSnapshot.h"
+
+// Only the instruction bits of a record, the side to move bit is implied by the replay
+static constexpr uint16 SNAPSHOT_INSTRUCTION_MASK = 0x3FFF;
+
+void FChessSnapshot::Reset()
+{
+	Header = FChessSnapshotHeader();
+	FMemory::Memset(Header.Board, BITBOARD_EMPTY, sizeof(Header.Board));
+	History.Reset();
+}
+
+void FChessSnapshot::SetPosition(const FChessBitboardPosition& position)
+{
+	FMemory::Memcpy(Header.Board, position.Board, sizeof(Header.Board));
+	Header.SideToMove = position.State.SideToMove;
+	Header.CastlingRights = position.State.CastlingRights;
+	Header.EnPassantSquare = position.State.EnPassantSquare;
+	Header.HalfmoveClock = position.State.HalfmoveClock;
+	Header.FullmoveNumber = position.State.FullmoveNumber;
+	Header.Key = position.Key;
+}
+
+bool FChessSnapshot::AddInstruction(uint16 encoded)
+{
+	if (Header.NumInstructions == MAX_uint16)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Snapshots hold at most %d instructions"), MAX_uint16);
+		return false;
+	}
+
+	AppendVarint(History, encoded & SNAPSHOT_INSTRUCTION_MASK);
+	++Header.NumInstructions;
+	Header.HistorySize = History.Num();
+	return true;
+}
+
+bool FChessSnapshot::DecodeHistory(TArray<uint16>& outInstructions) const
+{
+	outInstructions.Reset(Header.NumInstructions);
+
+	int32 offset = 0;
+	for (int32 i = 0; i < Header.NumInstructions; ++i)
+	{
+		uint32 value = 0;
+		if (!ReadVarint(History, offset, value) || value > SNAPSHOT_INSTRUCTION_MASK)
+			return false;
+
+		outInstructions.Add(static_cast<uint16>(value));
+	}
+
+	return offset == History.Num();
+}
+
+void FChessSnapshot::WriteBytes(TArray<uint8>& outBytes) const
+{
+	check(Header.HistorySize == History.Num());
+
+	outBytes.SetNumUninitialized(sizeof(FChessSnapshotHeader) + History.Num());
+	FMemory::Memcpy(outBytes.GetData(), &Header, sizeof(FChessSnapshotHeader));
+	FMemory::Memcpy(outBytes.GetData() + sizeof(FChessSnapshotHeader), History.GetData(), History.Num());
+}
+
+bool FChessSnapshot::ReadBytes(TArrayView<const uint8> bytes)
+{
+	if (bytes.Num() < static_cast<int32>(sizeof(FChessSnapshotHeader)))
+		return false;
+
+	FChessSnapshotHeader header;
+	FMemory::Memcpy(&header, bytes.GetData(), sizeof(FChessSnapshotHeader));
+	if (header.Magic != CHESS_SNAPSHOT_MAGIC || header.Version != CHESS_SNAPSHOT_VERSION)
+		return false;
+
+	const int32 historySize = bytes.Num() - sizeof(FChessSnapshotHeader);
+	if (static_cast<int32>(header.HistorySize) != historySize)
+		return false;
+
+	Header = header;
+	History.SetNumUninitialized(historySize);
+	FMemory::Memcpy(History.GetData(), bytes.GetData() + sizeof(FChessSnapshotHeader), historySize);
+	return true;
+}
+
+void AppendVarint(TArray<uint8>& bytes, uint32 value)
+{
+	// 7 bits per byte, low bits first, the high bit marks that more bytes follow
+	while (value >= 0x80)
+	{
+		bytes.Add(static_cast<uint8>(value | 0x80));
+		value >>= 7;
+	}
+	bytes.Add(static_cast<uint8>(value));
+}
+
+bool ReadVarint(TArrayView<const uint8> bytes, int32& inOutOffset, uint32& outValue)
+{
+	outValue = 0;
+	for (int32 shift = 0; shift < 32; shift += 7)
+	{
+		if (inOutOffset >= bytes.Num())
+			return false;
+
+		const uint8 byte = bytes[inOutOffset++];
+		outValue |= static_cast<uint32>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool DiffSnapshots(const FChessSnapshot& from, const FChessSnapshot& to, FChessSnapshotDiff& outDiff)
+{
+	outDiff.NumUndo = 0;
+	outDiff.Instructions.Reset();
+	outDiff.FromKey = from.Header.Key;
+	outDiff.ToKey = to.Header.Key;
+
+	TArray<uint16> fromInstructions;
+	TArray<uint16> toInstructions;
+	if (!from.DecodeHistory(fromInstructions) || !to.DecodeHistory(toInstructions))
+		return false;
+
+	int32 numShared = 0;
+	while (numShared < fromInstructions.Num() && numShared < toInstructions.Num() && fromInstructions[numShared] == toInstructions[numShared])
+	{
+		++numShared;
+	}
+
+	outDiff.NumUndo = fromInstructions.Num() - numShared;
+	outDiff.Instructions.Append(toInstructions.GetData() + numShared, toInstructions.Num() - numShared);
+	return true;
+}
@@ -0,0 +1,68 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ChessBitboard.h"
+
+#include <type_traits>
+
+constexpr uint32 CHESS_SNAPSHOT_MAGIC = 0x4E534843; // "CHSN"
+constexpr uint16 CHESS_SNAPSHOT_VERSION = 1;
+
+// Fixed layout part of a snapshot, the encoded history follows it directly. Plain old data in host byte order, copied with a memcpy.
+struct FChessSnapshotHeader
+{
+	uint32 Magic = CHESS_SNAPSHOT_MAGIC;
+	uint16 Version = CHESS_SNAPSHOT_VERSION;
+	uint16 Flags = 0; // Reserved, zero in version 1
+	uint64 Key = 0;
+	uint8 Board[BITBOARD_SQUARES]; // As FChessBitboardPosition::Board
+	uint8 SideToMove = EChessSide::White;
+	uint8 CastlingRights = 0;
+	int8 EnPassantSquare = INDEX_NONE;
+	uint8 HalfmoveClock = 0;
+	uint16 FullmoveNumber = 1;
+	uint16 NumInstructions = 0;
+	uint32 HistorySize = 0; // Bytes of encoded history after the header
+	uint32 Reserved = 0; // Explicit padding, so equal headers compare equal byte for byte
+};
+static_assert(std::is_trivially_copyable_v<FChessSnapshotHeader>, "Snapshot headers are copied as raw bytes");
+static_assert(sizeof(FChessSnapshotHeader) == 96, "Changing the snapshot layout needs a new version");
+
+// Game state as of a point in time: the position for checks and diffs plus every instruction since the standard setup.
+// Instructions are stored as varints of their 14 bit encoding (see EncodeInstruction), two bytes per move at most.
+struct FChessSnapshot
+{
+	FChessSnapshotHeader Header;
+	TArray<uint8> History;
+
+	FChessSnapshot() { Reset(); }
+	void Reset();
+	void SetPosition(const FChessBitboardPosition& position);
+	// False once NumInstructions is full, the snapshot is left as it was
+	bool AddInstruction(uint16 encoded);
+	bool DecodeHistory(TArray<uint16>& outInstructions) const;
+
+	// Header followed by the history, ready to be written as is
+	void WriteBytes(TArray<uint8>& outBytes) const;
+	// Fails on a wrong magic, an unknown version or a size mismatch
+	bool ReadBytes(TArrayView<const uint8> bytes);
+};
+
+void AppendVarint(TArray<uint8>& bytes, uint32 value);
+// Advances inOutOffset past the varint, false if it runs past the end or over 32 bits
+bool ReadVarint(TArrayView<const uint8> bytes, int32& inOutOffset, uint32& outValue);
+
+// Shortest way between two snapshots: undo back to the last instruction both histories share, then play the rest of the target
+struct FChessSnapshotDiff
+{
+	int32 NumUndo = 0;
+	TArray<uint16> Instructions; // Encoded, in play order
+	uint64 FromKey = 0; // Position keys of the two snapshots
+	uint64 ToKey = 0;
+
+	bool IsEmpty() const { return NumUndo == 0 && Instructions.Num() == 0; }
+};
+
+bool DiffSnapshots(const FChessSnapshot& from, const FChessSnapshot& to, FChessSnapshotDiff& outDiff);
@@ -0,0 +1,18 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "Trace/Trace.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+// `stat chess` in game, the Chess trace channel in Insights (-trace=cpu,chess)
+DECLARE_STATS_GROUP(TEXT("Chess"), STATGROUP_Chess, STATCAT_Advanced);
+
+UE_TRACE_CHANNEL_EXTERN(ChessChannel, NAJIEXPERIENCE_API);
+
+// Cycle stat plus a trace scope of the same name. Stats are compiled out of shipping builds, the trace scope stays.
+#define CHESS_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, ChessChannel)
@@ -0,0 +1,1243 @@
+
+
+
+#include "ChessTablebase.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+// Follows the layout of the Syzygy format as read by the reference probing code (Fathom, Stockfish)
+
+namespace
+{
+	constexpr uint8 WDL_MAGIC[4] = { 0x71, 0xE8, 0x23, 0x5D };
+	constexpr uint8 DTZ_MAGIC[4] = { 0xD7, 0x66, 0x0C, 0xA5 };
+
+	namespace ETableFlags
+	{
+		enum Type : uint8
+		{
+			SideToMove = 1 << 0,
+			Mapped = 1 << 1,
+			WinPlies = 1 << 2,
+			LossPlies = 1 << 3,
+			Wide = 1 << 4,
+			SingleValue = 1 << 7,
+		};
+	}
+
+	// Per file header flags
+	constexpr uint8 FILE_SPLIT = 1 << 0;
+	constexpr uint8 FILE_HAS_PAWNS = 1 << 1;
+
+	constexpr int32 MAX_DTZ = 1 << 18;
+	constexpr uint16 SYMBOL_LEAF = 0xFFF;
+
+	FORCEINLINE uint16 ReadLE16(const uint8* bytes) { return static_cast<uint16>(bytes[0] | (bytes[1] << 8)); }
+	FORCEINLINE uint32 ReadLE32(const uint8* bytes) { return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32>(bytes[3]) << 24); }
+	FORCEINLINE uint32 ReadBE32(const uint8* bytes) { return (static_cast<uint32>(bytes[0]) << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3]; }
+	FORCEINLINE uint64 ReadBE64(const uint8* bytes) { return (static_cast<uint64>(ReadBE32(bytes)) << 32) | ReadBE32(bytes + 4); }
+
+	FORCEINLINE int32 GetDiagonalOffset(int32 square) { return GetSquareY(square) - GetSquareX(square); } // 0 on the a1-h8 diagonal, negative below
+	FORCEINLINE int32 FlipFile(int32 square) { return square ^ 7; }
+	FORCEINLINE int32 FlipRank(int32 square) { return square ^ 56; }
+	FORCEINLINE int32 FlipDiagonal(int32 square) { return ((square >> 3) | (square << 3)) & 63; }
+
+	// Piece codes of the tables: white pawn 1 to king 6, black pieces 8 higher
+	FORCEINLINE uint8 GetPieceCode(const FChessBitboardPosition& position, int32 square)
+	{
+		return static_cast<uint8>((position.GetPiece(square) + 1) | (position.GetSide(square) << 3));
+	}
+
+	FORCEINLINE EChessWDL::Type Negate(EChessWDL::Type wdl) { return static_cast<EChessWDL::Type>(-wdl); }
+
+	int32 GetDTZBeforeZeroing(EChessWDL::Type wdl)
+	{
+		switch (wdl)
+		{
+		case EChessWDL::Win: return 1;
+		case EChessWDL::CursedWin: return 101;
+		case EChessWDL::BlessedLoss: return -101;
+		case EChessWDL::Loss: return -1;
+		default: return 0;
+		}
+	}
+
+	// Square and index tables of the encoding, built once
+	struct FTablebaseMaps
+	{
+		int32 MapPawns[BITBOARD_SQUARES]; // a2-h7 to 0..47, highest for the pawn nearest the edge and lowest rank
+		int32 MapB1H1H7[BITBOARD_SQUARES]; // Squares below the a1-h8 diagonal to 0..27
+		int32 MapA1D1D4[BITBOARD_SQUARES]; // a1-d1-d4 triangle to 0..9, diagonal squares last
+		int32 MapKK[10][BITBOARD_SQUARES]; // The 462 legal king pairs with the first king in the triangle
+		int32 Binomial[6][BITBOARD_SQUARES]; // [k][n] ways to choose k of n
+		int32 LeadPawnIdx[6][BITBOARD_SQUARES]; // [lead pawns][square]
+		int32 LeadPawnsSize[6][4]; // [lead pawns][file a..d]
+
+		FTablebaseMaps()
+		{
+			FMemory::Memzero(this, sizeof(*this));
+
+			int32 code = 0;
+			for (int32 square = 0; square < BITBOARD_SQUARES; ++square)
+			{
+				if (GetDiagonalOffset(square) < 0)
+					MapB1H1H7[square] = code++;
+			}
+
+			code = 0;
+			TArray<int32, TInlineAllocator<4>> diagonal;
+			for (int32 square = 0; square <= MakeSquare(3, 3); ++square)
+			{
+				if (GetSquareX(square) > 3)
+					continue;
+
+				if (GetDiagonalOffset(square) < 0)
+					MapA1D1D4[square] = code++;
+				else if (GetDiagonalOffset(square) == 0)
+					diagonal.Add(square);
+			}
+			for (int32 square : diagonal)
+			{
+				MapA1D1D4[square] = code++;
+			}
+
+			// With the first king on the diagonal the second one isn't above it, pairs with both on the diagonal come last
+			code = 0;
+			TArray<TPair<int32, int32>, TInlineAllocator<64>> bothOnDiagonal;
+			for (int32 idx = 0; idx < 10; ++idx)
+			{
+				for (int32 first = 0; first <= MakeSquare(3, 3); ++first)
+				{
+					// b1 is the only square mapped to 0, unmapped squares are 0 too
+					if (MapA1D1D4[first] != idx || (idx == 0 && first != MakeSquare(1, 0)))
+						continue;
+
+					for (int32 second = 0; second < BITBOARD_SQUARES; ++second)
+					{
+						if ((GetKingAttacks(first) | SquareBit(first)) & SquareBit(second))
+							continue;
+
+						if (GetDiagonalOffset(first) == 0 && GetDiagonalOffset(second) > 0)
+							continue;
+
+						if (GetDiagonalOffset(first) == 0 && GetDiagonalOffset(second) == 0)
+							bothOnDiagonal.Add({ idx, second });
+						else
+							MapKK[idx][second] = code++;
+					}
+				}
+			}
+			for (const TPair<int32, int32>& pair : bothOnDiagonal)
+			{
+				MapKK[pair.Key][pair.Value] = code++;
+			}
+
+			Binomial[0][0] = 1;
+			for (int32 n = 1; n < BITBOARD_SQUARES; ++n)
+			{
+				for (int32 k = 0; k < 6 && k <= n; ++k)
+				{
+					Binomial[k][n] = (k > 0 ? Binomial[k - 1][n - 1] : 0) + (k < n ? Binomial[k][n - 1] : 0);
+				}
+			}
+
+			// The leading pawn limits where the others can stand: 47 squares with it on a2, two fewer for every rank up
+			int32 availableSquares = 47;
+			for (int32 leadPawnsCnt = 1; leadPawnsCnt <= 5; ++leadPawnsCnt)
+			{
+				for (int32 file = 0; file < 4; ++file)
+				{
+					int32 idx = 0;
+					for (int32 rank = 1; rank <= 6; ++rank)
+					{
+						const int32 square = MakeSquare(file, rank);
+						if (leadPawnsCnt == 1)
+						{
+							MapPawns[square] = availableSquares--;
+							MapPawns[FlipFile(square)] = availableSquares--;
+						}
+
+						LeadPawnIdx[leadPawnsCnt][square] = idx;
+						idx += Binomial[leadPawnsCnt - 1][MapPawns[square]];
+					}
+
+					LeadPawnsSize[leadPawnsCnt][file] = idx;
+				}
+			}
+		}
+	};
+
+	const FTablebaseMaps& GetMaps()
+	{
+		static const FTablebaseMaps maps;
+		return maps;
+	}
+
+	// Stable and allocation free, the arrays hold a handful of squares at most
+	template <typename KeyType>
+	void InsertionSort(int32* squares, int32 num, KeyType getKey)
+	{
+		for (int32 i = 1; i < num; ++i)
+		{
+			const int32 square = squares[i];
+			int32 j = i;
+			while (j > 0 && getKey(square) < getKey(squares[j - 1]))
+			{
+				squares[j] = squares[j - 1];
+				--j;
+			}
+			squares[j] = square;
+		}
+	}
+
+	// Piece counts per side without the king, 4 bits each in EBitboardPiece order
+	constexpr int32 MATERIAL_SIDE_BITS = 20;
+
+	uint64 MakeMaterialKey(const uint8 (&counts)[EChessSide::COUNT][EBitboardPiece::COUNT], bool swapSides)
+	{
+		uint64 key = 0;
+		for (int32 side = 0; side < EChessSide::COUNT; ++side)
+		{
+			const int32 keySide = swapSides ? side ^ 1 : side;
+			for (int32 piece = EBitboardPiece::Pawn; piece < EBitboardPiece::King; ++piece)
+			{
+				key |= static_cast<uint64>(counts[side][piece] & 0xF) << (keySide * MATERIAL_SIDE_BITS + piece * 4);
+			}
+		}
+		return key;
+	}
+
+	uint64 MakeMaterialKey(const FChessBitboardPosition& position)
+	{
+		uint8 counts[EChessSide::COUNT][EBitboardPiece::COUNT];
+		for (int32 side = 0; side < EChessSide::COUNT; ++side)
+		{
+			for (int32 piece = 0; piece < EBitboardPiece::COUNT; ++piece)
+			{
+				counts[side][piece] = static_cast<uint8>(FMath::CountBits(position.Pieces[side][piece]));
+			}
+		}
+		return MakeMaterialKey(counts, false);
+	}
+
+	// Table names list the pieces of both sides from the king down, e.g. KRPvKR
+	bool ParseTableName(const FString& name, uint8 (&outCounts)[EChessSide::COUNT][EBitboardPiece::COUNT])
+	{
+		FMemory::Memzero(outCounts, sizeof(outCounts));
+
+		int32 side = EChessSide::White;
+		for (TCHAR c : name)
+		{
+			EBitboardPiece::Type piece = EBitboardPiece::None;
+			switch (c)
+			{
+			case TEXT('K'): piece = EBitboardPiece::King; break;
+			case TEXT('Q'): piece = EBitboardPiece::Queen; break;
+			case TEXT('R'): piece = EBitboardPiece::Rook; break;
+			case TEXT('B'): piece = EBitboardPiece::Bishop; break;
+			case TEXT('N'): piece = EBitboardPiece::Knight; break;
+			case TEXT('P'): piece = EBitboardPiece::Pawn; break;
+			case TEXT('v'):
+				if (side != EChessSide::White)
+					return false;
+				side = EChessSide::Black;
+				continue;
+			default:
+				return false;
+			}
+
+			++outCounts[side][piece];
+		}
+
+		return side == EChessSide::Black && outCounts[EChessSide::White][EBitboardPiece::King] == 1 && outCounts[EChessSide::Black][EBitboardPiece::King] == 1;
+	}
+}
+
+struct FChessTablebase::FPairsData
+{
+	uint8 Flags = 0;
+	uint64 BlockSize = 0; // Bytes of compressed data per block
+	uint64 Span = 0; // Values between two sparse index entries
+	int32 NumBlocks = 0;
+	int32 MaxSymLen = 0;
+	int32 MinSymLen = 0; // The value itself for single value tables
+	const uint8* LowestSym = nullptr; // Little endian uint16 per symbol length, the lowest symbol of that length
+	const uint8* BTree = nullptr; // 3 bytes per symbol: left (12 bits) | right (12 bits), a leaf stores its value on the left
+	const uint8* BlockLength = nullptr; // Little endian uint16 per block, values stored minus one
+	int32 BlockLengthSize = 0;
+	const uint8* SparseIndex = nullptr; // 6 bytes per entry: block (uint32) | offset (uint16), little endian
+	uint64 SparseIndexSize = 0;
+	const uint8* Data = nullptr;
+	TArray<uint64> Base64; // Lowest symbol of every length, left aligned to 64 bits
+	TArray<uint8> SymLen; // Values a symbol expands to, minus one
+	uint8 Pieces[MAX_PIECES] = {};
+	uint64 GroupIdx[MAX_PIECES + 1] = {};
+	int32 GroupLen[MAX_PIECES + 1] = {};
+	uint16 MapIdx[4] = {}; // DTZ value maps of wins, losses, cursed wins and blessed losses
+
+	uint16 GetLeft(uint16 symbol) const
+	{
+		const uint8* node = BTree + symbol * 3;
+		return static_cast<uint16>(((node[1] & 0xF) << 8) | node[0]);
+	}
+
+	uint16 GetRight(uint16 symbol) const
+	{
+		const uint8* node = BTree + symbol * 3;
+		return static_cast<uint16>((node[2] << 4) | (node[1] >> 4));
+	}
+
+	int32 GetBlockLength(uint32 block) const { return ReadLE16(BlockLength + block * sizeof(uint16)); }
+};
+
+struct FChessTablebase::FTableFile
+{
+	TUniquePtr<IMappedFileHandle> Handle;
+	TUniquePtr<IMappedFileRegion> Region; // Declared after the handle, the region has to be unmapped first
+	const uint8* Data = nullptr;
+	bool Tried = false; // Mapped or failed once, never retried
+};
+
+struct FChessTablebase::FTable
+{
+	FString Name;
+	uint64 Key = 0; // Material with the first side of the name as white
+	uint64 Key2 = 0; // Sides swapped, equal to Key for symmetric material
+	int32 PieceCount = 0;
+	bool HasPawns = false;
+	bool HasUniquePieces = false;
+	bool HasDTZ = false;
+	uint8 PawnCount[2] = {}; // Leading side, other side
+
+	FTableFile Files[2]; // WDL, DTZ
+	FPairsData WDL[2][4]; // [side to move][leading pawn file, 0 without pawns]
+	FPairsData DTZ[4]; // One side to move only
+	const uint8* DTZMap = nullptr;
+
+	FPairsData& Get(bool dtz, int32 sideToMove, int32 file)
+	{
+		const int32 fileIdx = HasPawns ? file : 0;
+		return dtz ? DTZ[fileIdx] : WDL[sideToMove % 2][fileIdx];
+	}
+};
+
+struct FChessTablebase::FCachedBlock
+{
+	TPair<const FPairsData*, uint32> Key;
+	TArray<uint16> Values;
+	uint64 LastUse = 0;
+};
+
+FChessTablebase::FChessTablebase(const FString& directory, int32 maxCachedBlocks)
+	: m_Directory(directory)
+	, m_MaxCachedBlocks(FMath::Max(maxCachedBlocks, 1))
+{
+}
+
+FChessTablebase::~FChessTablebase()
+{
+}
+
+int32 FChessTablebase::GetMaxPieces()
+{
+	FScopeLock lock(&m_Lock);
+	ScanDirectory();
+	return m_MaxPieces;
+}
+
+void FChessTablebase::ScanDirectory()
+{
+	if (m_Scanned)
+		return;
+
+	m_Scanned = true;
+	m_Blocks.Reserve(m_MaxCachedBlocks);
+
+	TArray<FString> wdlFiles;
+	TArray<FString> dtzFiles;
+	IFileManager::Get().FindFiles(wdlFiles, *(m_Directory / TEXT("*.rtbw")), true, false);
+	IFileManager::Get().FindFiles(dtzFiles, *(m_Directory / TEXT("*.rtbz")), true, false);
+
+	TSet<FString> dtzNames;
+	for (const FString& file : dtzFiles)
+	{
+		dtzNames.Add(FPaths::GetBaseFilename(file));
+	}
+
+	for (const FString& file : wdlFiles)
+	{
+		const FString name = FPaths::GetBaseFilename(file);
+		uint8 counts[EChessSide::COUNT][EBitboardPiece::COUNT];
+		if (!ParseTableName(name, counts))
+			continue;
+
+		TUniquePtr<FTable> table = MakeUnique<FTable>();
+		table->Name = name;
+		table->Key = MakeMaterialKey(counts, false);
+		table->Key2 = MakeMaterialKey(counts, true);
+		table->HasDTZ = dtzNames.Contains(name);
+
+		for (int32 side = 0; side < EChessSide::COUNT; ++side)
+		{
+			for (int32 piece = 0; piece < EBitboardPiece::COUNT; ++piece)
+			{
+				table->PieceCount += counts[side][piece];
+				table->HasUniquePieces |= piece != EBitboardPiece::King && counts[side][piece] == 1;
+			}
+		}
+
+		if (table->PieceCount > MAX_PIECES || m_TableIndices.Contains(table->Key))
+			continue;
+
+		// With pawns on both sides the side with fewer pawns leads, it compresses better
+		const uint8 whitePawns = counts[EChessSide::White][EBitboardPiece::Pawn];
+		const uint8 blackPawns = counts[EChessSide::Black][EBitboardPiece::Pawn];
+		const bool whiteLeads = blackPawns == 0 || (whitePawns > 0 && blackPawns >= whitePawns);
+		table->HasPawns = whitePawns + blackPawns > 0;
+		table->PawnCount[0] = whiteLeads ? whitePawns : blackPawns;
+		table->PawnCount[1] = whiteLeads ? blackPawns : whitePawns;
+
+		m_MaxPieces = FMath::Max(m_MaxPieces, table->PieceCount);
+		const int32 tableIdx = m_Tables.Add(MoveTemp(table));
+		m_TableIndices.Add(m_Tables[tableIdx]->Key, tableIdx);
+		m_TableIndices.Add(m_Tables[tableIdx]->Key2, tableIdx);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Found %d tablebases of up to %d pieces in %s"), m_Tables.Num(), m_MaxPieces, *m_Directory);
+}
+
+FChessTablebase::FTable* FChessTablebase::FindTable(uint64 materialKey)
+{
+	const int32* tableIdx = m_TableIndices.Find(materialKey);
+	return tableIdx ? m_Tables[*tableIdx].Get() : nullptr;
+}
+
+uint8 FChessTablebase::SetSymLen(FPairsData& pairs, uint16 symbol, TBitArray<>& visited)
+{
+	// The symbol tree is acyclic, so marking before recursing is safe
+	visited[symbol] = true;
+
+	const uint16 right = pairs.GetRight(symbol);
+	if (right == SYMBOL_LEAF)
+		return 0;
+
+	const uint16 left = pairs.GetLeft(symbol);
+	if (!pairs.SymLen.IsValidIndex(left) || !pairs.SymLen.IsValidIndex(right))
+		return 0;
+
+	if (!visited[left])
+		pairs.SymLen[left] = SetSymLen(pairs, left, visited);
+	if (!visited[right])
+		pairs.SymLen[right] = SetSymLen(pairs, right, visited);
+
+	return static_cast<uint8>(pairs.SymLen[left] + pairs.SymLen[right] + 1);
+}
+
+const uint8* FChessTablebase::SetSizes(FPairsData& pairs, const uint8* data)
+{
+	pairs.Flags = *data++;
+	if (pairs.Flags & ETableFlags::SingleValue)
+	{
+		pairs.MinSymLen = *data++;
+		return data;
+	}
+
+	// The last group index is the number of positions in the table
+	int32 numGroups = 0;
+	while (numGroups < MAX_PIECES && pairs.GroupLen[numGroups] != 0)
+	{
+		++numGroups;
+	}
+	const uint64 tableSize = pairs.GroupIdx[numGroups];
+
+	pairs.BlockSize = 1ull << *data++;
+	pairs.Span = 1ull << *data++;
+	pairs.SparseIndexSize = (tableSize + pairs.Span - 1) / pairs.Span;
+	const int32 padding = *data++;
+	pairs.NumBlocks = static_cast<int32>(ReadLE32(data));
+	data += sizeof(uint32);
+	// Padded so sparse index entries never point past the table
+	pairs.BlockLengthSize = pairs.NumBlocks + padding;
+	pairs.MaxSymLen = *data++;
+	pairs.MinSymLen = *data++;
+	pairs.LowestSym = data;
+
+	// Canonical Huffman code: longer symbols have lower values, every length gets the left aligned value of its lowest symbol
+	const int32 numLengths = FMath::Max(pairs.MaxSymLen - pairs.MinSymLen + 1, 1);
+	pairs.Base64.SetNumZeroed(numLengths);
+	for (int32 i = numLengths - 2; i >= 0; --i)
+	{
+		pairs.Base64[i] = (pairs.Base64[i + 1] + ReadLE16(pairs.LowestSym + i * sizeof(uint16)) - ReadLE16(pairs.LowestSym + (i + 1) * sizeof(uint16))) / 2;
+	}
+	for (int32 i = 0; i < numLengths; ++i)
+	{
+		pairs.Base64[i] <<= 64 - i - pairs.MinSymLen;
+	}
+	data += numLengths * sizeof(uint16);
+
+	// Recursive pairing: every symbol either stands for a value or for a pair of other symbols
+	pairs.SymLen.SetNumZeroed(ReadLE16(data));
+	data += sizeof(uint16);
+	pairs.BTree = data;
+
+	TBitArray<> visited(false, pairs.SymLen.Num());
+	for (int32 symbol = 0; symbol < pairs.SymLen.Num(); ++symbol)
+	{
+		if (!visited[symbol])
+			pairs.SymLen[symbol] = SetSymLen(pairs, static_cast<uint16>(symbol), visited);
+	}
+
+	return data + pairs.SymLen.Num() * 3 + (pairs.SymLen.Num() & 1);
+}
+
+bool FChessTablebase::MapTable(FTable& table, bool dtz)
+{
+	FTableFile& file = table.Files[dtz ? 1 : 0];
+	if (file.Data)
+		return true;
+	if (file.Tried || (dtz && !table.HasDTZ))
+		return false;
+
+	file.Tried = true;
+
+	const FString path = m_Directory / table.Name + (dtz ? TEXT(".rtbz") : TEXT(".rtbw"));
+	FOpenMappedResult mapped = FPlatformFileManager::Get().GetPlatformFile().OpenMappedEx(*path);
+	if (mapped.HasError())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Couldn't map tablebase %s"), *path);
+		return false;
+	}
+
+	file.Handle = mapped.StealValue();
+	const int64 fileSize = file.Handle->GetFileSize();
+	if (fileSize > 5)
+		file.Region.Reset(file.Handle->MapRegion(0, fileSize));
+
+	const uint8* data = file.Region.IsValid() ? file.Region->GetMappedPtr() : nullptr;
+	const uint8* magic = dtz ? DTZ_MAGIC : WDL_MAGIC;
+	const uint8 expectedFlags = (table.HasPawns ? FILE_HAS_PAWNS : 0) | (table.Key != table.Key2 ? FILE_SPLIT : 0);
+	if (!data || FMemory::Memcmp(data, magic, 4) != 0 || (data[4] & (FILE_HAS_PAWNS | FILE_SPLIT)) != expectedFlags)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s isn't a valid tablebase"), *path);
+		file.Region.Reset();
+		file.Handle.Reset();
+		return false;
+	}
+
+	const uint8* end = data + fileSize;
+	data += 5;
+
+	const int32 sides = !dtz && table.Key != table.Key2 ? 2 : 1;
+	const int32 maxFile = table.HasPawns ? 3 : 0;
+	const bool pawnsOnBothSides = table.HasPawns && table.PawnCount[1] > 0;
+
+	// Piece order and group order, per leading pawn file
+	for (int32 f = 0; f <= maxFile; ++f)
+	{
+		for (int32 i = 0; i < sides; ++i)
+		{
+			table.Get(dtz, i, f) = FPairsData();
+		}
+
+		const int32 order[2][2] =
+		{
+			{ data[0] & 0xF, pawnsOnBothSides ? data[1] & 0xF : 0xF },
+			{ data[0] >> 4, pawnsOnBothSides ? data[1] >> 4 : 0xF },
+		};
+		data += pawnsOnBothSides ? 2 : 1;
+
+		for (int32 k = 0; k < table.PieceCount; ++k, ++data)
+		{
+			for (int32 i = 0; i < sides; ++i)
+			{
+				table.Get(dtz, i, f).Pieces[k] = i ? *data >> 4 : *data & 0xF;
+			}
+		}
+
+		for (int32 i = 0; i < sides; ++i)
+		{
+			SetGroups(table, table.Get(dtz, i, f), order[i], f);
+		}
+	}
+
+	data += reinterpret_cast<UPTRINT>(data) & 1;
+
+	for (int32 f = 0; f <= maxFile; ++f)
+	{
+		for (int32 i = 0; i < sides && data < end; ++i)
+		{
+			data = SetSizes(table.Get(dtz, i, f), data);
+		}
+	}
+
+	if (dtz && data < end)
+	{
+		table.DTZMap = data;
+		for (int32 f = 0; f <= maxFile; ++f)
+		{
+			FPairsData& pairs = table.Get(true, 0, f);
+			if (!(pairs.Flags & ETableFlags::Mapped))
+				continue;
+
+			if (pairs.Flags & ETableFlags::Wide)
+			{
+				data += reinterpret_cast<UPTRINT>(data) & 1;
+				for (int32 i = 0; i < 4; ++i)
+				{
+					pairs.MapIdx[i] = static_cast<uint16>((data - table.DTZMap) / 2 + 1);
+					data += 2 * ReadLE16(data) + 2;
+				}
+			}
+			else
+			{
+				for (int32 i = 0; i < 4; ++i)
+				{
+					pairs.MapIdx[i] = static_cast<uint16>(data - table.DTZMap + 1);
+					data += *data + 1;
+				}
+			}
+		}
+		data += reinterpret_cast<UPTRINT>(data) & 1;
+	}
+
+	for (int32 f = 0; f <= maxFile; ++f)
+	{
+		for (int32 i = 0; i < sides; ++i)
+		{
+			FPairsData& pairs = table.Get(dtz, i, f);
+			pairs.SparseIndex = data;
+			data += pairs.SparseIndexSize * 6;
+		}
+	}
+
+	for (int32 f = 0; f <= maxFile; ++f)
+	{
+		for (int32 i = 0; i < sides; ++i)
+		{
+			FPairsData& pairs = table.Get(dtz, i, f);
+			pairs.BlockLength = data;
+			data += pairs.BlockLengthSize * sizeof(uint16);
+		}
+	}
+
+	for (int32 f = 0; f <= maxFile; ++f)
+	{
+		for (int32 i = 0; i < sides; ++i)
+		{
+			// Compressed blocks start 64 byte aligned
+			data = reinterpret_cast<const uint8*>((reinterpret_cast<UPTRINT>(data) + 0x3F) & ~static_cast<UPTRINT>(0x3F));
+			FPairsData& pairs = table.Get(dtz, i, f);
+			pairs.Data = data;
+			data += pairs.NumBlocks * pairs.BlockSize;
+		}
+	}
+
+	if (data > end)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s is truncated"), *path);
+		file.Region.Reset();
+		file.Handle.Reset();
+		return false;
+	}
+
+	file.Data = file.Region->GetMappedPtr();
+	return true;
+}
+
+void FChessTablebase::SetGroups(const FTable& table, FPairsData& pairs, const int32 (&order)[2], int32 file)
+{
+	const FTablebaseMaps& maps = GetMaps();
+
+	// Runs of equal pieces form groups, the leading group also takes the unique pieces it is encoded with: KRvKN gives (3, 1)
+	int32 numGroups = 0;
+	int32 firstLen = table.HasPawns ? 0 : table.HasUniquePieces ? 3 : 2;
+	pairs.GroupLen[numGroups] = 1;
+	for (int32 i = 1; i < table.PieceCount; ++i)
+	{
+		if (--firstLen > 0 || pairs.Pieces[i] == pairs.Pieces[i - 1])
+			++pairs.GroupLen[numGroups];
+		else
+			pairs.GroupLen[++numGroups] = 1;
+	}
+	pairs.GroupLen[++numGroups] = 0;
+
+	// The groups are combined as g1 * N(g2) * N(g3) + g2 * N(g3) + g3, in the order the table stores.
+	// order[0] places the leading group, order[1] the pawns of the other side if both sides have pawns.
+	const bool pawnsOnBothSides = table.HasPawns && table.PawnCount[1] > 0;
+	int32 next = pawnsOnBothSides ? 2 : 1;
+	int32 freeSquares = BITBOARD_SQUARES - pairs.GroupLen[0] - (pawnsOnBothSides ? pairs.GroupLen[1] : 0);
+	uint64 idx = 1;
+
+	for (int32 k = 0; next < numGroups || k == order[0] || k == order[1]; ++k)
+	{
+		if (k == order[0])
+		{
+			pairs.GroupIdx[0] = idx;
+			idx *= table.HasPawns ? maps.LeadPawnsSize[pairs.GroupLen[0]][file] : table.HasUniquePieces ? 31332 : 462;
+		}
+		else if (k == order[1])
+		{
+			pairs.GroupIdx[1] = idx;
+			idx *= maps.Binomial[pairs.GroupLen[1]][48 - pairs.GroupLen[0]];
+		}
+		else
+		{
+			pairs.GroupIdx[next] = idx;
+			idx *= maps.Binomial[pairs.GroupLen[next]][freeSquares];
+			freeSquares -= pairs.GroupLen[next++];
+		}
+	}
+
+	pairs.GroupIdx[numGroups] = idx;
+}
+
+const TArray<uint16>& FChessTablebase::GetBlock(const FPairsData& pairs, uint32 block)
+{
+	const TPair<const FPairsData*, uint32> key(&pairs, block);
+	if (const int32* blockIdx = m_BlockIndices.Find(key))
+	{
+		FCachedBlock& cached = m_Blocks[*blockIdx];
+		cached.LastUse = ++m_BlockUseCount;
+		return cached.Values;
+	}
+
+	int32 blockIdx = INDEX_NONE;
+	if (m_Blocks.Num() < m_MaxCachedBlocks)
+	{
+		blockIdx = m_Blocks.AddDefaulted();
+	}
+	else
+	{
+		// Misses decompress a whole block, a scan for the least recently used one is noise next to that
+		blockIdx = 0;
+		for (int32 i = 1; i < m_Blocks.Num(); ++i)
+		{
+			if (m_Blocks[i].LastUse < m_Blocks[blockIdx].LastUse)
+				blockIdx = i;
+		}
+		m_BlockIndices.Remove(m_Blocks[blockIdx].Key);
+	}
+
+	FCachedBlock& cached = m_Blocks[blockIdx];
+	cached.Key = key;
+	cached.LastUse = ++m_BlockUseCount;
+	DecompressBlock(pairs, block, cached.Values);
+	m_BlockIndices.Add(key, blockIdx);
+	return cached.Values;
+}
+
+void FChessTablebase::DecompressBlock(const FPairsData& pairs, uint32 block, TArray<uint16>& outValues)
+{
+	const int32 numValues = pairs.GetBlockLength(block) + 1;
+	outValues.Reset(numValues);
+
+	const uint8* ptr = pairs.Data + block * pairs.BlockSize;
+	const uint8* blockEnd = ptr + pairs.BlockSize;
+	uint64 buffer = ReadBE64(ptr);
+	ptr += sizeof(uint64);
+	int32 bufferBits = 64;
+
+	while (outValues.Num() < numValues)
+	{
+		// Symbols of one length are consecutive, the length is found from the left aligned lowest symbol of every length
+		int32 len = 0;
+		while (len + 1 < pairs.Base64.Num() && buffer < pairs.Base64[len])
+		{
+			++len;
+		}
+
+		const uint16 symbol = static_cast<uint16>(((buffer - pairs.Base64[len]) >> (64 - len - pairs.MinSymLen)) + ReadLE16(pairs.LowestSym + len * sizeof(uint16)));
+		if (!pairs.SymLen.IsValidIndex(symbol))
+			break;
+
+		// Expands depth first, left before right. A symbol stands for 256 values at most, so the tree is at most 255 deep.
+		uint16 stack[256];
+		int32 stackNum = 0;
+		stack[stackNum++] = symbol;
+		while (stackNum > 0)
+		{
+			const uint16 node = stack[--stackNum];
+			if (!pairs.SymLen.IsValidIndex(node))
+			{
+				outValues.Add(0);
+				continue;
+			}
+
+			if (pairs.SymLen[node] == 0 || stackNum + 2 > static_cast<int32>(UE_ARRAY_COUNT(stack)))
+			{
+				outValues.Add(pairs.GetLeft(node));
+				continue;
+			}
+
+			stack[stackNum++] = pairs.GetRight(node);
+			stack[stackNum++] = pairs.GetLeft(node);
+		}
+
+		len += pairs.MinSymLen;
+		buffer <<= len;
+		bufferBits -= len;
+		if (bufferBits <= 32)
+		{
+			// The last symbols of a block may end close to its end, nothing past it is read
+			bufferBits += 32;
+			buffer |= static_cast<uint64>(ptr + sizeof(uint32) <= blockEnd ? ReadBE32(ptr) : 0) << (64 - bufferBits);
+			ptr += sizeof(uint32);
+		}
+	}
+
+	outValues.SetNumZeroed(numValues);
+}
+
+int32 FChessTablebase::DecompressPairs(const FPairsData& pairs, uint64 idx)
+{
+	if (pairs.Flags & ETableFlags::SingleValue)
+		return pairs.MinSymLen;
+
+	// Sparse index entry k points at value k * Span + Span / 2, walk the blocks from there to the one holding idx
+	const uint64 k = idx / pairs.Span;
+	if (k >= pairs.SparseIndexSize)
+		return 0;
+
+	const uint8* entry = pairs.SparseIndex + k * 6;
+	int64 block = ReadLE32(entry);
+	int64 offset = ReadLE16(entry + 4);
+	offset += static_cast<int64>(idx % pairs.Span) - static_cast<int64>(pairs.Span / 2);
+
+	while (offset < 0 && block > 0)
+	{
+		offset += pairs.GetBlockLength(--block) + 1;
+	}
+	while (offset > pairs.GetBlockLength(block) && block + 1 < pairs.NumBlocks)
+	{
+		offset -= pairs.GetBlockLength(block++) + 1;
+	}
+
+	const TArray<uint16>& values = GetBlock(pairs, static_cast<uint32>(block));
+	return values.IsValidIndex(offset) ? values[offset] : 0;
+}
+
+int32 FChessTablebase::ProbeTable(const FChessBitboardPosition& position, bool dtz, EChessWDL::Type wdl, EProbeState& outState)
+{
+	const FTablebaseMaps& maps = GetMaps();
+
+	const uint64 occupancy = position.GetOccupancy();
+	if (FMath::CountBits(occupancy) == 2)
+		return EChessWDL::Draw; // Bare kings
+
+	const uint64 materialKey = MakeMaterialKey(position);
+	FTable* table = FindTable(materialKey);
+	if (!table || !MapTable(*table, dtz))
+	{
+		outState = EProbeState::Fail;
+		return 0;
+	}
+
+	// Tables are stored with the side named first as white, and symmetric material for white to move only.
+	// Other positions are probed with colours swapped and the board flipped.
+	const EChessSide::Type sideToMove = position.State.SideToMove;
+	const bool symmetricBlackToMove = table->Key == table->Key2 && sideToMove == EChessSide::Black;
+	const bool blackStronger = materialKey != table->Key;
+	const bool flip = symmetricBlackToMove || blackStronger;
+	const uint8 flipColor = flip ? 8 : 0;
+	const int32 flipSquares = flip ? 56 : 0;
+	const int32 stm = (flip ? 1 : 0) ^ sideToMove;
+
+	int32 squares[MAX_PIECES];
+	uint8 pieces[MAX_PIECES];
+	int32 size = 0;
+	int32 leadPawnsCnt = 0;
+	uint64 leadPawns = 0;
+	int32 tbFile = 0;
+
+	// Tables with pawns are split by the file of the leading pawn, the one nearest the edge and on the lowest rank
+	auto getMapPawns = [&maps](int32 square) { return maps.MapPawns[square]; };
+	if (table->HasPawns)
+	{
+		const uint8 leadPiece = static_cast<uint8>(table->Get(dtz, 0, 0).Pieces[0] ^ flipColor);
+		leadPawns = position.Pieces[leadPiece >> 3][EBitboardPiece::Pawn];
+		uint64 bits = leadPawns;
+		while (bits && size < MAX_PIECES)
+		{
+			squares[size++] = PopSquare(bits) ^ flipSquares;
+		}
+		leadPawnsCnt = size;
+
+		int32 leadIdx = 0;
+		for (int32 i = 1; i < leadPawnsCnt; ++i)
+		{
+			if (maps.MapPawns[squares[i]] > maps.MapPawns[squares[leadIdx]])
+				leadIdx = i;
+		}
+		Swap(squares[0], squares[leadIdx]);
+
+		const int32 file = GetSquareX(squares[0]);
+		tbFile = FMath::Min(file, 7 - file);
+	}
+
+	// DTZ tables only store one side to move
+	if (dtz && (table->Get(true, stm, tbFile).Flags & ETableFlags::SideToMove) != stm && !(table->Key == table->Key2 && !table->HasPawns))
+	{
+		outState = EProbeState::ChangeSide;
+		return 0;
+	}
+
+	uint64 bits = occupancy ^ leadPawns;
+	while (bits && size < MAX_PIECES)
+	{
+		const int32 square = PopSquare(bits);
+		squares[size] = square ^ flipSquares;
+		pieces[size++] = static_cast<uint8>(GetPieceCode(position, square) ^ flipColor);
+	}
+
+	const FPairsData& pairs = table->Get(dtz, stm, tbFile);
+
+	// Order the pieces like the table does
+	for (int32 i = leadPawnsCnt; i < size - 1; ++i)
+	{
+		for (int32 j = i + 1; j < size; ++j)
+		{
+			if (pairs.Pieces[i] == pieces[j])
+			{
+				Swap(pieces[i], pieces[j]);
+				Swap(squares[i], squares[j]);
+				break;
+			}
+		}
+	}
+
+	// Mirror the leading piece onto files a-d
+	if (GetSquareX(squares[0]) > 3)
+	{
+		for (int32 i = 0; i < size; ++i)
+		{
+			squares[i] = FlipFile(squares[i]);
+		}
+	}
+
+	uint64 idx = 0;
+	if (table->HasPawns)
+	{
+		idx = maps.LeadPawnIdx[leadPawnsCnt][squares[0]];
+		InsertionSort(squares + 1, leadPawnsCnt - 1, getMapPawns);
+		for (int32 i = 1; i < leadPawnsCnt; ++i)
+		{
+			idx += maps.Binomial[i][maps.MapPawns[squares[i]]];
+		}
+	}
+	else
+	{
+		// Without pawns the board is also mirrored onto ranks 1-4 and below the a1-h8 diagonal
+		if (GetSquareY(squares[0]) > 3)
+		{
+			for (int32 i = 0; i < size; ++i)
+			{
+				squares[i] = FlipRank(squares[i]);
+			}
+		}
+
+		for (int32 i = 0; i < pairs.GroupLen[0]; ++i)
+		{
+			if (GetDiagonalOffset(squares[i]) == 0)
+				continue;
+
+			if (GetDiagonalOffset(squares[i]) > 0)
+			{
+				for (int32 j = i; j < size; ++j)
+				{
+					squares[j] = FlipDiagonal(squares[j]);
+				}
+			}
+			break;
+		}
+
+		if (table->HasUniquePieces)
+		{
+			// Three unique pieces encoded together, every later piece skips the squares taken before it
+			const int32 adjust1 = squares[1] > squares[0];
+			const int32 adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+			if (GetDiagonalOffset(squares[0]))
+			{
+				idx = (maps.MapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+			}
+			else if (GetDiagonalOffset(squares[1]))
+			{
+				idx = (6 * 63 + GetSquareY(squares[0]) * 28 + maps.MapB1H1H7[squares[1]]) * 62 + squares[2] - adjust2;
+			}
+			else if (GetDiagonalOffset(squares[2]))
+			{
+				idx = 6 * 63 * 62 + 4 * 28 * 62 + GetSquareY(squares[0]) * 7 * 28 + (GetSquareY(squares[1]) - adjust1) * 28 + maps.MapB1H1H7[squares[2]];
+			}
+			else
+			{
+				idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + GetSquareY(squares[0]) * 7 * 6 + (GetSquareY(squares[1]) - adjust1) * 6 + (GetSquareY(squares[2]) - adjust2);
+			}
+		}
+		else
+		{
+			idx = maps.MapKK[maps.MapA1D1D4[squares[0]]][squares[1]];
+		}
+	}
+
+	// Remaining groups, each ordered by square and mapped past the squares of the groups before it
+	idx *= pairs.GroupIdx[0];
+	int32 groupStart = pairs.GroupLen[0];
+	bool remainingPawns = table->HasPawns && table->PawnCount[1] > 0;
+	for (int32 group = 1; group < MAX_PIECES && pairs.GroupLen[group] != 0; ++group)
+	{
+		const int32 groupLen = pairs.GroupLen[group];
+		InsertionSort(squares + groupStart, groupLen, [](int32 square) { return square; });
+
+		uint64 n = 0;
+		for (int32 i = 0; i < groupLen; ++i)
+		{
+			const int32 square = squares[groupStart + i];
+			int32 adjust = 0;
+			for (int32 j = 0; j < groupStart; ++j)
+			{
+				adjust += square > squares[j];
+			}
+			n += maps.Binomial[i + 1][square - adjust - (remainingPawns ? 8 : 0)];
+		}
+
+		remainingPawns = false;
+		idx += n * pairs.GroupIdx[group];
+		groupStart += groupLen;
+	}
+
+	const int32 value = DecompressPairs(pairs, idx);
+	if (!dtz)
+		return value - 2;
+
+	// DTZ values may go through a per table map and be stored in moves instead of plies
+	static constexpr int32 WDL_MAP[] = { 1, 3, 0, 2, 0 };
+	const FPairsData& dtzPairs = table->Get(true, 0, tbFile);
+	int32 dtzValue = value;
+	if (dtzPairs.Flags & ETableFlags::Mapped)
+	{
+		const int32 mapIdx = dtzPairs.MapIdx[WDL_MAP[wdl + 2]] + value;
+		dtzValue = (dtzPairs.Flags & ETableFlags::Wide) ? ReadLE16(table->DTZMap + mapIdx * sizeof(uint16)) : table->DTZMap[mapIdx];
+	}
+
+	if ((wdl == EChessWDL::Win && !(dtzPairs.Flags & ETableFlags::WinPlies))
+		|| (wdl == EChessWDL::Loss && !(dtzPairs.Flags & ETableFlags::LossPlies))
+		|| wdl == EChessWDL::CursedWin
+		|| wdl == EChessWDL::BlessedLoss)
+	{
+		dtzValue *= 2;
+	}
+
+	return dtzValue + 1;
+}
+
+EChessWDL::Type FChessTablebase::SearchWDL(const FChessBitboardPosition& position, bool checkZeroingMoves, EProbeState& outState)
+{
+	// Tables hold no en passant rights and a stored value may be a don't care, so captures (and pawn moves for DTZ) are searched first
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+
+	EChessWDL::Type bestValue = EChessWDL::Loss;
+	int32 moveCount = 0;
+	for (const FChessMove& move : moves)
+	{
+		if (!move.IsCapture() && (!checkZeroingMoves || position.GetPiece(move.From) != EBitboardPiece::Pawn))
+			continue;
+
+		++moveCount;
+
+		FChessBitboardPosition next = position;
+		MakeMove(next, move);
+		const EChessWDL::Type value = Negate(SearchWDL(next, false, outState));
+		if (outState == EProbeState::Fail)
+			return EChessWDL::Draw;
+
+		if (value > bestValue)
+		{
+			bestValue = value;
+			if (value >= EChessWDL::Win)
+			{
+				outState = EProbeState::ZeroingBestMove;
+				return value;
+			}
+		}
+	}
+
+	// With every legal move searched the table isn't needed, and it could be wrong here
+	const bool noMoreMoves = moveCount > 0 && moveCount == moves.Num();
+	EChessWDL::Type value = bestValue;
+	if (!noMoreMoves)
+	{
+		value = static_cast<EChessWDL::Type>(ProbeTable(position, false, EChessWDL::Draw, outState));
+		if (outState == EProbeState::Fail)
+			return EChessWDL::Draw;
+	}
+
+	if (bestValue >= value)
+	{
+		outState = bestValue > EChessWDL::Draw || noMoreMoves ? EProbeState::ZeroingBestMove : EProbeState::Ok;
+		return bestValue;
+	}
+
+	outState = EProbeState::Ok;
+	return value;
+}
+
+int32 FChessTablebase::ProbeDTZ(const FChessBitboardPosition& position, EProbeState& outState)
+{
+	outState = EProbeState::Ok;
+	const EChessWDL::Type wdl = SearchWDL(position, true, outState);
+
+	// Draws aren't stored
+	if (outState == EProbeState::Fail || wdl == EChessWDL::Draw)
+		return 0;
+
+	// The best move zeroes, the stored value is a don't care
+	if (outState == EProbeState::ZeroingBestMove)
+		return GetDTZBeforeZeroing(wdl);
+
+	int32 dtz = ProbeTable(position, true, wdl, outState);
+	if (outState == EProbeState::Fail)
+		return 0;
+
+	if (outState != EProbeState::ChangeSide)
+		return (dtz + (wdl == EChessWDL::BlessedLoss || wdl == EChessWDL::CursedWin ? 100 : 0)) * FMath::Sign<int32>(wdl);
+
+	// The table stores the other side to move, take the best of the positions one move on
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+
+	int32 minDTZ = 0xFFFF;
+	for (const FChessMove& move : moves)
+	{
+		const bool zeroing = move.IsCapture() || position.GetPiece(move.From) == EBitboardPiece::Pawn;
+
+		FChessBitboardPosition next = position;
+		MakeMove(next, move);
+
+		// A zeroing move counts from before it is played, the search only tells whether it wins, draws or loses
+		dtz = zeroing ? -GetDTZBeforeZeroing(SearchWDL(next, false, outState)) : -ProbeDTZ(next, outState);
+		if (outState == EProbeState::Fail)
+			return 0;
+
+		if (dtz == 1 && IsInCheck(next))
+		{
+			FChessMoveList replies;
+			GenerateLegalMoves(next, replies);
+			if (replies.Num() == 0)
+				minDTZ = 1;
+		}
+
+		if (!zeroing)
+			dtz += FMath::Sign(dtz);
+
+		if (dtz < minDTZ && FMath::Sign(dtz) == FMath::Sign<int32>(wdl))
+			minDTZ = dtz;
+	}
+
+	outState = EProbeState::Ok;
+
+	// No legal moves, mated
+	return minDTZ == 0xFFFF ? -1 : minDTZ;
+}
+
+bool FChessTablebase::CanProbe(const FChessBitboardPosition& position) const
+{
+	// Tables know nothing of castling
+	return m_MaxPieces > 0
+		&& position.State.CastlingRights == ECastlingRights::None
+		&& FMath::CountBits(position.GetOccupancy()) <= m_MaxPieces;
+}
+
+bool FChessTablebase::ProbeWDL(const FChessBitboardPosition& position, EChessWDL::Type& outWDL)
+{
+	FScopeLock lock(&m_Lock);
+	ScanDirectory();
+
+	if (!CanProbe(position))
+		return false;
+
+	EProbeState state = EProbeState::Ok;
+	outWDL = SearchWDL(position, false, state);
+	return state != EProbeState::Fail;
+}
+
+bool FChessTablebase::ProbeDTZ(const FChessBitboardPosition& position, int32& outDTZ)
+{
+	FScopeLock lock(&m_Lock);
+	ScanDirectory();
+
+	if (!CanProbe(position))
+		return false;
+
+	EProbeState state = EProbeState::Ok;
+	outDTZ = ProbeDTZ(position, state);
+	return state != EProbeState::Fail;
+}
+
+bool FChessTablebase::ProbeRoot(const FChessBitboardPosition& position, FChessMove& outMove, EChessWDL::Type& outWDL, int32& outDTZ)
+{
+	FScopeLock lock(&m_Lock);
+	ScanDirectory();
+
+	if (!CanProbe(position))
+		return false;
+
+	FChessMoveList moves;
+	GenerateLegalMoves(position, moves);
+	if (moves.Num() == 0)
+		return false;
+
+	EProbeState state = EProbeState::Ok;
+	outWDL = SearchWDL(position, false, state);
+	if (state == EProbeState::Fail)
+		return false;
+
+	const int32 halfmoveClock = position.State.HalfmoveClock;
+	int32 bestRank = MIN_int32;
+	for (const FChessMove& move : moves)
+	{
+		FChessBitboardPosition next = position;
+		MakeMove(next, move);
+
+		// DTZ of the move counted from the root
+		int32 dtz = 0;
+		if (next.State.HalfmoveClock == 0)
+		{
+			dtz = GetDTZBeforeZeroing(Negate(SearchWDL(next, false, state)));
+		}
+		else
+		{
+			dtz = -ProbeDTZ(next, state);
+			dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : 0;
+		}
+
+		if (state == EProbeState::Fail)
+			return false;
+
+		if (dtz == 2 && IsInCheck(next))
+		{
+			FChessMoveList replies;
+			GenerateLegalMoves(next, replies);
+			if (replies.Num() == 0)
+				dtz = 1;
+		}
+
+		// Quickest win the 50 move rule allows, then wins it spoils, draws, losses it saves and the longest certain loss
+		const int32 rank = dtz > 0 ? (dtz + halfmoveClock <= 99 ? 2 * MAX_DTZ - dtz : MAX_DTZ - (dtz + halfmoveClock))
+			: dtz < 0 ? (-dtz * 2 + halfmoveClock < 100 ? -2 * MAX_DTZ - dtz : -MAX_DTZ + (-dtz + halfmoveClock))
+			: 0;
+
+		if (rank > bestRank)
+		{
+			bestRank = rank;
+			outMove = move;
+			outDTZ = dtz;
+		}
+	}
+
+	return true;
+}
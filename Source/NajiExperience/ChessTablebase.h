@@ -0,0 +1,89 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ChessBitboard.h"
+#include "HAL/CriticalSection.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+// Win/draw/loss from the point of view of the side to move. Cursed wins and blessed losses are draws under the 50 move rule.
+namespace EChessWDL
+{
+	enum Type : int8
+	{
+		Loss = -2,
+		BlessedLoss = -1,
+		Draw = 0,
+		CursedWin = 1,
+		Win = 2,
+	};
+}
+
+// Syzygy endgame tablebase prober. The directory is scanned for .rtbw (win/draw/loss) and .rtbz (distance to zeroing) files by the first probe,
+// a table is only mapped the first time a position of its material is probed. Decompressed blocks are kept in a bounded LRU cache,
+// probes into a cached block cost an index computation and a lookup. Probes are meant for worker tasks and are serialized on a lock.
+class FChessTablebase
+{
+public:
+	static constexpr int32 MAX_PIECES = 7;
+
+	FChessTablebase(const FString& directory, int32 maxCachedBlocks);
+	~FChessTablebase();
+
+	// Most pieces of any table found, 0 if the directory holds none
+	int32 GetMaxPieces();
+
+	bool ProbeWDL(const FChessBitboardPosition& position, EChessWDL::Type& outWDL);
+	// Plies to the next capture or pawn move with best play, positive when the side to move wins. 0 for draws.
+	bool ProbeDTZ(const FChessBitboardPosition& position, int32& outDTZ);
+	// Best move by DTZ: the quickest zeroing win the 50 move rule allows, else a draw, else the longest loss
+	bool ProbeRoot(const FChessBitboardPosition& position, FChessMove& outMove, EChessWDL::Type& outWDL, int32& outDTZ);
+
+private:
+	struct FPairsData;
+	struct FTable;
+	struct FTableFile;
+	struct FCachedBlock;
+
+	enum class EProbeState : int8
+	{
+		Fail, // Missing or broken table
+		Ok,
+		ChangeSide, // The DTZ table only stores the other side to move
+		ZeroingBestMove, // The best move is a capture or pawn move, the table value may not apply
+	};
+
+	// Lists the directory once, under the lock
+	void ScanDirectory();
+	bool CanProbe(const FChessBitboardPosition& position) const;
+
+	EChessWDL::Type SearchWDL(const FChessBitboardPosition& position, bool checkZeroingMoves, EProbeState& outState);
+	int32 ProbeDTZ(const FChessBitboardPosition& position, EProbeState& outState);
+	int32 ProbeTable(const FChessBitboardPosition& position, bool dtz, EChessWDL::Type wdl, EProbeState& outState);
+
+	FTable* FindTable(uint64 materialKey);
+	bool MapTable(FTable& table, bool dtz);
+	static void SetGroups(const FTable& table, FPairsData& pairs, const int32 (&order)[2], int32 file);
+	static const uint8* SetSizes(FPairsData& pairs, const uint8* data);
+	static uint8 SetSymLen(FPairsData& pairs, uint16 symbol, TBitArray<>& visited);
+
+	int32 DecompressPairs(const FPairsData& pairs, uint64 idx);
+	// Through the block cache, decompressing the block on a miss
+	const TArray<uint16>& GetBlock(const FPairsData& pairs, uint32 block);
+	static void DecompressBlock(const FPairsData& pairs, uint32 block, TArray<uint16>& outValues);
+
+	FCriticalSection m_Lock;
+	FString m_Directory;
+	bool m_Scanned = false;
+	int32 m_MaxPieces = 0;
+	TArray<TUniquePtr<FTable>> m_Tables;
+	TMap<uint64, int32> m_TableIndices; // Both colourings of every table's material
+
+	TArray<FCachedBlock> m_Blocks;
+	TMap<TPair<const FPairsData*, uint32>, int32> m_BlockIndices;
+	int32 m_MaxCachedBlocks = 0;
+	uint64 m_BlockUseCount = 0;
+};
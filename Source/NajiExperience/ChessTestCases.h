@@ -0,0 +1,45 @@
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ChessBitboard.h"
+
+// Positions and moves shared by the NajiExperience.Chess automation tests and the benchmark commandlet
+
+struct FChessPerftCase
+{
+	const TCHAR* Name;
+	const TCHAR* FEN;
+	int32 Depth; // Benchmark depth, the tests and -quick run a ply short of it
+	uint64 Nodes; // At Depth
+	uint64 ShallowNodes; // At Depth - 1
+};
+
+// Published counts from the chess programming wiki
+inline constexpr FChessPerftCase CHESS_PERFT_CASES[] =
+{
+	{ TEXT("StartPosition"), START_POSITION_FEN, 5, 4865609, 197281 },
+	{ TEXT("Kiwipete"), TEXT("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"), 4, 4085603, 97862 },
+	{ TEXT("Position3"), TEXT("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"), 6, 11030083, 674624 },
+	{ TEXT("Position4"), TEXT("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"), 5, 15833292, 422333 },
+	{ TEXT("Position5"), TEXT("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"), 4, 2103487, 62379 },
+	{ TEXT("Position6"), TEXT("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"), 4, 3894594, 89890 },
+};
+
+struct FChessTileMove
+{
+	int32 FromX;
+	int32 FromY;
+	int32 ToX;
+	int32 ToY;
+};
+
+// e4, d4, Nf3 and Nc3, each played and undone on its own
+inline constexpr FChessTileMove CHESS_ROUND_TRIP_MOVES[] =
+{
+	{ 4, 1, 4, 3 },
+	{ 3, 1, 3, 3 },
+	{ 6, 0, 5, 2 },
+	{ 1, 0, 2, 2 },
+};
@@ -0,0 +1,204 @@
+
+
+
+#include "ChessExperience.h"
+#include "ChessBitboard.h"
+#include "ChessBook.h"
+#include "ChessTestCases.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	struct FBookKeyCase
+	{
+		const TCHAR* FEN;
+		uint64 Key;
+	};
+
+	// Test keys from the Polyglot book format description, e4 d5 e5 f5 Ke2 Kf7 and a4 b5 h4 b4 c4 bxc3 Ra3
+	const FBookKeyCase BookKeyCases[] =
+	{
+		{ START_POSITION_FEN, 0x463B96181691FC9Cull },
+		{ TEXT("rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1"), 0x823C9B50FD114196ull },
+		{ TEXT("rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2"), 0x0756B94461C50FB0ull },
+		{ TEXT("rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2"), 0x662FAFB965DB29D4ull },
+		{ TEXT("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3"), 0x22A48B5A8E47FF78ull },
+		{ TEXT("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3"), 0x652A607CA3F242C1ull },
+		{ TEXT("rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4"), 0x00FDD303C946BDD9ull },
+		{ TEXT("rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3"), 0x3C8123EA7B067637ull },
+		{ TEXT("rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4"), 0x5C3F9B829B279560ull },
+	};
+
+	// 1. e4 e5 2. Nf3 Nc6, undone and redone as a whole
+	const FChessTileMove LineMoves[] =
+	{
+		{ 4, 1, 4, 3 },
+		{ 4, 6, 4, 4 },
+		{ 6, 0, 5, 2 },
+		{ 1, 7, 2, 5 },
+	};
+
+	// None of them a multiple of the 4 anims a vector register holds, so every batch ends on the scalar remainder
+	const int32 AnimBatchSizes[] = { 1, 3, 6, 13 };
+
+	bool IsSameBoard(const Chess::Board& a, const Chess::Board& b)
+	{
+		for (int32 x = 0; x < Chess::BOARD_SIZE; ++x)
+		{
+			for (int32 y = 0; y < Chess::BOARD_SIZE; ++y)
+			{
+				if (a.At(x, y) != b.At(x, y))
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FChessPerftTest, "NajiExperience.Chess.Perft", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FChessPerftTest::RunTest(const FString& Parameters)
+{
+	// A ply short of the benchmark depths to keep the test quick
+	for (const FChessPerftCase& perftCase : CHESS_PERFT_CASES)
+	{
+		FChessBitboardPosition position;
+		if (!TestTrue(FString::Printf(TEXT("%s parses"), perftCase.Name), ParseFEN(perftCase.FEN, position)))
+			continue;
+
+		const int32 depth = perftCase.Depth - 1;
+		TestEqual(FString::Printf(TEXT("%s perft %d"), perftCase.Name, depth), Perft(position, depth), perftCase.ShallowNodes);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FChessBookKeyTest, "NajiExperience.Chess.BookKey", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FChessBookKeyTest::RunTest(const FString& Parameters)
+{
+	for (const FBookKeyCase& keyCase : BookKeyCases)
+	{
+		FChessBitboardPosition position;
+		if (!TestTrue(FString::Printf(TEXT("%s parses"), keyCase.FEN), ParseFEN(keyCase.FEN, position)))
+			continue;
+
+		TestEqual(FString::Printf(TEXT("Polyglot key of %s"), keyCase.FEN), FChessOpeningBook::ComputeKey(position), keyCase.Key);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FChessAnimBatchTest, "NajiExperience.Chess.AnimBatch", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FChessAnimBatchTest::RunTest(const FString& Parameters)
+{
+	const float animDuration = 0.3f;
+	FRandomStream random(1234);
+
+	for (uint8 easing = EChessAnimEasing::Linear; easing <= EChessAnimEasing::SmoothStep; ++easing)
+	{
+		for (int32 num : AnimBatchSizes)
+		{
+			// Elapsed times run from the start to past the end of the anim, the exact end included
+			TArray<float> elapsed;
+			TArray<FVector2D> initial;
+			TArray<FVector2D> target;
+			for (int32 i = 0; i < num; ++i)
+			{
+				elapsed.Add(i == num / 2 ? animDuration : random.FRandRange(0.0f, animDuration * 1.5f));
+				initial.Add(FVector2D(random.FRandRange(-500.0f, 500.0f), random.FRandRange(-500.0f, 500.0f)));
+				target.Add(FVector2D(random.FRandRange(-500.0f, 500.0f), random.FRandRange(-500.0f, 500.0f)));
+			}
+
+			TArray<FVector2D> vectorized;
+			TArray<FVector2D> scalar;
+			vectorized.SetNumZeroed(num);
+			scalar.SetNumZeroed(num);
+			CalculateAnimBatch(static_cast<EChessAnimEasing::Type>(easing), animDuration, elapsed, initial, target, vectorized);
+			CalculateAnimBatchScalar(static_cast<EChessAnimEasing::Type>(easing), animDuration, elapsed, initial, target, scalar);
+
+			for (int32 i = 0; i < num; ++i)
+			{
+				TestTrue(FString::Printf(TEXT("Easing %d, anim %d of %d: %s vs %s"), easing, i, num, *vectorized[i].ToString(), *scalar[i].ToString()),
+					FMemory::Memcmp(&vectorized[i], &scalar[i], sizeof(FVector2D)) == 0);
+			}
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FChessGameRoundTripTest, "NajiExperience.Chess.GameRoundTrip", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FChessGameRoundTripTest::RunTest(const FString& Parameters)
+{
+	// Raw rules engine, no actor around it
+	ChessGame game;
+	AChessGame::SetupGame(nullptr, nullptr, game);
+
+	ChessGame initialGame;
+	AChessGame::SetupGame(nullptr, nullptr, initialGame);
+
+	for (const FChessTileMove& move : CHESS_ROUND_TRIP_MOVES)
+	{
+		game.EvaluateInstruction(MakeMoveInstruction(move.FromX, move.FromY, move.ToX, move.ToY));
+		TestEqual(TEXT("History after a move"), game.GetHistory().Num(), 1);
+
+		game.UndoInstruction();
+		TestEqual(TEXT("History after the undo"), game.GetHistory().Num(), 0);
+		TestTrue(TEXT("Board after the undo"), IsSameBoard(game.GetBoard(), initialGame.GetBoard()));
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FChessActorRoundTripTest, "NajiExperience.Chess.ActorRoundTrip", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FChessActorRoundTripTest::RunTest(const FString& Parameters)
+{
+	// Full actor pipeline, including the incremental piece and bitboard sync
+	UWorld* world = UWorld::CreateWorld(EWorldType::Game, false, TEXT("ChessRoundTripTest"));
+	FWorldContext& worldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	worldContext.SetCurrentWorld(world);
+
+	if (AChessGame* chessGame = world->SpawnActor<AChessGame>())
+	{
+		chessGame->Setup(nullptr, nullptr);
+		const uint64 initialKey = chessGame->GetPositionKey();
+
+		for (const FChessTileMove& move : CHESS_ROUND_TRIP_MOVES)
+		{
+			chessGame->EvaluateInstruction(MakeMoveInstruction(move.FromX, move.FromY, move.ToX, move.ToY));
+			TestNotEqual(TEXT("Key after a move"), chessGame->GetPositionKey(), initialKey);
+
+			chessGame->UndoLastInstruction();
+			TestEqual(TEXT("Key after the undo"), chessGame->GetPositionKey(), initialKey);
+		}
+
+		// The whole line at once, back and forth with a single refresh each way
+		for (const FChessTileMove& move : LineMoves)
+		{
+			chessGame->EvaluateInstruction(MakeMoveInstruction(move.FromX, move.FromY, move.ToX, move.ToY));
+		}
+		const uint64 lineKey = chessGame->GetPositionKey();
+		const int32 lineLength = UE_ARRAY_COUNT(LineMoves);
+
+		TestEqual(TEXT("Undone steps"), chessGame->UndoInstructions(lineLength), lineLength);
+		TestEqual(TEXT("Key after undoing the line"), chessGame->GetPositionKey(), initialKey);
+		TestEqual(TEXT("Redone steps"), chessGame->RedoInstructions(lineLength), lineLength);
+		TestEqual(TEXT("Key after redoing the line"), chessGame->GetPositionKey(), lineKey);
+
+		chessGame->Destroy();
+	}
+	else
+	{
+		AddError(TEXT("Could not spawn a chess game"));
+	}
+
+	GEngine->DestroyWorldContext(world);
+	world->DestroyWorld(false);
+	return true;
+}
+
+#endif